@@ -28,6 +28,24 @@
     } \
     std::string name##_str = std::string(name##_node->GetText()); \
 
+//可选的整型配置项,没有配置的时候保留默认值
+#define READ_OPT_INT_FROM_XML_NODE(name, parent, target) \
+    { \
+        TiXmlElement * name##_node = parent->FirstChildElement(#name); \
+        if (name##_node && name##_node->GetText()) { \
+            target = std::atoi(name##_node->GetText()); \
+        } \
+    } \
+
+//可选的字符串配置项
+#define READ_OPT_STR_FROM_XML_NODE(name, parent, target) \
+    { \
+        TiXmlElement * name##_node = parent->FirstChildElement(#name); \
+        if (name##_node && name##_node->GetText()) { \
+            target = std::string(name##_node->GetText()); \
+        } \
+    } \
+
 namespace rocket
 {
     Config * g_config = NULL;
@@ -81,6 +99,11 @@ namespace rocket
         m_log_sync_interval = std::atoi(log_sync_interval_str.c_str());        
 
         printf("LOG -- CONFIG LEVEL [%s], FILE_NAME [%s], FILE_PATH [%s],MAX_FILE_SIZE[%d B], SYNC_INTEVAL [%d ms] \n", m_log_level.c_str(), m_log_file_name.c_str(), m_log_file_path.c_str(), m_log_max_file_size, m_log_sync_interval);
+        READ_OPT_INT_FROM_XML_NODE(log_sample_every, log_node, m_log_sample_every);
+        printf("LOG -- SAMPLE_EVERY [%d] \n", m_log_sample_every);
+        READ_OPT_INT_FROM_XML_NODE(log_ring_size, log_node, m_log_ring_size);
+        READ_OPT_STR_FROM_XML_NODE(log_overflow_policy, log_node, m_log_overflow_policy);
+        printf("LOG -- RING_SIZE [%d B], OVERFLOW_POLICY [%s] \n", m_log_ring_size, m_log_overflow_policy.c_str());
 
         READ_STR_FROM_XML_NODE(port, server_node);
         READ_STR_FROM_XML_NODE(io_threads, server_node);
@@ -89,6 +112,35 @@ namespace rocket
         m_io_threads = std::atoi(io_threads_str.c_str());
         
         printf("Server -- PORT[%d], IO THREADS [%d] \n", m_port, m_io_threads);
+
+        READ_OPT_INT_FROM_XML_NODE(epoll_max_events, server_node, m_epoll_max_events);
+        READ_OPT_INT_FROM_XML_NODE(epoll_max_timeout, server_node, m_epoll_max_timeout);
+        printf("Server -- EPOLL_MAX_EVENTS[%d], EPOLL_MAX_TIMEOUT [%d ms] \n", m_epoll_max_events, m_epoll_max_timeout);
+        READ_OPT_STR_FROM_XML_NODE(io_placement, server_node, m_io_placement);
+        printf("Server -- IO_PLACEMENT [%s] \n", m_io_placement.c_str());
+        READ_OPT_INT_FROM_XML_NODE(reuse_port, server_node, m_reuse_port);
+        READ_OPT_INT_FROM_XML_NODE(accept_batch, server_node, m_accept_batch);
+        printf("Server -- REUSE_PORT [%d], ACCEPT_BATCH [%d] \n", m_reuse_port, m_accept_batch);
+        READ_OPT_INT_FROM_XML_NODE(conn_idle_timeout, server_node, m_conn_idle_timeout);
+        printf("Server -- CONN_IDLE_TIMEOUT [%d ms] \n", m_conn_idle_timeout);
+        READ_OPT_INT_FROM_XML_NODE(timer_slack_us, server_node, m_timer_slack_us);
+        printf("Server -- TIMER_SLACK [%d us] \n", m_timer_slack_us);
+        READ_OPT_STR_FROM_XML_NODE(io_thread_cpus, server_node, m_io_thread_cpus);
+        READ_OPT_STR_FROM_XML_NODE(main_thread_cpus, server_node, m_main_thread_cpus);
+        READ_OPT_STR_FROM_XML_NODE(log_thread_cpus, server_node, m_log_thread_cpus);
+        printf("Server -- IO_THREAD_CPUS [%s], MAIN_THREAD_CPUS [%s], LOG_THREAD_CPUS [%s] \n", m_io_thread_cpus.c_str(), m_main_thread_cpus.c_str(), m_log_thread_cpus.c_str());
+        READ_OPT_INT_FROM_XML_NODE(worker_threads, server_node, m_worker_threads);
+        READ_OPT_STR_FROM_XML_NODE(worker_services, server_node, m_worker_services);
+        printf("Server -- WORKER_THREADS [%d], WORKER_SERVICES [%s] \n", m_worker_threads, m_worker_services.c_str());
+        READ_OPT_INT_FROM_XML_NODE(client_pool_max_per_peer, server_node, m_client_pool_max_per_peer);
+        READ_OPT_INT_FROM_XML_NODE(client_pool_max_idle, server_node, m_client_pool_max_idle);
+        READ_OPT_INT_FROM_XML_NODE(client_pool_idle_timeout, server_node, m_client_pool_idle_timeout);
+        READ_OPT_INT_FROM_XML_NODE(client_max_inflight, server_node, m_client_max_inflight);
+        printf("Server -- CLIENT_POOL MAX_PER_PEER [%d], MAX_IDLE [%d], IDLE_TIMEOUT [%d ms], MAX_INFLIGHT [%d] \n", m_client_pool_max_per_peer, m_client_pool_max_idle, m_client_pool_idle_timeout, m_client_max_inflight);
+        READ_OPT_INT_FROM_XML_NODE(max_frame_size, server_node, m_max_frame_size);
+        printf("Server -- MAX_FRAME_SIZE [%d B] \n", m_max_frame_size);
+        READ_OPT_INT_FROM_XML_NODE(message_pool_size, server_node, m_message_pool_size);
+        printf("Server -- MESSAGE_POOL_SIZE [%d] \n", m_message_pool_size);
         
 
         
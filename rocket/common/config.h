@@ -20,9 +20,33 @@ namespace rocket
         std::string m_log_file_path;
         int m_log_max_file_size {0};
         int m_log_sync_interval {0};     //日志同步间隔，毫秒为单位 
+        int m_log_sample_every {1};     //请求路径上的日志每n次打印一次,1表示每次都打印
+        int m_log_ring_size {1024 * 1024};  //每个线程日志环的大小,字节
+        std::string m_log_overflow_policy {"drop"};   //日志环满了怎么办: drop丢弃并计数, block等日志线程取走
 
         int m_port {0};
         int m_io_threads {0};
+
+        int m_epoll_max_events {256};   //单次epoll_wait最多返回的事件数
+        int m_epoll_max_timeout {10000};    //epoll_wait最长等待时间,毫秒为单位
+        std::string m_io_placement {"round_robin"};  //新连接分配IO线程的策略: round_robin/least_conn/least_busy/p2c
+        int m_reuse_port {0};   //非0时每个IO线程用SO_REUSEPORT各自监听和accept
+        int m_accept_batch {64};    //每次监听套接字可读时最多accept的连接数
+        int m_conn_idle_timeout {0};    //连接空闲多久(ms)之后服务端主动关闭,0表示不关闭
+        int m_timer_slack_us {0};   //定时器到期时间合并的粒度,微秒为单位,0表示不合并
+        //绑核,格式同taskset -c,例如"0-3,8";io线程可以用';'分成多组,第i个线程用第(i % 组数)组,空表示不绑定
+        std::string m_io_thread_cpus;
+        std::string m_main_thread_cpus;
+        std::string m_log_thread_cpus;
+        //客户端连接池,按对端地址分组
+        int m_client_pool_max_per_peer {64};    //每个对端最多同时借出的连接数,0表示不限制
+        int m_client_pool_max_idle {8};     //每个对端最多保留的空闲连接数
+        int m_client_pool_idle_timeout {30000};    //空闲连接保留多久(ms)
+        int m_worker_threads {0};   //业务线程数,0表示rpc方法都在IO线程里执行
+        std::string m_worker_services;  //交给业务线程执行的服务名或方法全名,逗号分隔,空表示全部
+        int m_client_max_inflight {1};  //每个连接上最多同时在路上的请求数,大于1时多个请求复用一个连接
+        int m_max_frame_size {16 * 1024 * 1024};    //一个TinyPB包最大的字节数,超过的包头当作脏数据跳过
+        int m_message_pool_size {0};    //每个线程每种请求/响应消息最多缓存的个数,0表示不用对象池,消息分配在arena上
     };
 
 
@@ -2,10 +2,12 @@
 #include <sstream>
 #include <stdio.h>
 #include <assert.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
 #include "rocket/common/log.h"
 #include "rocket/common/util.h"
 #include "rocket/common/run_time.h"
-#include "rocket/net/eventloop.h"
 
 
 
@@ -13,12 +15,54 @@ namespace rocket
 {
 
     static Logger * g_logger = NULL;
+
+    //当前线程的日志环,线程退出时标记关闭,日志线程取完剩下的日志后释放
+    struct ThreadLogRing {
+        std::shared_ptr<LogRing> m_ring;
+        std::string m_args_buffer;  //序列化日志参数用的缓冲区
+        ~ThreadLogRing()
+        {
+            if (m_ring)
+            {
+                m_ring->close();
+            }
+        }
+    };
+    static thread_local ThreadLogRing t_log_ring;
+
+    //合并时使用的一条日志
+    struct LogRecord {
+        int64_t m_time;
+        int m_type;
+        std::string m_msg;
+    };
     Logger * Logger::GetGlobalLogger()
     {
         return g_logger;
     }
 
     Logger::Logger(LogLevel level, int type /*=1*/) : m_set_level(level), m_type(type) {
+        if (Config::GetGlobalConfig() && Config::GetGlobalConfig()->m_log_sample_every > 1)
+        {
+            m_sample_every = Config::GetGlobalConfig()->m_log_sample_every;
+        }
+        if (Config::GetGlobalConfig())
+        {
+            if (Config::GetGlobalConfig()->m_log_ring_size > 0)
+            {
+                m_ring_size = Config::GetGlobalConfig()->m_log_ring_size;
+            }
+            //太小的环放不下几条日志,很快写满之后不是丢日志就是阻塞等日志线程
+            if (m_ring_size < 4 * 1024)
+            {
+                m_ring_size = 4 * 1024;
+            }
+            if (Config::GetGlobalConfig()->m_log_sync_interval > 0)
+            {
+                m_sync_interval = Config::GetGlobalConfig()->m_log_sync_interval;
+            }
+            m_overflow_block = Config::GetGlobalConfig()->m_log_overflow_policy == "block";
+        }
         if (m_type == 0)
         {
             return;
@@ -39,36 +83,161 @@ namespace rocket
         {
             return;
         }
-        m_timer_event = std::make_shared<TimerEvent>(Config::GetGlobalConfig()->m_log_sync_interval, true, std::bind(&Logger::syncLoop, this));  
-        //成员函数，不是静态的，当作为回调函数的时候，需要指名一个this指针,因为普通的成员函数必须有对象才能调用
-        //如果是静态成员函数，就不需要绑定，直接传入就行了
-        EventLoop::GetCurrentEventLoop()->addTimerEvent(m_timer_event);
+        //不再挂在主线程的EventLoop上,日志环满了(block模式)要能随时唤醒日志线程,主线程自己写满时也不会卡死
+        sem_init(&m_sync_semaphore, 0, 0);
+        assert(pthread_create(&m_sync_thread, NULL, &Logger::Loop, this) == 0);
+    }
+
+    void * Logger::Loop(void * arg)
+    {
+        Logger * logger = reinterpret_cast<Logger*>(arg);
+        //日志线程自己不能打日志,绑核失败直接输出到标准错误
+        if (Config::GetGlobalConfig() && !bindCurrentThreadToCpus(Config::GetGlobalConfig()->m_log_thread_cpus)) {
+            fprintf(stderr, "Logger bind cpus [%s] error\n", Config::GetGlobalConfig()->m_log_thread_cpus.c_str());
+        }
+        while (1)
+        {
+            timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += logger->m_sync_interval / 1000;
+            deadline.tv_nsec += (logger->m_sync_interval % 1000) * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L)
+            {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            sem_timedwait(&logger->m_sync_semaphore, &deadline);
+            logger->syncLoop();
+        }
+        return NULL;
     }
 
     void Logger::syncLoop()
     {
-        //同步m_buffer 到 async_logger 的buffer队尾
-        // printf("sync to sync logger\n");
-        std::vector<std::string> tmp_vec;
-        ScopeMutex<Mutex> lock(m_mutex);
-        tmp_vec.swap(m_buffer); //指针交换动作
+        std::vector<std::shared_ptr<LogRing>> rings;
+        ScopeMutex<Mutex> lock(m_rings_mutex);
+        rings = m_rings;
         lock.unlock();
-        if (!tmp_vec.empty())
+
+        //只取这个时间点之前写入的日志,之后写入的留到下一次,避免先取的线程晚写的日志排到后取的线程前面
+        int64_t deadline = getNowUs();
+        std::vector<LogRecord> records;
+        std::vector<LogRing *> closed_rings;
+        LogRecordHeader header;
+        for (size_t i = 0; i < rings.size(); ++i)
+        {
+            //先看是否关闭再取,关闭之后不会再有新日志,取空就可以释放
+            bool closed = rings[i]->isClosed();
+            rings[i]->clearNotified();
+            while (true)
+            {
+                records.emplace_back();
+                if (!rings[i]->pop(closed ? INT64_MAX : deadline, header, records.back().m_msg))
+                {
+                    records.pop_back();
+                    break;
+                }
+                records.back().m_time = header.m_time;
+                records.back().m_type = header.m_type;
+                if (header.m_format != NULL)
+                {
+                    //调用线程只拷贝了参数,在这里格式化
+                    std::string & msg = records.back().m_msg;
+                    msg = header.m_format(msg.data(), (uint32_t)msg.length());
+                }
+            }
+            if (closed && rings[i]->empty())
+            {
+                closed_rings.push_back(rings[i].get());
+            }
+        }
+        if (!closed_rings.empty())
+        {
+            ScopeMutex<Mutex> lock2(m_rings_mutex);
+            m_rings.erase(std::remove_if(m_rings.begin(), m_rings.end(), [&closed_rings](const std::shared_ptr<LogRing> & ring) {
+                return std::find(closed_rings.begin(), closed_rings.end(), ring.get()) != closed_rings.end();
+            }), m_rings.end());
+            lock2.unlock();
+        }
+
+        //每个线程的日志本身是按时间有序的,稳定排序保证同一时刻写入的日志顺序不变
+        std::stable_sort(records.begin(), records.end(), [](const LogRecord & a, const LogRecord & b) {
+            return a.m_time < b.m_time;
+        });
+
+        std::vector<std::string> rpc_logs;
+        std::vector<std::string> app_logs;
+        uint64_t dropped = m_dropped.load(std::memory_order_relaxed);
+        if (dropped != m_reported_dropped)
+        {
+            rpc_logs.push_back(LogEvent(LogLevel::Error).format(ROCKET_LOG_FILE_LINE, "log ring full, dropped %llu logs, total dropped %llu",
+                (unsigned long long)(dropped - m_reported_dropped), (unsigned long long)dropped));
+            m_reported_dropped = dropped;
+        }
+        for (size_t i = 0; i < records.size(); ++i)
+        {
+            if (records[i].m_type == 0)
+            {
+                rpc_logs.push_back(std::move(records[i].m_msg));
+            }
+            else
+            {
+                app_logs.push_back(std::move(records[i].m_msg));
+            }
+        }
+        if (!rpc_logs.empty())
         {
-            m_asnyc_logger->pushLogBuffer(tmp_vec);
+            m_asnyc_logger->pushLogBuffer(rpc_logs);
         }
-        tmp_vec.clear();
-
-        //同步m_app_buffer 到 app_async_logger 的buffer队尾
-        std::vector<std::string> tmp_vec2;
-        ScopeMutex<Mutex> lock2(m_app_mutex);
-        tmp_vec2.swap(m_app_buffer); //指针交换动作
-        lock2.unlock();
-        if (!tmp_vec2.empty())
+        if (!app_logs.empty())
         {
-            m_asnyc_app_logger->pushLogBuffer(tmp_vec2);
+            m_asnyc_app_logger->pushLogBuffer(app_logs);
+        }
+    }
+
+    LogRing * Logger::getThreadRing()
+    {
+        if (!t_log_ring.m_ring)
+        {
+            t_log_ring.m_ring = std::make_shared<LogRing>(m_ring_size);
+            ScopeMutex<Mutex> lock(m_rings_mutex);
+            m_rings.push_back(t_log_ring.m_ring);
+            lock.unlock();
+        }
+        return t_log_ring.m_ring.get();
+    }
+
+    std::string & Logger::getThreadArgsBuffer()
+    {
+        return t_log_ring.m_args_buffer;
+    }
+
+    void Logger::pushRecord(int type, const std::string & msg, LogFormatter format /*= NULL*/)
+    {
+        LogRing * ring = getThreadRing();
+        if (format != NULL && sizeof(LogRecordHeader) + msg.length() > ring->capacity())
+        {
+            //序列化的参数不能截断,比整个环还大的日志在这里格式化,按普通日志截断
+            pushRecord(type, format(msg.data(), (uint32_t)msg.length()));
+            return;
+        }
+        int64_t now = getNowUs();
+        while (!ring->push(type, now, msg.data(), msg.length(), format))
+        {
+            if (!m_overflow_block)
+            {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            //唤醒日志线程取走日志,等一会再试
+            sem_post(&m_sync_semaphore);
+            usleep(100);
+        }
+        //写了一半就提前唤醒日志线程,不用等到同步间隔,尽量不丢/不阻塞
+        if (ring->used() > ring->capacity() / 2 && ring->markNotified())
+        {
+            sem_post(&m_sync_semaphore);
         }
-        tmp_vec2.clear();
     }
 
 
@@ -115,58 +284,125 @@ namespace rocket
         }
     }
 
+    //同一秒内的日志共用格式化好的秒级时间,不用每条都localtime_r + strftime
+    static thread_local time_t t_log_sec = -1;
+    static thread_local char t_log_sec_str[64];
+
+    //日志头部: [级别]\t[时间]\t[进程号:线程号]\t[msgid]\t[方法名]\t
+    static void appendLogHead(std::string & out, LogLevel level, const struct timeval & now_time, int32_t pid, int32_t thread_id,
+        const char * msgid, size_t msgid_len, const char * method_name, size_t method_name_len)
+    {
+        if (now_time.tv_sec != t_log_sec)
+        {
+            struct tm now_time_t;
+            localtime_r(&(now_time.tv_sec), &now_time_t);
+            strftime(t_log_sec_str, sizeof(t_log_sec_str), "%y-%m-%d %H:%M.%S", &now_time_t);
+            t_log_sec = now_time.tv_sec;
+        }
+        int ms = now_time.tv_usec / 1000;   //单位是微秒
+
+        char buf[256];
+        int len = snprintf(buf, sizeof(buf), "[%s]\t[%s.%d]\t[%d:%d]\t", LogLevelToString(level).c_str(), t_log_sec_str, ms, pid, thread_id);
+        out.append(buf, len);
+        if (msgid_len > 0) {
+            out.append("[").append(msgid, msgid_len).append("]\t");
+        }
+        if (method_name_len > 0) {
+            out.append("[").append(method_name, method_name_len).append("]\t");
+        }
+    }
+
     //格式化字符串
     std::string LogEvent::toString()
     {
         struct timeval now_time;
         gettimeofday(&now_time, nullptr);   //获取到当前时间
-        struct tm now_time_t;
-        localtime_r(&(now_time.tv_sec), &now_time_t);
-
-        char buf[128]; 
-        strftime(&buf[0], 128, "%y-%m-%d %H:%M.%S", &now_time_t);
-        std::string time_str(buf);
-        
-        int ms = now_time.tv_usec / 1000;   //单位是微秒
-        time_str = time_str + "." + std::to_string(ms);
-
         m_pid = getPid();
         m_thread_id = getThreadId();
 
+        //获取当前线程处理的请求的msgid
+        const std::string & msgid = RunTime::GetRunTime()->m_msgid;
+        const std::string & method_name = RunTime::GetRunTime()->m_method_name;
+        std::string re;
+        appendLogHead(re, m_level, now_time, m_pid, m_thread_id, msgid.data(), msgid.length(), method_name.data(), method_name.length());
+        return re;
+    }
 
-        std::stringstream ss;
-        ss << "[" << LogLevelToString(m_level) << "]\t"
-            << "[" << time_str << "]\t"
-            << "[" << m_pid << ":" << m_thread_id << "]\t";
+    //延迟格式化的记录: [LogRecordContext][msgid][方法名][参数]
+    struct LogRecordContext {
+        int64_t m_time_sec;
+        int64_t m_time_usec;
+        const char * m_file_line;   //字符串常量,一直有效
+        const char * m_str;         //字符串常量,一直有效
+        int32_t m_level;
+        int32_t m_pid;
+        int32_t m_thread_id;
+        uint32_t m_msgid_len;
+        uint32_t m_method_name_len;
+    };
+
+    char * beginLogRecord(std::string & out, LogLevel level, const char * file_line, const char * str, size_t args_len)
+    {
+        struct timeval now_time;
+        gettimeofday(&now_time, nullptr);
+        const std::string & msgid = RunTime::GetRunTime()->m_msgid;
+        const std::string & method_name = RunTime::GetRunTime()->m_method_name;
+        LogRecordContext context;
+        context.m_time_sec = now_time.tv_sec;
+        context.m_time_usec = now_time.tv_usec;
+        context.m_file_line = file_line;
+        context.m_str = str;
+        context.m_level = level;
+        context.m_pid = getPid();
+        context.m_thread_id = getThreadId();
+        context.m_msgid_len = msgid.length();
+        context.m_method_name_len = method_name.length();
+
+        size_t head_len = sizeof(context) + msgid.length() + method_name.length();
+        out.resize(head_len + args_len);
+        char * p = &out[0];
+        memcpy(p, &context, sizeof(context));
+        p += sizeof(context);
+        memcpy(p, msgid.data(), msgid.length());
+        p += msgid.length();
+        memcpy(p, method_name.data(), method_name.length());
+        return p + method_name.length();
+    }
 
-        //获取当前线程处理的请求的msgid
-        std::string msgid = RunTime::GetRunTime()->m_msgid;
-        std::string method_name = RunTime::GetRunTime()->m_method_name;
-        if (!msgid.empty()) {
-            ss << "[" << msgid << "]\t";
-        }
-        if (!method_name.empty()) {
-            ss << "[" << method_name << "]\t";
-        }
-        return ss.str();
+    const char * formatLogRecordHead(const char * data, std::string & result, const char * & file_line, const char * & str)
+    {
+        LogRecordContext context;
+        memcpy(&context, data, sizeof(context));
+        const char * msgid = data + sizeof(context);
+        const char * method_name = msgid + context.m_msgid_len;
+        struct timeval now_time;
+        now_time.tv_sec = context.m_time_sec;
+        now_time.tv_usec = context.m_time_usec;
+        appendLogHead(result, (LogLevel)context.m_level, now_time, context.m_pid, context.m_thread_id,
+            msgid, context.m_msgid_len, method_name, context.m_method_name_len);
+        file_line = context.m_file_line;
+        str = context.m_str;
+        return method_name + context.m_method_name_len;
     }
 
     void Logger::pushLog(const std::string & msg)
     {
         if (m_type == 0)    //同步日志
         {
-            printf((msg + "\n").c_str());
+            //msg已经带了换行;日志内容里可能有%,不能当格式串
+            fputs(msg.c_str(), stdout);
             return;
         }        
-        ScopeMutex<Mutex> lock(m_mutex);
-        m_buffer.push_back(msg);
-        lock.unlock(); 
+        pushRecord(0, msg);
     }
     void Logger::pushAppLog(const std::string & msg)
     {
-        ScopeMutex<Mutex> lock(m_app_mutex);
-        m_app_buffer.push_back(msg);
-        lock.unlock(); 
+        if (m_type == 0)    //同步日志,没有日志线程取日志环
+        {
+            fputs(msg.c_str(), stdout);
+            return;
+        }
+        pushRecord(1, msg);
     }
 
     //多个线程可能会同时调用log方法
@@ -195,6 +431,10 @@ namespace rocket
     void * AsyncLogger::Loop(void * arg) {
         //将buffer中的所有数据打印到文件中，然后线程睡眠，直到有新的数据将再重复这个过程
         AsyncLogger * logger = reinterpret_cast<AsyncLogger*>(arg);
+        //日志线程自己不能打日志,绑核失败直接输出到标准错误
+        if (Config::GetGlobalConfig() && !bindCurrentThreadToCpus(Config::GetGlobalConfig()->m_log_thread_cpus)) {
+            fprintf(stderr, "AsyncLogger bind cpus [%s] error\n", Config::GetGlobalConfig()->m_log_thread_cpus.c_str());
+        }
         assert(pthread_cond_init(&logger->m_condition, NULL) == 0);
         sem_post(&logger->m_semaphore);
         while (1)
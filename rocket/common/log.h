@@ -4,11 +4,15 @@
 
 #include <string>
 #include <queue>
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
 #include <memory>
+#include <type_traits>
 #include <semaphore.h>
 #include "rocket/common/config.h"
 #include "rocket/common/mutex.h"
-#include "rocket/net/timer_event.h"
+#include "rocket/common/log_ring.h"
 
 namespace rocket 
 //隔离库代码，防止命名空间污染
@@ -51,48 +55,64 @@ std::string formatString(const char * str, Args&&... args)  //接受一个C风
     在调用 `LOG` 宏时，我们可以像调用函数一样传入多个参数，这些参数会被替换为 `__VA_ARGS__`，然后传递给 `printf` 函数进行格式化输出。
     注意：`__VA_ARGS__` 必须始终与省略号 `...` 成对出现，并且在宏定义中必须放在最后。
     */
-#define DEBUGLOG(str, ...) \
-    if (rocket::Logger::GetGlobalLogger()->getLogLevel() <= rocket::Debug) \
-    { \
-        rocket::Logger::GetGlobalLogger()->pushLog(rocket::LogEvent(rocket::LogLevel::Debug).toString()\
-         + "[" + std::string(__FILE__) + ":" + std::to_string(__LINE__) + "]\t" + rocket::formatString(str, ##__VA_ARGS__) + "\n"); \
-    } \
-
-#define INFOLOG(str, ...) \
-    if (rocket::Logger::GetGlobalLogger()->getLogLevel() <= rocket::Info) \
-    { \
-        rocket::Logger::GetGlobalLogger()->pushLog(rocket::LogEvent(rocket::LogLevel::Info).toString()\
-         + "[" + std::string(__FILE__) + ":" +  std::to_string(__LINE__) + "]\t" + rocket::formatString(str, ##__VA_ARGS__) + "\n"); \
-    } \
-
-#define ERRORLOG(str, ...) \
-    if (rocket::Logger::GetGlobalLogger()->getLogLevel() <= rocket::Error) \
-    { \
-        rocket::Logger::GetGlobalLogger()->pushLog(rocket::LogEvent(rocket::LogLevel::Error).toString()\
-         + "[" + std::string(__FILE__) + ":" +  std::to_string(__LINE__) + "]\t" +  rocket::formatString(str, ##__VA_ARGS__) + "\n"); \
-    } \
-
-
-#define APPDEBUGLOG(str, ...) \
-    if (rocket::Logger::GetGlobalLogger()->getLogLevel() <= rocket::Debug) \
-    { \
-        rocket::Logger::GetGlobalLogger()->pushAppLog(rocket::LogEvent(rocket::LogLevel::Debug).toString()\
-         + "[" + std::string(__FILE__) + ":" + std::to_string(__LINE__) + "]\t" + rocket::formatString(str, ##__VA_ARGS__) + "\n"); \
-    } \
-
-#define APPINFOLOG(str, ...) \
-    if (rocket::Logger::GetGlobalLogger()->getLogLevel() <= rocket::Info) \
-    { \
-        rocket::Logger::GetGlobalLogger()->pushAppLog(rocket::LogEvent(rocket::LogLevel::Info).toString()\
-         + "[" + std::string(__FILE__) + ":" +  std::to_string(__LINE__) + "]\t" + rocket::formatString(str, ##__VA_ARGS__) + "\n"); \
-    } \
-
-#define APPERRORLOG(str, ...) \
-    if (rocket::Logger::GetGlobalLogger()->getLogLevel() <= rocket::Error) \
-    { \
-        rocket::Logger::GetGlobalLogger()->pushAppLog(rocket::LogEvent(rocket::LogLevel::Error).toString()\
-         + "[" + std::string(__FILE__) + ":" +  std::to_string(__LINE__) + "]\t" +  rocket::formatString(str, ##__VA_ARGS__) + "\n"); \
-    } \
+/*
+    编译期最低日志级别,低于它的日志调用整个被编译器删掉,参数也不会求值
+    1:DEBUG 2:INFO 3:ERROR,例如 make ROCKET_MIN_LOG_LEVEL=2 去掉所有DEBUG日志
+    运行时再按配置的log_level过滤,两个条件都满足才会记录
+    异步日志不在调用线程格式化: 参数拷进日志环,由日志线程格式化,所以格式串必须是字符串常量
+*/
+#ifndef ROCKET_MIN_LOG_LEVEL
+#define ROCKET_MIN_LOG_LEVEL 1
+#endif
+
+#define ROCKET_LOG_STR_HELPER(x) #x
+#define ROCKET_LOG_STR(x) ROCKET_LOG_STR_HELPER(x)
+//"文件:行号"在编译期拼成字符串常量,不用每次std::to_string
+#define ROCKET_LOG_FILE_LINE __FILE__ ":" ROCKET_LOG_STR(__LINE__)
+
+#define ROCKET_LOG_ENABLED(level) \
+    (ROCKET_MIN_LOG_LEVEL <= (level) && rocket::Logger::GetGlobalLogger()->getLogLevel() <= (level))
+
+//"" str 让非字符串常量的格式串编译不过,日志线程格式化时还要用这个指针
+#define ROCKET_LOG(level, type, str, ...) \
+    do { \
+        if (ROCKET_LOG_ENABLED(level)) \
+        { \
+            rocket::Logger::GetGlobalLogger()->logDeferred(type, level, ROCKET_LOG_FILE_LINE, "" str, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+//按调用点采样,每个调用点自己计数,每n次打印一次,n<=1时每次都打印
+#define ROCKET_LOG_EVERY_N(level, type, n, str, ...) \
+    do { \
+        if (ROCKET_LOG_ENABLED(level)) \
+        { \
+            static std::atomic<uint64_t> rocket_log_site_count {0}; \
+            uint64_t rocket_log_n = (n); \
+            if (rocket_log_n <= 1 || rocket_log_site_count.fetch_add(1, std::memory_order_relaxed) % rocket_log_n == 0) \
+            { \
+                rocket::Logger::GetGlobalLogger()->logDeferred(type, level, ROCKET_LOG_FILE_LINE, "" str, ##__VA_ARGS__); \
+            } \
+        } \
+    } while (0)
+
+//type 0:rpc日志 1:app日志
+#define DEBUGLOG(str, ...) ROCKET_LOG(rocket::Debug, 0, str, ##__VA_ARGS__)
+#define INFOLOG(str, ...) ROCKET_LOG(rocket::Info, 0, str, ##__VA_ARGS__)
+#define ERRORLOG(str, ...) ROCKET_LOG(rocket::Error, 0, str, ##__VA_ARGS__)
+
+#define APPDEBUGLOG(str, ...) ROCKET_LOG(rocket::Debug, 1, str, ##__VA_ARGS__)
+#define APPINFOLOG(str, ...) ROCKET_LOG(rocket::Info, 1, str, ##__VA_ARGS__)
+#define APPERRORLOG(str, ...) ROCKET_LOG(rocket::Error, 1, str, ##__VA_ARGS__)
+
+//指定采样间隔
+#define DEBUGLOG_EVERY_N(n, str, ...) ROCKET_LOG_EVERY_N(rocket::Debug, 0, n, str, ##__VA_ARGS__)
+#define INFOLOG_EVERY_N(n, str, ...) ROCKET_LOG_EVERY_N(rocket::Info, 0, n, str, ##__VA_ARGS__)
+#define APPINFOLOG_EVERY_N(n, str, ...) ROCKET_LOG_EVERY_N(rocket::Info, 1, n, str, ##__VA_ARGS__)
+
+//采样间隔取配置的log_sample_every,用在每个请求都会走到的日志上
+#define DEBUGLOG_SAMPLED(str, ...) DEBUGLOG_EVERY_N(rocket::Logger::GetGlobalLogger()->getSampleEvery(), str, ##__VA_ARGS__)
+#define INFOLOG_SAMPLED(str, ...) INFOLOG_EVERY_N(rocket::Logger::GetGlobalLogger()->getSampleEvery(), str, ##__VA_ARGS__)
 
 
 
@@ -105,6 +125,193 @@ enum LogLevel
     Error = 3
 };
 
+//在result后面追加: [文件:行号] + 内容 + 换行,只分配一次
+template<typename... Args>
+void appendLogBody(std::string & result, const char * file_line, const char * str, const Args &... args)
+{
+    size_t header_len = result.size();
+    size_t file_line_len = strlen(file_line);
+    int size = snprintf(nullptr, 0, str, args...);
+    if (size < 0)
+    {
+        size = 0;
+    }
+    result.resize(header_len + file_line_len + 3 + size + 1);
+    char * p = &result[header_len];
+    *p++ = '[';
+    memcpy(p, file_line, file_line_len);
+    p += file_line_len;
+    *p++ = ']';
+    *p++ = '\t';
+    snprintf(p, size + 1, str, args...);   //结尾的'\0'写在最后一个字符的位置上,下面换成换行
+    p[size] = '\n';
+}
+
+/*
+    延迟格式化的参数序列化: 基本类型和指针按值拷贝,字符串(char *)拷贝内容
+    调用返回之后字符串可能就释放了,日志线程格式化时用的是日志环里的副本
+*/
+template<typename T>
+struct LogArg {
+    static_assert(std::is_trivially_copyable<T>::value, "log argument must be a scalar or a C string");
+    typedef T type;     //日志线程里还原出来的类型
+    static size_t size(const T &)
+    {
+        return sizeof(T);
+    }
+    static char * store(char * p, const T & value)
+    {
+        memcpy(p, &value, sizeof(T));
+        return p + sizeof(T);
+    }
+    static const char * load(const char * p, T & value)
+    {
+        memcpy(&value, p, sizeof(T));
+        return p + sizeof(T);
+    }
+};
+
+//字符串: [长度][内容]['\0'],长度为UINT32_MAX表示空指针
+struct LogStringArg {
+    typedef const char * type;
+    static size_t size(const char * value)
+    {
+        return sizeof(uint32_t) + (value != NULL ? strlen(value) + 1 : 0);
+    }
+    static char * store(char * p, const char * value)
+    {
+        uint32_t len = value != NULL ? (uint32_t)strlen(value) : UINT32_MAX;
+        memcpy(p, &len, sizeof(len));
+        p += sizeof(len);
+        if (value == NULL)
+        {
+            return p;
+        }
+        memcpy(p, value, len + 1);
+        return p + len + 1;
+    }
+    static const char * load(const char * p, const char * & value)
+    {
+        uint32_t len = 0;
+        memcpy(&len, p, sizeof(len));
+        p += sizeof(len);
+        if (len == UINT32_MAX)
+        {
+            value = NULL;
+            return p;
+        }
+        value = p;
+        return p + len + 1;
+    }
+};
+template<>
+struct LogArg<char *> : public LogStringArg {};
+template<>
+struct LogArg<const char *> : public LogStringArg {};
+
+inline size_t logArgsSize()
+{
+    return 0;
+}
+template<typename T, typename... Rest>
+size_t logArgsSize(const T & value, const Rest &... rest)
+{
+    return LogArg<typename std::decay<T>::type>::size(value) + logArgsSize(rest...);
+}
+
+inline char * storeLogArgs(char * p)
+{
+    return p;
+}
+template<typename T, typename... Rest>
+char * storeLogArgs(char * p, const T & value, const Rest &... rest)
+{
+    p = LogArg<typename std::decay<T>::type>::store(p, value);
+    return storeLogArgs(p, rest...);
+}
+
+//按类型依次还原参数,全部还原之后格式化
+template<typename... Rest>
+struct LogArgReader;
+template<>
+struct LogArgReader<> {
+    template<typename... Got>
+    static void read(const char *, std::string & result, const char * file_line, const char * str, const Got &... got)
+    {
+        appendLogBody(result, file_line, str, got...);
+    }
+};
+template<typename T, typename... Rest>
+struct LogArgReader<T, Rest...> {
+    template<typename... Got>
+    static void read(const char * p, std::string & result, const char * file_line, const char * str, const Got &... got)
+    {
+        T value;
+        p = LogArg<T>::load(p, value);
+        LogArgReader<Rest...>::read(p, result, file_line, str, got..., value);
+    }
+};
+
+//在out里写入调用点的上下文(时间、线程、msgid等),返回参数区的位置,参数区留出args_len个字节
+char * beginLogRecord(std::string & out, LogLevel level, const char * file_line, const char * str, size_t args_len);
+//还原调用点的上下文并格式化出日志头部,返回参数区的位置
+const char * formatLogRecordHead(const char * data, std::string & result, const char * & file_line, const char * & str);
+
+//每种参数类型组合一个格式化函数,函数指针和序列化的参数一起放进日志环
+template<typename... Stored>
+struct LogRecordFormatter {
+    static std::string Format(const char * data, uint32_t)
+    {
+        std::string result;
+        const char * file_line = NULL;
+        const char * str = NULL;
+        const char * p = formatLogRecordHead(data, result, file_line, str);
+        LogArgReader<Stored...>::read(p, result, file_line, str);
+        return result;
+    }
+};
+
+//把一次日志调用序列化到out里,返回日志线程格式化用的函数
+template<typename... Args>
+LogFormatter serializeLog(std::string & out, LogLevel level, const char * file_line, const char * str, const Args &... args)
+{
+    char * p = beginLogRecord(out, level, file_line, str, logArgsSize(args...));
+    storeLogArgs(p, args...);
+    return &LogRecordFormatter<typename LogArg<typename std::decay<Args>::type>::type...>::Format;
+}
+
+
+class LogEvent
+{
+public:
+    LogEvent(LogLevel level): m_level(level) {};
+    std::string getFileName() const
+    {
+        return m_file_name;
+    }
+    LogLevel getLogLevel() const
+    {
+        return m_level;
+    }
+    std::string toString();
+    //一次分配拼好整条日志: 头部 + [文件:行号] + 内容 + 换行
+    template<typename... Args>
+    std::string format(const char * file_line, const char * str, Args&&... args)
+    {
+        std::string result = toString();
+        appendLogBody(result, file_line, str, args...);
+        return result;
+    }
+
+
+private:
+    std::string m_file_name;    //文件名
+    int32_t m_file_line;        //行号
+    int32_t m_pid;              //进程号
+    int32_t m_thread_id;        //线程号
+    LogLevel m_level;           //日志级别
+};
+
 
 class AsyncLogger {
 public:
@@ -147,24 +354,66 @@ class Logger
 public:
     typedef std::shared_ptr<Logger> s_ptr;
     Logger(LogLevel level, int type = 1);
-    void pushLog(const std::string & msg);  //将msg对象塞到buffer中
-    void pushAppLog(const std::string & msg);  //将msg对象塞到buffer中
+    void pushLog(const std::string & msg);  //将msg写到当前线程的日志环里
+    void pushAppLog(const std::string & msg);  //将msg写到当前线程的日志环里
+    //日志宏调用的入口,type 0:rpc日志 1:app日志
+    //异步日志只把参数序列化进当前线程的日志环,日志线程再格式化;同步日志直接格式化输出
+    template<typename... Args>
+    void logDeferred(int type, LogLevel level, const char * file_line, const char * str, const Args &... args)
+    {
+        if (m_type == 0)
+        {
+            std::string msg = LogEvent(level).format(file_line, str, args...);
+            type == 0 ? pushLog(msg) : pushAppLog(msg);
+            return;
+        }
+        std::string & buffer = getThreadArgsBuffer();
+        LogFormatter format = serializeLog(buffer, level, file_line, str, args...);
+        pushRecord(type, buffer, format);
+    }
     void init();
     void log(); //将buffer中的日志输出，后续优化 ① 异步 ② 输出到文件
     LogLevel getLogLevel() const 
     {
         return m_set_level;
     }
+    int getSampleEvery() const
+    {
+        return m_sample_every;
+    }
+    //取出所有线程日志环里的日志,按写入时间合并后交给AsyncLogger
     void syncLoop();
+    //日志环满了丢掉的日志条数
+    uint64_t getDroppedCount()
+    {
+        return m_dropped.load(std::memory_order_relaxed);
+    }
 public:
     static Logger * GetGlobalLogger();
     static void InitGlobalLogger(int type = 1);
+    static void * Loop(void *); //日志线程,定时或者被唤醒后执行syncLoop
+private:
+    //format不为NULL时msg是序列化的参数
+    void pushRecord(int type, const std::string & msg, LogFormatter format = NULL);
+    LogRing * getThreadRing();
+    //当前线程序列化日志参数用的缓冲区,反复使用不用每次分配
+    std::string & getThreadArgsBuffer();
 private:
     LogLevel m_set_level;   //日志级别
-    std::vector<std::string> m_buffer;  //底层rpc日志队列
-    std::vector<std::string> m_app_buffer;  //应用层日志
-    Mutex m_mutex;
-    Mutex m_app_mutex;
+    int m_sample_every {1}; //*_SAMPLED日志的采样间隔
+    /*
+        每个线程一个无锁的日志环,写日志时不和其他线程竞争
+        m_rings只在线程第一次写日志和日志线程释放已退出线程的环时加锁
+    */
+    std::vector<std::shared_ptr<LogRing>> m_rings;
+    Mutex m_rings_mutex;
+    int m_ring_size {1024 * 1024};
+    bool m_overflow_block {false};  //日志环满了: false丢弃并计数, true等日志线程取走
+    std::atomic<uint64_t> m_dropped {0};
+    uint64_t m_reported_dropped {0};    //已经写到日志里的丢弃条数,只在日志线程访问
+    int m_sync_interval {500};  //ms
+    sem_t m_sync_semaphore;     //日志环满了唤醒日志线程
+    pthread_t m_sync_thread;
 
     std::string m_file_name;    //日志输出文件名字
     std::string m_file_path;    //日志输出路径
@@ -172,8 +421,6 @@ private:
 
     AsyncLogger::s_ptr m_asnyc_logger;
     AsyncLogger::s_ptr m_asnyc_app_logger;
-    
-    TimerEvent::s_ptr m_timer_event;
 
     int m_type {0}; 
 };
@@ -183,29 +430,6 @@ std::string LogLevelToString(LogLevel level);
 LogLevel StringToLogLevel(const std::string & log_level);
 
 
-class LogEvent
-{
-public:
-    LogEvent(LogLevel level): m_level(level) {};
-    std::string getFileName() const
-    {
-        return m_file_name;
-    }
-    LogLevel getLogLevel() const
-    {
-        return m_level;
-    }
-    std::string toString();
-
-
-private:
-    std::string m_file_name;    //文件名
-    int32_t m_file_line;        //行号
-    int32_t m_pid;              //进程号
-    int32_t m_thread_id;        //线程号
-    LogLevel m_level;           //日志级别
-};
-
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,144 @@
+#ifndef ROCKET_COMMON_LOG_RING_H
+#define ROCKET_COMMON_LOG_RING_H
+
+#include <atomic>
+#include <string>
+#include <stdint.h>
+#include <string.h>
+
+namespace rocket {
+
+/*
+每个线程一个的日志环形缓冲区,无锁单生产者单消费者
+生产者是写日志的线程,消费者是日志线程;容量是2的幂次,读写位置只增不减,对容量取模
+每条记录是 [LogRecordHeader][日志内容],记录可以跨越环尾
+日志内容可以是格式化好的一行,也可以是序列化的参数,由日志线程调用m_format格式化
+*/
+//把序列化的参数格式化成完整的一行日志,在日志线程里调用
+typedef std::string (*LogFormatter)(const char * data, uint32_t len);
+
+struct LogRecordHeader {
+    uint32_t m_len;   //日志内容长度,不含头部
+    int32_t m_type;   //0:rpc日志 1:app日志
+    int64_t m_time;   //写入时间(us),用于合并各个线程的日志
+    LogFormatter m_format;  //NULL表示日志内容已经格式化好了
+};
+
+class LogRing {
+public:
+    LogRing(int size) {
+        //至少要能放下一个头部加上内容,否则截断长度会下溢
+        m_size = 1;
+        while (m_size < (uint64_t)size || m_size <= sizeof(LogRecordHeader)) {
+            m_size <<= 1;
+        }
+        m_buffer = new char[m_size];
+    }
+
+    ~LogRing() {
+        delete[] m_buffer;
+    }
+
+    LogRing(const LogRing &) = delete;
+    LogRing & operator=(const LogRing &) = delete;
+
+    //生产者调用,空间不够时返回false;超过容量的日志截断,序列化的参数不能截断,调用方要先检查长度
+    bool push(int type, int64_t time, const char * data, uint32_t len, LogFormatter format = NULL) {
+        if (sizeof(LogRecordHeader) + len > m_size) {
+            len = m_size - sizeof(LogRecordHeader);
+        }
+        uint64_t write_pos = m_write_pos.load(std::memory_order_relaxed);
+        uint64_t need = sizeof(LogRecordHeader) + len;
+        if (need > m_size - (write_pos - m_read_pos.load(std::memory_order_acquire))) {
+            return false;
+        }
+        LogRecordHeader header;
+        header.m_len = len;
+        header.m_type = type;
+        header.m_time = time;
+        header.m_format = format;
+        copyIn(write_pos, (const char *)&header, sizeof(header));
+        copyIn(write_pos + sizeof(header), data, len);
+        m_write_pos.store(write_pos + need, std::memory_order_release);
+        return true;
+    }
+
+    //消费者调用,只取写入时间不晚于deadline的一条记录,没有时返回false
+    bool pop(int64_t deadline, LogRecordHeader & header, std::string & data) {
+        uint64_t read_pos = m_read_pos.load(std::memory_order_relaxed);
+        if (read_pos == m_write_pos.load(std::memory_order_acquire)) {
+            return false;
+        }
+        copyOut(read_pos, (char *)&header, sizeof(header));
+        if (header.m_time > deadline) {
+            return false;
+        }
+        data.resize(header.m_len);
+        if (header.m_len > 0) {
+            copyOut(read_pos + sizeof(header), &data[0], header.m_len);
+        }
+        m_read_pos.store(read_pos + sizeof(header) + header.m_len, std::memory_order_release);
+        return true;
+    }
+
+    //已经写入还没有取走的字节数,生产者调用
+    uint64_t used() {
+        return m_write_pos.load(std::memory_order_relaxed) - m_read_pos.load(std::memory_order_acquire);
+    }
+
+    uint64_t capacity() {
+        return m_size;
+    }
+
+    //超过一半时生产者唤醒一次日志线程,日志线程取完后清掉,避免每条日志都唤醒
+    bool markNotified() {
+        return !m_notified.exchange(true, std::memory_order_acq_rel);
+    }
+
+    void clearNotified() {
+        m_notified.store(false, std::memory_order_release);
+    }
+
+    bool empty() {
+        return m_read_pos.load(std::memory_order_acquire) == m_write_pos.load(std::memory_order_acquire);
+    }
+
+    //所属线程退出后设置,日志线程取完剩下的日志就可以释放
+    void close() {
+        m_closed.store(true, std::memory_order_release);
+    }
+
+    bool isClosed() {
+        return m_closed.load(std::memory_order_acquire);
+    }
+
+private:
+    //最多分成两段拷贝
+    void copyIn(uint64_t pos, const char * src, uint64_t len) {
+        uint64_t index = pos & (m_size - 1);
+        uint64_t first = len < m_size - index ? len : m_size - index;
+        memcpy(m_buffer + index, src, first);
+        memcpy(m_buffer, src + first, len - first);
+    }
+
+    void copyOut(uint64_t pos, char * dst, uint64_t len) {
+        uint64_t index = pos & (m_size - 1);
+        uint64_t first = len < m_size - index ? len : m_size - index;
+        memcpy(dst, m_buffer + index, first);
+        memcpy(dst + first, m_buffer, len - first);
+    }
+
+private:
+    std::atomic<uint64_t> m_write_pos {0};    //生产者一侧
+    char m_pad[64];   //读写位置放在不同的cache line,避免伪共享
+    std::atomic<uint64_t> m_read_pos {0};     //消费者一侧
+    char m_pad2[64];
+    uint64_t m_size {0};
+    char * m_buffer {NULL};
+    std::atomic<bool> m_closed {false};
+    std::atomic<bool> m_notified {false};
+};
+
+}
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef ROCKET_COMMON_MPSC_QUEUE_H
+#define ROCKET_COMMON_MPSC_QUEUE_H
+
+#include <atomic>
+#include <stddef.h>
+
+namespace rocket {
+
+/*
+侵入式的无锁多生产者单消费者队列(Vyukov MPSC)
+需要入队的对象继承MpscNode,队列本身不分配内存
+push可以在任意线程调用,只需要一次原子交换;pop/empty只能在消费者线程调用
+生产者正在插入的瞬间,消费者可能暂时看不到这个节点(pop返回NULL),插入完成后就能看到
+*/
+struct MpscNode {
+    std::atomic<MpscNode *> m_mpsc_next {NULL};
+};
+
+class MpscQueue {
+public:
+    MpscQueue() : m_head(&m_stub), m_tail(&m_stub) {
+    }
+
+    void push(MpscNode * node) {
+        node->m_mpsc_next.store(NULL, std::memory_order_relaxed);
+        MpscNode * prev = m_head.exchange(node, std::memory_order_acq_rel);
+        prev->m_mpsc_next.store(node, std::memory_order_release);
+    }
+
+    MpscNode * pop() {
+        MpscNode * tail = m_tail;
+        MpscNode * next = tail->m_mpsc_next.load(std::memory_order_acquire);
+        if (tail == &m_stub) {
+            if (next == NULL) {
+                return NULL;
+            }
+            m_tail = next;
+            tail = next;
+            next = next->m_mpsc_next.load(std::memory_order_acquire);
+        }
+        if (next != NULL) {
+            m_tail = next;
+            return tail;
+        }
+        MpscNode * head = m_head.load(std::memory_order_acquire);
+        if (tail != head) {
+            //生产者交换了head但是还没有链接上,下次再取
+            return NULL;
+        }
+        //tail是最后一个节点,先把stub放回去才能把tail取出来
+        push(&m_stub);
+        next = tail->m_mpsc_next.load(std::memory_order_acquire);
+        if (next != NULL) {
+            m_tail = next;
+            return tail;
+        }
+        return NULL;
+    }
+
+    bool empty() {
+        return m_tail == &m_stub && m_stub.m_mpsc_next.load(std::memory_order_acquire) == NULL;
+    }
+
+private:
+    std::atomic<MpscNode *> m_head;   //生产者一侧
+    char m_pad[64];   //和消费者的数据分开放在不同的cache line,避免伪共享
+    MpscNode * m_tail;    //消费者一侧
+    MpscNode m_stub;
+
+};
+
+}
+
+#endif
@@ -26,28 +26,27 @@ namespace rocket
                 ERRORLOG("read from /dev/urandom/error");
                 return "";
             }
+            t_max_msg_id_no.clear();
             for (int i = 0; i < g_msg_id_length; i++)
             {
                 uint8_t x = ((uint8_t)(res[i])) % 10;
                 res[i] = x + '0';
                 t_max_msg_id_no += "9";
             }
-            t_max_msg_id_no = res;
+            t_msg_id_no = res;
         } 
         else 
         {
-            size_t i = t_msg_id_no.length() - 1; 
-            while (t_msg_id_no[i] == '9' && i >= 0)
+            //从末位开始加1,遇到9进位变0;全是9的情况在上面已经重新随机了
+            int i = (int)t_msg_id_no.length() - 1; 
+            while (i >= 0 && t_msg_id_no[i] == '9')
             {
+                t_msg_id_no[i] = '0';
                 i--;
             }
             if (i >= 0)
             {
                 t_msg_id_no[i] += 1;
-                for (size_t j = i + 1; i < t_msg_id_no.length(); j++)
-                {
-                    t_msg_id_no[j] = '0';
-                }
             }
         }
         return t_msg_id_no;
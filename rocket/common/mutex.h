@@ -20,19 +20,23 @@ class ScopeMutex {
   }
 
   ~ScopeMutex() {
-    m_mutex.unlock();
-    m_is_lock = false;
+    if (m_is_lock) {
+      m_mutex.unlock();
+      m_is_lock = false;
+    }
   }
 
   void lock() {
     if (!m_is_lock) {
       m_mutex.lock();
+      m_is_lock = true;
     }
   }
 
   void unlock() {
     if (m_is_lock) {
       m_mutex.unlock();
+      m_is_lock = false;
     }
   }
   pthread_mutex_t * getMutex()
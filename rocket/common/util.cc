@@ -1,8 +1,16 @@
 #include <arpa/inet.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <vector>
 #include <sys/syscall.h>
 #include <sys/time.h>
+#include <time.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
 #include "rocket/common/util.h"
+#include "rocket/common/log.h"
 
 namespace rocket
 {
@@ -15,7 +23,8 @@ namespace rocket
         {
             return g_pid;
         }
-        return getpid();
+        g_pid = getpid();
+        return g_pid;
     }
     pid_t getThreadId()
     {
@@ -23,7 +32,8 @@ namespace rocket
         {
             return t_thread_id;
         }
-        return syscall(SYS_gettid);
+        t_thread_id = syscall(SYS_gettid);
+        return t_thread_id;
     }
 
     int64_t getNowMs() {
@@ -32,6 +42,12 @@ namespace rocket
         return val.tv_sec * 1000 +  val.tv_usec / 1000;
     }
 
+    int64_t getNowUs() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    }
+
     //这个函数的作用是将网络字节序转换为主机字节序
     int32_t getInt32FromNetByte(const char * buf)
     {
@@ -40,6 +56,106 @@ namespace rocket
         return ntohl(re);
     }
 
+    //解析一个cpu编号,必须整个字符串都是数字并且在cpu_set_t能表示的范围内
+    static bool parseCpuIndex(const std::string & str, int & cpu)
+    {
+        if (str.empty())
+        {
+            return false;
+        }
+        char * end = NULL;
+        errno = 0;
+        long value = strtol(str.c_str(), &end, 10);
+        if (end == str.c_str() || *end != '\0' || errno == ERANGE || value < 0 || value >= CPU_SETSIZE)
+        {
+            return false;
+        }
+        cpu = (int)value;
+        return true;
+    }
+
+    bool bindCurrentThreadToCpus(const std::string & cpu_list)
+    {
+        if (cpu_list.empty())
+        {
+            return true;
+        }
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        long cpu_count = sysconf(_SC_NPROCESSORS_CONF);
+        size_t pos = 0;
+        while (pos < cpu_list.size())
+        {
+            size_t end = cpu_list.find(',', pos);
+            if (end == std::string::npos)
+            {
+                end = cpu_list.size();
+            }
+            std::string item = cpu_list.substr(pos, end - pos);
+            pos = end + 1;
+            if (item.empty())
+            {
+                continue;
+            }
+            //单个cpu或者a-b的范围,有一项写错整个列表都不用,避免全部绑到0号核上
+            size_t dash = item.find('-');
+            int first = 0;
+            int last = 0;
+            if (!parseCpuIndex(item.substr(0, dash), first)
+                || !parseCpuIndex(dash == std::string::npos ? item : item.substr(dash + 1), last)
+                || last < first)
+            {
+                //日志器还没创建时(比如AsyncLogger线程里)不能打日志,由调用方处理
+                if (Logger::GetGlobalLogger())
+                {
+                    ERRORLOG("invalid cpu list [%s], bad item [%s]", cpu_list.c_str(), item.c_str());
+                }
+                return false;
+            }
+            if (cpu_count > 0 && last >= cpu_count)
+            {
+                if (Logger::GetGlobalLogger())
+                {
+                    ERRORLOG("invalid cpu list [%s], cpu %d out of range, only %ld cpus", cpu_list.c_str(), last, cpu_count);
+                }
+                return false;
+            }
+            for (int cpu = first; cpu <= last; ++cpu)
+            {
+                CPU_SET(cpu, &cpus);
+            }
+        }
+        if (CPU_COUNT(&cpus) == 0)
+        {
+            return false;
+        }
+        return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+    }
+
+    std::string pickCpuList(const std::string & cpu_lists, int index)
+    {
+        std::vector<std::string> groups;
+        size_t pos = 0;
+        while (pos <= cpu_lists.size())
+        {
+            size_t end = cpu_lists.find(';', pos);
+            if (end == std::string::npos)
+            {
+                end = cpu_lists.size();
+            }
+            if (end > pos)
+            {
+                groups.push_back(cpu_lists.substr(pos, end - pos));
+            }
+            pos = end + 1;
+        }
+        if (groups.empty())
+        {
+            return "";
+        }
+        return groups[index % groups.size()];
+    }
+
 
 
 
@@ -6,13 +6,20 @@
 
 #include <sys/types.h>
 #include <unistd.h>
+#include <string>
 
 namespace rocket
 {
     pid_t getPid();
     pid_t getThreadId();
     int64_t getNowMs();
+    //单调时钟,微秒,不受系统时间调整的影响,定时器都用这个
+    int64_t getNowUs();
     int32_t getInt32FromNetByte(const char * buf);
+    //把当前线程绑定到cpu_list上,格式和taskset -c一样,比如"0-3,8",空串表示不绑定
+    bool bindCurrentThreadToCpus(const std::string & cpu_list);
+    //按照';'分成多组,第index个线程用第index % 组数个
+    std::string pickCpuList(const std::string & cpu_lists, int index);
 }
 
 
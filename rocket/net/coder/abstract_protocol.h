@@ -2,6 +2,7 @@
 #define ROCKET_NET_ABSTRACT_PROTOCOL_H
 
 #include <memory>
+#include <string>
 #include "rocket/net/tcp/tcp_buffer.h"
 
 //抽象的协议基类
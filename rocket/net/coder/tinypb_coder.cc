@@ -1,160 +1,205 @@
 #include <vector>
 #include <string.h>
 #include <arpa/inet.h>
+#include <google/protobuf/message.h>
 #include "rocket/net/coder/tinypb_coder.h"
 #include "rocket/net/coder/tinypb_protocol.h"
 #include "rocket/common/util.h"
 #include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/common/error_code.h"
 
 namespace rocket
 {
+    static const int g_min_pk_len = 2 + 24;    //开始符和结束符 + 6个int32字段, 一个包最少有这么长
+    static const int g_default_max_pk_len = 16 * 1024 * 1024;
+
+    TinyPBCoder::TinyPBCoder()
+    {
+        m_max_pk_len = g_default_max_pk_len;
+        if (Config::GetGlobalConfig() && Config::GetGlobalConfig()->m_max_frame_size >= g_min_pk_len)
+        {
+            m_max_pk_len = Config::GetGlobalConfig()->m_max_frame_size;
+        }
+    }
+
     //将message对象转换为字节流，并写入到buffer中
     void TinyPBCoder::encode(std::vector<AbstractProtocol::s_ptr> &messages, TcpBuffer::s_ptr out_buffer)
     {
         for (auto &i : messages)
         {
             std::shared_ptr<TinyPBProtocol> msg = std::dynamic_pointer_cast<TinyPBProtocol>(i);
-            int len = 0;
-            //将一个message对象转换为buf
-            const char * buf = encodeTinyPB(msg,  len);
-            if (buf != NULL && len != 0) 
-            {
-                out_buffer->writeToBuffer(buf, len);
-            }
-            if (buf)
-            {
-                free ((void *)buf);
-                buf = NULL;
-            }
+            //直接编码到out_buffer中,不再申请临时内存
+            encodeTinyPB(msg, out_buffer);
         }
     }
     void TinyPBCoder::decode(std::vector<AbstractProtocol::s_ptr> &out_messages, TcpBuffer::s_ptr buffer)
     {
-        while (1)
+        // 直接在TcpBuffer上原地扫描, 不再把整个m_buffer拷贝一份
+        // 上一次留下了半包并且数据还没到齐, 就不用再从readIndex()开始重新扫描了
+        if (m_pending_pk_len > 0 && buffer->readAble() < m_pending_pk_len)
+        {
+            DEBUGLOG("decode wait for partial package, need %d bytes, now %d bytes", m_pending_pk_len, buffer->readAble());
+            return;
+        }
+        m_pending_pk_len = 0;
+
+        while (buffer->readAble() > 0)
         {
-            // 解码
-            // 遍历buffer，找到PB_START，找到之后解析出整包的长度，得到结束符位置，校验结束符是不是0x03，如果是
-            // 说明数据包合法
-            std::vector<char> tmp = buffer->m_buffer;
-            int start_index = buffer->readIndex();
-            int end_index = -1;
-            int pk_len = 0;
-            bool parse_success = false; // 说明读成功了
-            int i = 0;
-            for (i = start_index; i < buffer->writeIndex(); i++)
+            // 找到PB_START, 前面的脏数据直接丢掉; 可读区域最多被环尾分成两段
+            struct iovec iov[2];
+            int iov_count = buffer->readIovec(iov);
+            int skip = 0;
+            bool find_start = false;
+            for (int k = 0; k < iov_count && !find_start; k++)
             {
-                if (tmp[i] == TinyPBProtocol::PB_START)
-                { // 读下去四个字节，由于是网络字节序，需要转换为主机字节序
-                    if (i + 1 < buffer->writeIndex())
-                    { // pk_len
-                        pk_len = getInt32FromNetByte(&tmp[i + 1]);
-                        DEBUGLOG("get pk_len = %d", pk_len);
-                        // 结束符的索引
-                        int j = i + pk_len - 1;
-                        if (j >= buffer->writeIndex())
-                        {
-                            continue; // 说明没有读到整个包
-                        }
-                        if (tmp[j] == TinyPBProtocol::PB_END)
-                        {
-                            // 下次遍历从这里开始
-                            start_index = i;
-                            end_index = j;
-                            parse_success = true;
-                            break;
-                        }
-                    }
+                const char *seg = reinterpret_cast<const char *>(iov[k].iov_base);
+                const char *start = reinterpret_cast<const char *>(memchr(seg, TinyPBProtocol::PB_START, iov[k].iov_len));
+                if (start != NULL)
+                {
+                    skip += start - seg;
+                    find_start = true;
+                }
+                else
+                {
+                    skip += iov[k].iov_len;
                 }
             }
-            if (i >= buffer->writeIndex())
+            if (skip > 0)
+            {
+                ERRORLOG("decode skip %d invalid bytes before PB_START", skip);
+                buffer->moveReadIndex(skip);
+            }
+            if (!find_start)
             {
                 DEBUGLOG("decode end, read all buffer data");
                 return;
             }
-            if (parse_success)
-            {
-                buffer->moveReadIndex(end_index - start_index + 1); // 移动成功读取的字节数个字节
-                std::shared_ptr<TinyPBProtocol> message = std::make_shared<TinyPBProtocol>();
-                message->m_pk_len = pk_len;
-
-                int req_id_len_index = start_index + sizeof(char) + sizeof(message->m_pk_len);
-                if (req_id_len_index >= end_index)
-                {
-                    // 说明包有问题
-                    message->parse_success = false;
-                    ERRORLOG("parse error, req_id_len_index[%d] > end_index[%d]", req_id_len_index, end_index);
-                    continue;
-                }
-                // 包没问题，继续往下读
-                message->m_msg_id_len = getInt32FromNetByte(&tmp[req_id_len_index]);
-                DEBUGLOG("parse req_id_len = %d", message->m_msg_id_len);
-
-                int req_id_index = req_id_len_index + sizeof(message->m_msg_id_len);
-                char req_id[100] = {0};
-                memcpy(&req_id[0], &tmp[req_id_index], message->m_msg_id_len);
-                message->m_msg_id = std::string(req_id);
-                DEBUGLOG("parse req_id = %s", message->m_msg_id.c_str());
-
-                int method_name_len_index = req_id_index + message->m_msg_id_len;
-                if (method_name_len_index >= end_index)
-                {
-                    message->parse_success = false;
-                    ERRORLOG("parse error, method_name_len_index[%d] > end_index[%d]", req_id_len_index, end_index);
-                    continue;
-                }
-                message->m_method_name_len = getInt32FromNetByte(&tmp[method_name_len_index]);
 
-                int method_name_index = method_name_len_index + sizeof(message->m_method_name_len);
-                char method_name[512] = {0};
-                memcpy(&method_name[0], &tmp[method_name_index], message->m_method_name_len);
-                message->m_method_name = std::string(method_name);
-                DEBUGLOG("parse method_name = %s", message->m_method_name.c_str());
-
-                int err_code_index = method_name_index + message->m_method_name_len;
-                if (err_code_index >= end_index)
+            // 此时包头就在readIndex()处, 剩余的字节都属于这个包
+            int available = buffer->readAble();
+            if (available < (int)(sizeof(char) + sizeof(int32_t)))
+            {
+                m_pending_pk_len = sizeof(char) + sizeof(int32_t);
+                return;
+            }
+            char pk_len_buf[sizeof(int32_t)];
+            buffer->peek(pk_len_buf, sizeof(pk_len_buf), sizeof(char));
+            int pk_len = getInt32FromNetByte(pk_len_buf);
+            DEBUGLOG("get pk_len = %d", pk_len);
+            if (pk_len < g_min_pk_len || pk_len > m_max_pk_len)
+            {
+                // 不是一个合法的包头, 跳过这个字节继续找
+                // 长度过大时不能当半包等下去, 否则连接会一直等数据, 缓冲区也会跟着涨
+                if (pk_len > m_max_pk_len)
                 {
-                    message->parse_success = false;
-                    ERRORLOG("parse error, err_code_index[%d] > end_index[%d]", req_id_len_index, end_index);
-                    continue;
+                    ERRORLOG("decode invalid pk_len %d, exceed max frame size %d, skip", pk_len, m_max_pk_len);
                 }
-                message->m_err_code = getInt32FromNetByte(&tmp[err_code_index]);
+                buffer->moveReadIndex(1);
+                continue;
+            }
+            if (available < pk_len)
+            {
+                // 半包, 记下需要的长度, 数据没到齐之前不再扫描
+                m_pending_pk_len = pk_len;
+                DEBUGLOG("decode get partial package, need %d bytes, now %d bytes", pk_len, available);
+                return;
+            }
+            char end_flag = 0;
+            buffer->peek(&end_flag, sizeof(end_flag), pk_len - 1);
+            if (end_flag != TinyPBProtocol::PB_END)
+            {
+                buffer->moveReadIndex(1);
+                continue;
+            }
 
-                int error_info_len_index = err_code_index + sizeof(message->m_err_code);
-                if (error_info_len_index >= end_index)
-                {
-                    message->parse_success = false;
-                    ERRORLOG("parse error, error_info_len_index[%d] > end_index[%d]", req_id_len_index, end_index);
-                    continue;
-                }
-                message->m_err_info_len = getInt32FromNetByte(&tmp[error_info_len_index]);
-
-                int error_info_index = error_info_len_index + sizeof(message->m_err_info_len);
-                char error_info[512] = {0};
-                memcpy(&error_info[0], &tmp[error_info_index], message->m_err_info_len);
-                message->m_err_info = std::string(error_info);
-                DEBUGLOG("parse error_info = %s", message->m_err_info.c_str());
-
-                int pb_data_len = message->m_pk_len - message->m_method_name_len - message->m_msg_id_len - message->m_err_info_len - 2 - 24;
-                int pb_data_index = error_info_index + message->m_err_info_len;
-                message->m_pb_data = std::string(&tmp[pb_data_index], pb_data_len);
-                // 这里校验和去解析
-                message->parse_success = true;
+            // 包在环里面是连续的就直接指向缓冲区, 只有跨越环尾的那一个包需要拷贝
+            const char *pk = buffer->peekContiguous(pk_len);
+            std::shared_ptr<TinyPBProtocol> message = std::make_shared<TinyPBProtocol>();
+            message->m_pk_len = pk_len;
+            if (parseTinyPB(message, pk, pk_len))
+            {
                 out_messages.push_back(message);
             }
+            // 只移动读指针, 不会搬移数据, 所以message里面的视图在dispatcher处理完之前一直有效
+            buffer->moveReadIndex(pk_len);
+        }
+    }
+
+    // 在[pk, pk + pk_len)这段内存上解析一个完整的包, 字段都直接从缓冲区构造, 不经过栈上的临时数组
+    bool TinyPBCoder::parseTinyPB(std::shared_ptr<TinyPBProtocol> message, const char *pk, int pk_len)
+    {
+        // 去掉结束符和校验和, 剩下的才是可以放字段的区域
+        const char *end = pk + pk_len - sizeof(char) - sizeof(message->m_check_sum);
+        const char *tmp = pk + sizeof(char) + sizeof(message->m_pk_len);
+
+        message->m_msg_id_len = getInt32FromNetByte(tmp);
+        tmp += sizeof(message->m_msg_id_len);
+        if (message->m_msg_id_len < 0 || message->m_msg_id_len > end - tmp)
+        {
+            ERRORLOG("parse error, invalid req_id_len[%d]", message->m_msg_id_len);
+            return false;
+        }
+        message->m_msg_id.assign(tmp, message->m_msg_id_len);
+        tmp += message->m_msg_id_len;
+        DEBUGLOG("parse req_id = %s", message->m_msg_id.c_str());
+
+        if (end - tmp < (int)sizeof(message->m_method_name_len))
+        {
+            ERRORLOG("parse error, no method_name_len, req_id[%s]", message->m_msg_id.c_str());
+            return false;
+        }
+        message->m_method_name_len = getInt32FromNetByte(tmp);
+        tmp += sizeof(message->m_method_name_len);
+        if (message->m_method_name_len < 0 || message->m_method_name_len > end - tmp)
+        {
+            ERRORLOG("parse error, invalid method_name_len[%d], req_id[%s]", message->m_method_name_len, message->m_msg_id.c_str());
+            return false;
+        }
+        message->m_method_name.assign(tmp, message->m_method_name_len);
+        tmp += message->m_method_name_len;
+        DEBUGLOG("parse method_name = %s", message->m_method_name.c_str());
+
+        if (end - tmp < (int)(sizeof(message->m_err_code) + sizeof(message->m_err_info_len)))
+        {
+            ERRORLOG("parse error, no err_code and err_info_len, req_id[%s]", message->m_msg_id.c_str());
+            return false;
+        }
+        message->m_err_code = getInt32FromNetByte(tmp);
+        tmp += sizeof(message->m_err_code);
+        message->m_err_info_len = getInt32FromNetByte(tmp);
+        tmp += sizeof(message->m_err_info_len);
+        if (message->m_err_info_len < 0 || message->m_err_info_len > end - tmp)
+        {
+            ERRORLOG("parse error, invalid err_info_len[%d], req_id[%s]", message->m_err_info_len, message->m_msg_id.c_str());
+            return false;
         }
+        message->m_err_info.assign(tmp, message->m_err_info_len);
+        tmp += message->m_err_info_len;
+        DEBUGLOG("parse error_info = %s", message->m_err_info.c_str());
+
+        // 剩下的就是pb_data
+        message->m_pb_data_view = tmp;
+        message->m_pb_data_view_len = end - tmp;
+        message->m_check_sum = getInt32FromNetByte(end);
+        // 这里校验和去解析
+        message->parse_success = true;
+        return true;
     }
-    const char *TinyPBCoder::encodeTinyPB(std::shared_ptr<TinyPBProtocol> message, int &len)
+    bool TinyPBCoder::encodeTinyPB(std::shared_ptr<TinyPBProtocol> message, TcpBuffer::s_ptr out_buffer)
     {
         if (message->m_msg_id.empty())
         {
             message->m_msg_id = "123456789";
         }
         DEBUGLOG("req_id = %s", message->m_msg_id.c_str());
-        int pk_len = 2 + 24 + message->m_msg_id.length() + message->m_method_name.length() + message->m_err_info.length() + message->m_pb_data.length();
+        //有pb对象时先算出序列化后的长度,后面直接序列化到缓冲区里
+        int pb_data_len = message->m_pb_message ? (int)message->m_pb_message->ByteSizeLong() : (int)message->m_pb_data.length();
+        int pk_len = 2 + 24 + message->m_msg_id.length() + message->m_method_name.length() + message->m_err_info.length() + pb_data_len;
         DEBUGLOG("pk_len = %d", pk_len);
 
-        char *buf = reinterpret_cast<char *>(malloc(pk_len));
-        char *tmp = buf;
+        //在out_buffer中预留出整包的连续空间,直接往里面写
+        char *tmp = out_buffer->reserveWrite(pk_len);
         *tmp = TinyPBProtocol::PB_START;
         tmp++;
 
@@ -199,7 +244,23 @@ namespace rocket
             tmp += err_info_len;
         }
 
-        if (!message->m_pb_data.empty())
+        if (message->m_pb_message)
+        {
+            //上面刚调用过ByteSizeLong,可以直接用缓存的大小序列化
+            uint8_t *end = message->m_pb_message->SerializeWithCachedSizesToArray(reinterpret_cast<uint8_t *>(tmp));
+            if (end - reinterpret_cast<uint8_t *>(tmp) != pb_data_len)
+            {
+                //没有提交写入,预留的空间会被覆盖掉;改成同一个msg_id的错误包发出去,对端不用等到超时
+                ERRORLOG("%s | encode error, serialize pb message failed, send error frame instead", message->m_msg_id.c_str());
+                message->m_pb_message.reset();
+                message->m_pb_data.clear();
+                message->m_err_code = ERROR_FAILED_SERIALIZE;
+                message->m_err_info = "serilize error";
+                return encodeTinyPB(message, out_buffer);
+            }
+            tmp += pb_data_len;
+        }
+        else if (!message->m_pb_data.empty())
         {
             memcpy(tmp, &(message->m_pb_data[0]), message->m_pb_data.length());
             tmp += message->m_pb_data.length();
@@ -210,17 +271,16 @@ namespace rocket
         tmp += sizeof(check_sum_net);
 
         *tmp = TinyPBProtocol::PB_END;
+        out_buffer->commitWrite(pk_len);
         
         message->m_pk_len = pk_len;
         message->m_msg_id_len = req_id_len;
         message->m_method_name_len = method_name_len;
         message->m_err_info_len = err_info_len;
         message->parse_success = true;
-        len = pk_len;
 
         DEBUGLOG("encode message[%s]", message->m_msg_id.c_str());
-        return buf;
-
+        return true;
     }
 
 }
@@ -10,15 +10,21 @@ namespace rocket
 class TinyPBCoder : public AbstractCoder 
 {
 public:
-    TinyPBCoder() {}
+    TinyPBCoder();
     ~TinyPBCoder() {}
 public:
     void encode(std::vector<AbstractProtocol::s_ptr> & messages, TcpBuffer::s_ptr out_buffer);
     void decode(std::vector<AbstractProtocol::s_ptr> & out_messages, TcpBuffer::s_ptr buffer);
 
 private:
-    //传入PB对象返回字节流及长度
-    const char * encodeTinyPB(std::shared_ptr<TinyPBProtocol> message, int &len);
+    //把PB对象直接编码到out_buffer里面,返回是否成功
+    bool encodeTinyPB(std::shared_ptr<TinyPBProtocol> message, TcpBuffer::s_ptr out_buffer);
+    //解析一个完整的包, pk指向PB_START
+    bool parseTinyPB(std::shared_ptr<TinyPBProtocol> message, const char * pk, int pk_len);
+
+private:
+    int m_pending_pk_len {0};   //上次decode留下的半包需要的总字节数,为0表示没有半包
+    int m_max_pk_len {0};   //包长上限,超过的包头不可信
 };
 
 
@@ -4,6 +4,12 @@
 #include <string>
 #include "rocket/net/coder/abstract_protocol.h"
 
+namespace google {
+namespace protobuf {
+class Message;
+}
+}
+
 namespace rocket {
 struct TinyPBProtocol : public AbstractProtocol 
 {
@@ -23,9 +29,41 @@ public:
     int32_t m_err_code {0}; //错误码
     int32_t m_err_info_len {0}; //错误信息长度
     std::string m_err_info;     //错误信息
-    std::string m_pb_data;  //protobuf字节流
+    std::string m_pb_data;  //protobuf字节流,encode时使用
+    //设置了m_pb_message时, encode直接把它序列化到输出缓冲区, 不再经过m_pb_data
+    std::shared_ptr<google::protobuf::Message> m_pb_message;
     int32_t m_check_sum {0};    //校验和
     bool parse_success {false};
+
+    //msg_id、方法名和错误信息decode时仍然拷贝成string,不做视图:
+    //msg_id要做客户端等待回包的key、写进RunTime、拷贝到回包里,方法名要查分发表,都会比输入缓冲区活得久
+    //代价是每个包最多三次短拷贝;20字节的msg_id超过短字符串优化的长度,每个包一次堆分配,
+    //方法名不超过15字节、错误信息为空(请求都是空的)时不分配
+
+    //decode得到的protobuf字节流不再拷贝,而是指向输入缓冲区的视图
+    //视图在该连接下一次往输入缓冲区写数据之前有效,也就是dispatcher同步处理完这一批请求之前都有效
+    //如果需要跨越这个时间使用(比如交给其他线程),要先调用materialize()拷贝出来
+    const char * m_pb_data_view {NULL};
+    int32_t m_pb_data_view_len {0};
+
+    const char * pbData() const
+    {
+        return m_pb_data_view != NULL ? m_pb_data_view : m_pb_data.data();
+    }
+    int32_t pbDataLen() const
+    {
+        return m_pb_data_view != NULL ? m_pb_data_view_len : (int32_t)m_pb_data.length();
+    }
+    //把视图拷贝成自己持有的m_pb_data,之后不再依赖输入缓冲区
+    void materialize()
+    {
+        if (m_pb_data_view != NULL)
+        {
+            m_pb_data.assign(m_pb_data_view, m_pb_data_view_len);
+            m_pb_data_view = NULL;
+            m_pb_data_view_len = 0;
+        }
+    }
 };
 
 
@@ -4,6 +4,7 @@
 #include <string.h>
 #include "rocket/net/eventloop.h"
 #include "rocket/common/util.h"
+#include "rocket/common/config.h"
 
 //首先判断之前是否添加过fd，如果之前添加过，就变成修改
 #define ADD_TO_EPOLL() \
@@ -13,10 +14,14 @@
         op = EPOLL_CTL_MOD;  }  \
     epoll_event tmp = event->getEpollEvent(); \
     int rt = epoll_ctl(m_epoll_fd, op, event->getFd(), &tmp); \
+    if (rt == -1 && op == EPOLL_CTL_MOD && errno == ENOENT) { \
+        /*fd关闭时没有先从epoll里删掉,fd号又被复用了,重新添加*/ \
+        rt = epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, event->getFd(), &tmp); \
+    } \
     if (rt == -1) { \
         ERRORLOG("failed epoll_ctl when add fd %d, errno=%d, error=%s", event->getFd(), errno, strerror(errno)); \
     } \
-    m_listen_fds.insert(event->getFd()); \
+    m_listen_fds[event->getFd()] = event->getGeneration(); \
     DEBUGLOG("add event success, fd[%d]", event->getFd()); \
 
 #define DELETE_TO_EPOLL() \
@@ -38,8 +43,6 @@
 namespace rocket {
 
 static thread_local EventLoop * t_current_eventloop = NULL;     //利用线程局部变量判断当前线程有没有创建过EventLoop
-static int g_epoll_max_timeout = 10000; //10s
-static int g_epoll_max_events = 10;     //单次最大的event监听事件
 
 EventLoop::EventLoop() {
     if (t_current_eventloop != NULL) {
@@ -48,6 +51,12 @@ EventLoop::EventLoop() {
     }
 
     m_thread_id = getThreadId();
+    //默认值从配置中读取,每个loop还可以单独调整
+    if (Config::GetGlobalConfig()) {
+        m_epoll_max_events = Config::GetGlobalConfig()->m_epoll_max_events;
+        m_epoll_max_timeout = Config::GetGlobalConfig()->m_epoll_max_timeout;
+    }
+    setEpollMaxEvents(m_epoll_max_events);
     m_epoll_fd = epoll_create(1024);    //参数随便给一个正数就行，Linux 2.6.8以后这个参数就没什么用了
     if (m_epoll_fd == -1) {
         ERRORLOG("failed to create event loop, epoll_create error, error info[%d]\n", errno);
@@ -74,15 +83,43 @@ EventLoop::~EventLoop() {   //一般来说调用不到
         delete m_timer;
         m_timer = NULL;
     }
+    MpscNode * node = NULL;
+    while ((node = m_pending_tasks.pop()) != NULL) {
+        delete static_cast<PendingTask *>(node);
+    }
 }
 
 void EventLoop::initTimer() {
     m_timer = new Timer();
+    if (Config::GetGlobalConfig()) {
+        m_timer->setSlack(Config::GetGlobalConfig()->m_timer_slack_us);
+    }
     addEpollEvent(m_timer);
 }
 
 void EventLoop::addTimerEvent(TimerEvent::s_ptr event) {
-    m_timer->addTimerEvent(event);
+    //定时器不加锁,只能在IO线程里操作,其他线程转成任务交给IO线程
+    if (isInLoopThread()) {
+        m_timer->addTimerEvent(event);
+        return;
+    }
+    Timer * timer = m_timer;
+    addTask([timer, event]() {
+        timer->addTimerEvent(event);
+    }, true);
+}
+
+void EventLoop::deleteTimerEvent(TimerEvent::s_ptr event) {
+    if (isInLoopThread()) {
+        m_timer->deleteTimerEvent(event);
+        return;
+    }
+    //先打上取消标记,保证就算还没从堆里删掉也不会执行
+    event->setCancel(true);
+    Timer * timer = m_timer;
+    addTask([timer, event]() {
+        timer->deleteTimerEvent(event);
+    }, true);
 }
 
 void EventLoop::initWakeUpFdEvent() {
@@ -96,46 +133,74 @@ void EventLoop::initWakeUpFdEvent() {
     addEpollEvent(m_wakeup_fd_event);
 }
 
+//忙碌时间的统计周期
+static const int64_t g_busy_window_us = 100000;
+
 void EventLoop::loop() {
     m_is_loopping = true;
+    int64_t busy_begin = getNowUs();
+    m_busy_window_begin = busy_begin;
     while (!m_stop_flag) {
-        ScopeMutex<Mutex> lock(m_mutex);
-        std::queue<std::function<void()>> tmp_tasks;
-        m_pending_tasks.swap(tmp_tasks);
-        lock.unlock();
-        while (!tmp_tasks.empty()) {
-            std::function<void()> cb = tmp_tasks.front();
-            tmp_tasks.pop();
-            if (cb) {
-                cb();
-            }
-        }
+        runPendingTasks();
         
         //如果有定时任务需要执行，那么执行 
         //1.如何判断定时任务是否需要执行？ now()>TimerEvent.arrtive_time
         //2.如何在arrtive_time让epoll_wait返回,也就是如何让event_loop监听arrive_time
 
-        int timeout = g_epoll_max_timeout;   
-        epoll_event result_events [g_epoll_max_events];
+        int timeout = m_epoll_max_timeout;   
+        //执行任务的过程中又有新的任务加进来,就不要阻塞在epoll_wait上了
+        if (!m_pending_tasks.empty()) {
+            timeout = 0;
+        }
+        //从上次epoll_wait返回到现在都在干活
+        int64_t now = getNowUs();
+        m_busy_us += now - busy_begin;
+        if (now - m_busy_window_begin >= g_busy_window_us) {
+            m_recent_busy_us.store(m_busy_us * 1000000 / (now - m_busy_window_begin));
+            m_busy_us = 0;
+            m_busy_window_begin = now;
+        }
         //DEBUGLOG("now begin to epoll_wait");
-        int rt = epoll_wait(m_epoll_fd, result_events, g_epoll_max_events, timeout);
+        m_wait_begin.store(now, std::memory_order_relaxed);
+        int rt = epoll_wait(m_epoll_fd, &m_result_events[0], m_epoll_max_events, timeout);
+        busy_begin = getNowUs();
+        m_wait_begin.store(0, std::memory_order_relaxed);
         DEBUGLOG("now end epoll_wait, rt = %d", rt);
+        m_epoll_wait_count.fetch_add(1, std::memory_order_relaxed);
         if (rt < 0) {
-            ERRORLOG("epoll_wait error, errno = ", errno);
+            ERRORLOG("epoll_wait error, errno = %d", errno);
         } else {
+            if (rt == m_epoll_max_events) {
+                //事件数组被填满了,可能还有就绪的事件要等下一轮才能拿到
+                m_epoll_full_count.fetch_add(1, std::memory_order_relaxed);
+            }
             for (int i = 0; i < rt; ++i) {
-                epoll_event trigger_event = result_events[i];
+                epoll_event trigger_event = m_result_events[i];
                 FdEvent * fd_event = static_cast<FdEvent *>(trigger_event.data.ptr);
                 if (fd_event == NULL) {
                     continue;
                 }
+                //同一批结果里前面的回调已经把这个fd删掉并关闭了,fd号可能已经被别的IO线程复用,不能再碰这个FdEvent
+                if (!isListening(fd_event)) {
+                    DEBUGLOG("fd %d stale epoll event, skip", fd_event->getFd());
+                    continue;
+                }
+                //就绪事件的回调直接在这里执行,不再经过加锁的任务队列,只有跨线程的任务才放进队列
+                //回调执行过程中可能会重新listen替换掉自己,所以先拷贝一份再执行
+                //读回调里可能已经关闭了连接,后面的写/错误回调执行之前都要再检查一次
                 if (trigger_event.events & EPOLLIN) {
                     DEBUGLOG("fd %d trigger EPOLLIN event", fd_event->getFd());
-                    addTask(fd_event->handler(FdEvent::IN_EVENT));  //取读回调函数，再把回调函数放到执行队列里面
+                    std::function<void()> cb = fd_event->handler(FdEvent::IN_EVENT);
+                    if (cb) {
+                        cb();
+                    }
                 }
-                if (trigger_event.events & EPOLLOUT) {
+                if ((trigger_event.events & EPOLLOUT) && isListening(fd_event)) {
                     DEBUGLOG("fd %d trigger EPOLLOUT event", fd_event->getFd());
-                    addTask(fd_event->handler(FdEvent::OUT_EVENT));
+                    std::function<void()> cb = fd_event->handler(FdEvent::OUT_EVENT);
+                    if (cb) {
+                        cb();
+                    }
                 }
                 // if (!(trigger_event.events & EPOLLIN) && !(trigger_event.events & EPOLLOUT))
                 // {
@@ -143,15 +208,16 @@ void EventLoop::loop() {
                 //     DEBUGLOG("unknow event = %d", event);
                 // }
                 //EPOLLHUP or EPOERROR
-                if (trigger_event.events & EPOLLERR)
+                if ((trigger_event.events & EPOLLERR) && isListening(fd_event))
                 {
                     DEBUGLOG("fd %d trigger EPOLLERRO event", fd_event->getFd());
                     //删除出错的套接字
                     delEpollEvent(fd_event);
-                    if (fd_event->handler(FdEvent::ERROR_EVENT) != nullptr)
+                    std::function<void()> cb = fd_event->handler(FdEvent::ERROR_EVENT);
+                    if (cb)
                     {
-                        DEBUGLOG("fd %d add error callback", fd_event->getFd());
-                        addTask(fd_event->handler(FdEvent::OUT_EVENT));
+                        DEBUGLOG("fd %d run error callback", fd_event->getFd());
+                        cb();
                     }
                 }
             }
@@ -159,6 +225,11 @@ void EventLoop::loop() {
         }
     }
 }
+bool EventLoop::isListening(FdEvent * event) {
+    auto it = m_listen_fds.find(event->getFd());
+    return it != m_listen_fds.end() && it->second == event->getGeneration();
+}
+
 void EventLoop::wakeup() {
     INFOLOG("wake up fd = %d", m_wakeup_fd);
     m_wakeup_fd_event->wakeup();
@@ -176,7 +247,13 @@ void EventLoop::addEpollEvent(FdEvent * event) {
         ADD_TO_EPOLL();
     } else {
         //如果不是当前线程，要用回调函数
+        //执行之前fd已经关闭(FdEvent被reset过)就不再添加,否则会改到复用了这个fd号的新连接
+        uint32_t generation = event->getGeneration();
         auto cb = [=]() {
+            if (event->getGeneration() != generation) {
+                DEBUGLOG("fd %d closed before add to epoll, skip", event->getFd());
+                return;
+            }
             ADD_TO_EPOLL();
         };
         addTask(cb, true);
@@ -186,21 +263,40 @@ void EventLoop::delEpollEvent(FdEvent * event) {
     if (isInLoopThread()) {
        DELETE_TO_EPOLL();
     } else {
+        uint32_t generation = event->getGeneration();
         auto cb = [=] () {
+            if (event->getGeneration() != generation) {
+                return;
+            }
             DELETE_TO_EPOLL();
         };
         addTask(cb, true);
     }
 }
 void EventLoop::addTask(std::function<void()> cb, bool is_wake_up) {
-    ScopeMutex<Mutex> lock(m_mutex);
-    m_pending_tasks.push(cb);
-    lock.unlock();
-    if (is_wake_up) {
+    PendingTask * task = new PendingTask();
+    task->m_cb.swap(cb);
+    m_pending_tasks.push(task);
+    //只有第一个放任务的人需要写wakeup fd,loop取任务之前其他人都不用再写了
+    //loop线程自己放的任务在下一轮就会执行,不需要唤醒
+    if (is_wake_up && !isInLoopThread() && !m_wakeup_pending.exchange(true)) {
         wakeup();
     }    
 }
 
+void EventLoop::runPendingTasks() {
+    //先清掉标志再取任务,清掉之后再放进来的任务会重新唤醒
+    m_wakeup_pending.store(false);
+    MpscNode * node = NULL;
+    while ((node = m_pending_tasks.pop()) != NULL) {
+        PendingTask * task = static_cast<PendingTask *>(node);
+        if (task->m_cb) {
+            task->m_cb();
+        }
+        delete task;
+    }
+}
+
 bool EventLoop::isInLoopThread() {
     return getThreadId() == m_thread_id;
 }
@@ -216,6 +312,72 @@ bool EventLoop::isLooping() {
     return m_is_loopping;
 }
 
+void EventLoop::setEpollMaxEvents(int max_events) {
+    if (max_events <= 0) {
+        ERRORLOG("invalid epoll max events %d, keep %d", max_events, m_epoll_max_events);
+        return;
+    }
+    m_epoll_max_events = max_events;
+    m_result_events.resize(max_events);
+}
+
+void EventLoop::setEpollMaxTimeout(int max_timeout) {
+    m_epoll_max_timeout = max_timeout;
+}
+
+uint64_t EventLoop::getEpollFullCount() {
+    return m_epoll_full_count.load(std::memory_order_relaxed);
+}
+
+uint64_t EventLoop::getEpollWaitCount() {
+    return m_epoll_wait_count.load(std::memory_order_relaxed);
+}
+
+void EventLoop::setTimerSlack(int64_t slack_us) {
+    //定时器只在IO线程里访问
+    if (isInLoopThread()) {
+        m_timer->setSlack(slack_us);
+        return;
+    }
+    Timer * timer = m_timer;
+    addTask([timer, slack_us]() {
+        timer->setSlack(slack_us);
+    }, true);
+}
+
+uint64_t EventLoop::getTimerArmCount() {
+    return m_timer->getArmCount();
+}
+
+void EventLoop::incConnectionCount() {
+    m_connection_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void EventLoop::decConnectionCount() {
+    m_connection_count.fetch_sub(1, std::memory_order_relaxed);
+}
+
+int EventLoop::getConnectionCount() {
+    return m_connection_count.load(std::memory_order_relaxed);
+}
+
+int64_t EventLoop::getRecentBusyUs() {
+    int64_t busy = m_recent_busy_us.load(std::memory_order_relaxed);
+    int64_t wait_begin = m_wait_begin.load(std::memory_order_relaxed);
+    if (wait_begin == 0) {
+        return busy;
+    }
+    //已经空闲了idle这么久,最近一个统计周期里只剩下(周期 - idle)可能是忙的
+    int64_t idle = getNowUs() - wait_begin;
+    if (idle >= g_busy_window_us) {
+        return 0;
+    }
+    if (idle > 0) {
+        busy = busy * (g_busy_window_us - idle) / g_busy_window_us;
+    }
+    return busy;
+}
+
 }
 
 
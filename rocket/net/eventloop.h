@@ -3,11 +3,14 @@
 
 #include <pthread.h>
 #include <set>
+#include <unordered_map>
+#include <vector>
 #include <functional>
-#include <queue>
+#include <atomic>
 #include "rocket/net/fd_event.h"
 #include "rocket/net/wakeup_fd_event.h"
 #include "rocket/common/log.h"
+#include "rocket/common/mpsc_queue.h"
 #include "rocket/net/timer.h"
 
 namespace rocket {
@@ -24,7 +27,25 @@ public:
     void addTask(std::function<void()> cb, bool is_wake_up = false); 
     //将任务添加到pending队列中,当此线程从epoll_wait返回后，自己去执行这些任务,而不是由其他线程执行，将任务封装到回调函数中
     void addTimerEvent(TimerEvent::s_ptr event);
+    void deleteTimerEvent(TimerEvent::s_ptr event);
     bool isLooping();
+    //单次epoll_wait最多返回的事件数,以及最长等待时间(ms),需要在loop之前设置
+    void setEpollMaxEvents(int max_events);
+    void setEpollMaxTimeout(int max_timeout);
+    //epoll_wait返回的事件数等于数组大小的次数,这个值增长很快说明max_events设小了
+    uint64_t getEpollFullCount();
+    uint64_t getEpollWaitCount();
+    //定时器到期时间的合并粒度(us),0表示不合并
+    void setTimerSlack(int64_t slack_us);
+    uint64_t getTimerArmCount();
+    //负载统计,其他线程可以读,给IOThreadGroup选线程用
+    //当前挂在这个loop上的连接数
+    void incConnectionCount();
+    void decConnectionCount();
+    int getConnectionCount();
+    //最近一个统计周期内的忙碌时间(不在epoll_wait里的时间),折算成每秒多少us
+    //loop一直阻塞在epoll_wait里时统计值不会更新,读的时候按已经空闲的时间衰减
+    int64_t getRecentBusyUs();
 public:
     static EventLoop * GetCurrentEventLoop();    //获得当前线程的EventLoop对象， 如果当前线程没有会去构建一个
     
@@ -32,17 +53,37 @@ private:
     void dealWakeup();              //处理wake的函数
     void initWakeUpFdEvent();
     void initTimer();
+    void runPendingTasks();
+    //fd还在本loop里监听,并且FdEvent没有被reset过
+    bool isListening(FdEvent * event);
+private:
+    //待执行任务的队列节点
+    struct PendingTask : public MpscNode {
+        std::function<void()> m_cb;
+    };
 private:
     pid_t m_thread_id {0};    //该对象每个线程只能有一个
     int m_epoll_fd {0}; //epoll句柄
     int m_wakeup_fd {0};    //唤醒epoll_wait
     WakeUpFdEvent * m_wakeup_fd_event {NULL};
     bool m_stop_flag {false};
-    std::set<int> m_listen_fds; //表示当前监听的所有套接字
-    std::queue<std::function<void()>> m_pending_tasks;  //所有待执行的任务队列
-    Mutex m_mutex;
+    std::unordered_map<int, uint32_t> m_listen_fds; //当前监听的所有套接字,以及注册时FdEvent的代数
+    MpscQueue m_pending_tasks;  //所有待执行的任务队列,无锁,任意线程都可以往里面放
+    std::atomic<bool> m_wakeup_pending {false};    //已经有人写过wakeup fd,loop还没有处理,其他生产者就不用再写了
     Timer * m_timer {NULL};
     bool m_is_loopping {false};
+
+    int m_epoll_max_events {256};
+    int m_epoll_max_timeout {10000};
+    std::vector<epoll_event> m_result_events;   //epoll_wait的结果数组,只分配一次
+    std::atomic<uint64_t> m_epoll_wait_count {0};    //其他线程会读取做统计
+    std::atomic<uint64_t> m_epoll_full_count {0};
+
+    std::atomic<int> m_connection_count {0};
+    std::atomic<int64_t> m_recent_busy_us {0};
+    int64_t m_busy_us {0};  //当前统计周期内累计的忙碌时间
+    int64_t m_busy_window_begin {0};
+    std::atomic<int64_t> m_wait_begin {0};  //进入epoll_wait的时间,0表示没有在等待
 };
 
 }
@@ -69,6 +69,15 @@ namespace rocket
         }
     }
 
+    void FdEvent::reset()
+    {
+        memset(&m_listen_events, 0, sizeof(m_listen_events));
+        m_read_callback = nullptr;
+        m_write_callback = nullptr;
+        m_error_callback = nullptr;
+        m_generation.fetch_add(1, std::memory_order_acq_rel);
+    }
+
     void FdEvent::setNonBlock()
     {
         int flag = fcntl(m_fd, F_GETFL, 0);
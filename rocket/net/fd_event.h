@@ -1,6 +1,8 @@
 #ifndef ROCKET_NET_FDEVENT_H
 #define ROCKET_NET_FDEVENT_H
 
+#include <atomic>
+#include <stdint.h>
 #include <functional>
 #include <sys/epoll.h>
 
@@ -30,14 +32,22 @@ public:
     epoll_event getEpollEvent() {
         return m_listen_events;
     }
+    //清空监听的事件和回调,fd号复用时重新开始
+    void reset();
+    //每次reset加1,fd关闭之前留下的epoll结果、addTask任务和旧连接拿着的指针,代数对不上就不再使用
+    uint32_t getGeneration() const {
+        return m_generation.load(std::memory_order_acquire);
+    }
 
 
 protected:
+    friend class FdEventGroup;  //FdEventGroup按页批量分配,分配后再设置fd
     int m_fd {-1};
     epoll_event m_listen_events;    //监听事件
     std::function<void()> m_read_callback {nullptr};  //两个回调函数,读回调函数
     std::function<void()> m_write_callback {nullptr};     //写回调函数
     std::function<void()> m_error_callback {nullptr};
+    std::atomic<uint32_t> m_generation {0};
 
 };
 }
@@ -1,56 +1,81 @@
 #include "rocket/net/fd_event_group.h"
+#include "rocket/common/log.h"
 
 
 namespace rocket {
-    static FdEventGroup * g_fd_event_group = NULL;
+    //静态对象,第一次使用时构造,构造本身是线程安全的
     FdEventGroup * FdEventGroup::GetFdEventGroup()
     {
-        if (g_fd_event_group != NULL)
-        {
-            return g_fd_event_group;
-        } else {
-
-            g_fd_event_group = new FdEventGroup(128);
-            return g_fd_event_group;
-        }
+        static FdEventGroup * g_fd_event_group = new FdEventGroup(128);
+        return g_fd_event_group;
     }
 
-    FdEventGroup::FdEventGroup(int size) : m_size(size)
+    FdEventGroup::FdEventGroup(int size)
     {
-        for (int i = 0; i < m_size; i++)
+        for (int i = 0; i < g_fd_max_pages; i++)
         {
-            m_fd_group.push_back(new FdEvent(i));
-
+            m_pages[i].store(NULL, std::memory_order_relaxed);
+        }
+        //预先分配能放下size个fd的页
+        for (int i = 0; i < size && i < g_fd_max_pages * g_fd_page_size; i += g_fd_page_size)
+        {
+            getPage(i >> g_fd_page_bits);
         }
     }
     FdEventGroup::~FdEventGroup()
     {
-        for (int i = 0; i < m_size; i++)
+        for (int i = 0; i < g_fd_max_pages; i++)
         {
-            if (m_fd_group[i] != NULL)
+            FdEvent * page = m_pages[i].load(std::memory_order_acquire);
+            if (page != NULL)
             {
-                delete m_fd_group[i];
-                m_fd_group[i] = NULL;
+                delete [] page;
+                m_pages[i].store(NULL, std::memory_order_relaxed);
             }
         }
     }
 
+    FdEvent * FdEventGroup::getPage(int page_index)
+    {
+        FdEvent * page = m_pages[page_index].load(std::memory_order_acquire);
+        if (page != NULL)   //说明已经有fd对象了
+        {
+            return page;
+        }
+        FdEvent * new_page = new FdEvent[g_fd_page_size];
+        for (int i = 0; i < g_fd_page_size; i++)
+        {
+            new_page[i].m_fd = (page_index << g_fd_page_bits) + i;
+        }
+        if (!m_pages[page_index].compare_exchange_strong(page, new_page, std::memory_order_acq_rel, std::memory_order_acquire))
+        {
+            //别的线程已经分配好了,用它的
+            delete [] new_page;
+            return page;
+        }
+        return new_page;
+    }
+
     FdEvent * FdEventGroup::getFdEvent(int fd)
     {
-        ScopeMutex<Mutex> lock(m_mutex);
-        if ((size_t)fd < m_fd_group.size()) //说明已经有fd对象了
+        if (fd < 0 || fd >= g_fd_max_pages * g_fd_page_size)
         {
-            return m_fd_group[fd];
+            ERRORLOG("invalid fd %d for FdEventGroup", fd);
+            return NULL;
         }
-        int new_size = int (fd * 1.5);
-        for (int i = m_fd_group.size(); i < new_size; i++)
+        return &getPage(fd >> g_fd_page_bits)[fd & (g_fd_page_size - 1)];
+    }
+
+    void FdEventGroup::releaseFdEvent(int fd)
+    {
+        FdEvent * fd_event = getFdEvent(fd);
+        if (fd_event != NULL)
         {
-            m_fd_group.push_back(new FdEvent(i));
+            fd_event->reset();
         }
-        return m_fd_group[fd];
     }
 
 
 
 
-}
\ No newline at end of file
+}
@@ -1,25 +1,34 @@
 #ifndef ROCKET_NET_FD_EVENT_GROUP_H
 #define ROCKET_NET_FD_EVENT_GROUP_H
 
-#include <vector>
+#include <atomic>
 #include "rocket/net/fd_event.h"
-#include "rocket/common/mutex.h"
 
 namespace rocket {
 
+/*
+    按fd下标索引的两级表,第一级是固定大小的页指针数组,第二级每页一次分配g_fd_page_size个FdEvent
+    页只会新增不会移动也不会释放,查找不需要加锁;新页用CAS发布,抢输的一方删掉自己分配的页
+    fd关闭之前调用releaseFdEvent清空槽位,同一个fd号下次被复用时拿到的是干净的FdEvent
+*/
 class FdEventGroup {
     
 public:
     FdEventGroup(int size);
     ~FdEventGroup();
-    FdEvent * getFdEvent(int fd);   //获取关联的fd event对象
+    FdEvent * getFdEvent(int fd);   //获取关联的fd event对象,fd超出范围返回NULL
+    //fd要关闭了,清空对应的FdEvent,必须在close之前调用,并且已经从epoll里删掉了
+    void releaseFdEvent(int fd);
 
 public:
     static FdEventGroup * GetFdEventGroup();
+    static const int g_fd_page_bits = 10;
+    static const int g_fd_page_size = 1 << g_fd_page_bits;    //每页1024个
+    static const int g_fd_max_pages = 4096;     //最多支持4M个fd
 private:
-    int m_size {0};
-    std::vector<FdEvent *> m_fd_group;
-    Mutex m_mutex;
+    FdEvent * getPage(int page_index);
+private:
+    std::atomic<FdEvent *> m_pages[g_fd_max_pages];
 };
 
 
@@ -28,4 +37,4 @@ private:
 
 
 
-#endif 
\ No newline at end of file
+#endif 
@@ -5,7 +5,7 @@
 #include "rocket/common/log.h"
 
 namespace rocket {
-IOThread::IOThread() {
+IOThread::IOThread(const std::string & cpu_list /*= ""*/) : m_cpu_list(cpu_list) {
     int rt = sem_init(&m_init_semaphore, 0, 0);  //初始值设为0
     assert(rt == 0);
 
@@ -30,6 +30,10 @@ IOThread::~IOThread() {
 
 void * IOThread::Main(void * arg) {
     IOThread * thread = static_cast<IOThread *> (arg);  //传入的是this指针
+    //先绑核,再创建EventLoop
+    if (!bindCurrentThreadToCpus(thread->m_cpu_list)) {
+        ERRORLOG("IOThread bind cpus [%s] error", thread->m_cpu_list.c_str());
+    }
     thread->m_event_loop = new EventLoop();
     thread->m_thread_id = getThreadId();
 
@@ -3,12 +3,14 @@
 
 #include <pthread.h>
 #include <semaphore.h>
+#include <string>
 #include "rocket/net/eventloop.h"
 
 namespace rocket {
 class IOThread {
 public:
-    IOThread();
+    //cpu_list不为空时,线程启动后先绑核再创建EventLoop
+    IOThread(const std::string & cpu_list = "");
     ~IOThread();
     EventLoop * getEventLoop();
     void start();
@@ -22,6 +24,7 @@ private:
     EventLoop * m_event_loop {NULL};    //当前io线程的loop对象
     sem_t m_init_semaphore; //信号量
     sem_t m_start_semaphore;
+    std::string m_cpu_list;
     
 };
 }
@@ -1,4 +1,8 @@
+#include <stdlib.h>
 #include "rocket/net/io_thread_group.h"
+#include "rocket/common/log.h"
+#include "rocket/common/util.h"
+#include "rocket/common/config.h"
 
 
 
@@ -7,8 +11,13 @@ namespace rocket {
         m_io_thread_groups.resize(size);
         for (size_t i = 0; (int)i < size; i++)
         {
-            m_io_thread_groups[i] = new IOThread();
+            std::string cpu_list;
+            if (Config::GetGlobalConfig()) {
+                cpu_list = pickCpuList(Config::GetGlobalConfig()->m_io_thread_cpus, (int)i);
+            }
+            m_io_thread_groups[i] = new IOThread(cpu_list);
         }
+        m_seed = (unsigned int)getNowUs();
     };
     IOThreadGroup::~IOThreadGroup() {
 
@@ -25,11 +34,93 @@ namespace rocket {
         }
     }
     IOThread * IOThreadGroup::getIOThread() {
+        if (m_placement_func) {
+            int index = m_placement_func(m_io_thread_groups);
+            if (index >= 0 && index < (int)m_io_thread_groups.size()) {
+                return m_io_thread_groups[index];
+            }
+            ERRORLOG("invalid io thread index %d from placement func, use round robin", index);
+        }
+        switch (m_placement) {
+            case PlacementLeastConnections:
+                return m_io_thread_groups[pickLeastConnections()];
+            case PlacementLeastBusy:
+                return m_io_thread_groups[pickLeastBusy()];
+            case PlacementPowerOfTwo:
+                return m_io_thread_groups[pickPowerOfTwo()];
+            default:
+                break;
+        }
         if (m_index == (int)m_io_thread_groups.size() || m_index == -1) {
             m_index = 0;
         }
         return m_io_thread_groups[m_index++];
     }
+    IOThread * IOThreadGroup::getIOThread(int index) {
+        return m_io_thread_groups[index];
+    }
+    int IOThreadGroup::size() {
+        return (int)m_io_thread_groups.size();
+    }
+    void IOThreadGroup::setPlacement(IOThreadPlacement placement) {
+        m_placement = placement;
+        m_placement_func = nullptr;
+    }
+    void IOThreadGroup::setPlacement(PlacementFunc func) {
+        m_placement_func = func;
+    }
+
+    IOThreadPlacement IOThreadGroup::ParsePlacement(const std::string & name) {
+        if (name == "least_conn") {
+            return PlacementLeastConnections;
+        } else if (name == "least_busy") {
+            return PlacementLeastBusy;
+        } else if (name == "p2c") {
+            return PlacementPowerOfTwo;
+        } else if (name != "round_robin" && !name.empty()) {
+            ERRORLOG("unknown io thread placement [%s], use round_robin", name.c_str());
+        }
+        return PlacementRoundRobin;
+    }
+
+    //下面的计数都是其他线程在更新,读到的是近似值,选错一次也没关系
+    int IOThreadGroup::pickLeastConnections() {
+        int min = 0;
+        for (int i = 1; i < (int)m_io_thread_groups.size(); ++i) {
+            if (m_io_thread_groups[i]->getEventLoop()->getConnectionCount() < m_io_thread_groups[min]->getEventLoop()->getConnectionCount()) {
+                min = i;
+            }
+        }
+        return min;
+    }
+    int IOThreadGroup::pickLeastBusy() {
+        //忙碌时间一样(比如都空闲)的时候从轮询的位置开始找,避免全都落到第一个线程
+        int n = (int)m_io_thread_groups.size();
+        int start = m_index % n;
+        m_index = (m_index + 1) % n;
+        int min = start;
+        for (int k = 1; k < n; ++k) {
+            int i = (start + k) % n;
+            if (m_io_thread_groups[i]->getEventLoop()->getRecentBusyUs() < m_io_thread_groups[min]->getEventLoop()->getRecentBusyUs()) {
+                min = i;
+            }
+        }
+        return min;
+    }
+    int IOThreadGroup::pickPowerOfTwo() {
+        int n = (int)m_io_thread_groups.size();
+        if (n == 1) {
+            return 0;
+        }
+        int a = rand_r(&m_seed) % n;
+        int b = rand_r(&m_seed) % (n - 1);
+        if (b >= a) {   //保证和a不同
+            b++;
+        }
+        EventLoop * la = m_io_thread_groups[a]->getEventLoop();
+        EventLoop * lb = m_io_thread_groups[b]->getEventLoop();
+        return la->getConnectionCount() <= lb->getConnectionCount() ? a : b;
+    }
 
 
 
@@ -2,23 +2,50 @@
 #define ROCKET_NET_IO_THREAD_GROUP_H
 
 #include <vector>
+#include <string>
+#include <functional>
 #include "rocket/net/io_thread.h"   
 
 
 namespace rocket {
 
+enum IOThreadPlacement {   //新连接放到哪个IO线程
+    PlacementRoundRobin = 1,        //轮询
+    PlacementLeastConnections = 2,  //连接数最少
+    PlacementLeastBusy = 3,         //最近忙碌时间最少
+    PlacementPowerOfTwo = 4,        //随机选两个,取连接数少的那个
+};
+
 class IOThreadGroup {
 public:
+    //自定义的选择策略,返回IO线程的下标
+    typedef std::function<int(const std::vector<IOThread *> &)> PlacementFunc;
+
     IOThreadGroup(int size);
     ~IOThreadGroup();
 
     void start();
     void join();
+    //按照选择策略取一个IO线程
     IOThread * getIOThread();
+    IOThread * getIOThread(int index);
+    int size();
+    void setPlacement(IOThreadPlacement placement);
+    void setPlacement(PlacementFunc func);
+public:
+    //round_robin/least_conn/least_busy/p2c,不认识的返回轮询
+    static IOThreadPlacement ParsePlacement(const std::string & name);
+private:
+    int pickLeastConnections();
+    int pickLeastBusy();
+    int pickPowerOfTwo();
 private:
     int m_size {0};
     std::vector<IOThread *> m_io_thread_groups;
     int m_index {0};
+    IOThreadPlacement m_placement {PlacementRoundRobin};
+    PlacementFunc m_placement_func;
+    unsigned int m_seed {0};    //power of two choices用的随机数种子
 
 };
 
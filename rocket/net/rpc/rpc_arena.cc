@@ -0,0 +1,61 @@
+#include "rocket/net/rpc/rpc_arena.h"
+#include "rocket/common/log.h"
+
+namespace rocket {
+    static const int g_arena_initial_block_size = 64 * 1024;   //初始块大小,一批普通请求用不完
+    static thread_local RpcArena::s_ptr t_arena;
+
+    RpcArena::RpcArena(int initial_block_size)
+    {
+        m_initial_block = new char[initial_block_size];
+        google::protobuf::ArenaOptions options;
+        options.initial_block = m_initial_block;
+        options.initial_block_size = initial_block_size;
+        m_arena = new google::protobuf::Arena(options);
+    }
+
+    RpcArena::~RpcArena()
+    {
+        delete m_arena;
+        m_arena = NULL;
+        delete[] m_initial_block;
+        m_initial_block = NULL;
+    }
+
+    google::protobuf::Arena * RpcArena::get()
+    {
+        return m_arena;
+    }
+
+    std::shared_ptr<google::protobuf::Message> RpcArena::NewMessage(s_ptr arena, const google::protobuf::Message & prototype)
+    {
+        //别名构造,引用计数算在arena上,消息由arena统一释放
+        return std::shared_ptr<google::protobuf::Message>(arena, prototype.New(arena->get()));
+    }
+
+    RpcArena::s_ptr RpcArena::GetThreadArena()
+    {
+        if (!t_arena)
+        {
+            t_arena = std::make_shared<RpcArena>(g_arena_initial_block_size);
+        }
+        return t_arena;
+    }
+
+    void RpcArena::ResetThreadArena()
+    {
+        if (!t_arena)
+        {
+            return;
+        }
+        if (t_arena.use_count() == 1)
+        {
+            //只有当前线程还引用着,可以放心Reset
+            t_arena->get()->Reset();
+            return;
+        }
+        //还有消息在其他地方用,留给它们,下一批换新的
+        t_arena.reset();
+    }
+
+}
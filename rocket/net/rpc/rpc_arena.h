@@ -0,0 +1,41 @@
+#ifndef ROCKET_NET_RPC_RPC_ARENA_H
+#define ROCKET_NET_RPC_RPC_ARENA_H
+
+#include <memory>
+#include <google/protobuf/arena.h>
+#include <google/protobuf/message.h>
+
+namespace rocket {
+
+/*
+    每个线程一个protobuf Arena,请求/响应消息在上面分配,一条消息里的子消息、repeated字段都只是移动指针
+    一批请求处理完调用ResetThreadArena:
+    1. 消息都已经释放了,Reset之后下一批接着用,初始块不还给系统
+    2. 还有消息在用(异步处理的方法、交给业务线程的请求),这个arena留给它们,最后一个消息释放时arena跟着释放,当前线程换一个新的
+    消息的shared_ptr持有arena的引用,不会delete消息本身
+*/
+class RpcArena {
+public:
+    typedef std::shared_ptr<RpcArena> s_ptr;
+    RpcArena(int initial_block_size);
+    ~RpcArena();
+    RpcArena(const RpcArena &) = delete;
+    RpcArena & operator=(const RpcArena &) = delete;
+    google::protobuf::Arena * get();
+
+public:
+    //在arena上创建一个和prototype同类型的空消息
+    static std::shared_ptr<google::protobuf::Message> NewMessage(s_ptr arena, const google::protobuf::Message & prototype);
+    //当前线程的arena
+    static s_ptr GetThreadArena();
+    //当前线程处理完一批请求之后调用
+    static void ResetThreadArena();
+
+private:
+    char * m_initial_block {NULL};  //要比m_arena先构造后析构
+    google::protobuf::Arena * m_arena {NULL};
+};
+
+}
+
+#endif
@@ -6,6 +6,8 @@
 #include "rocket/net/rpc/rpc_controller.h"
 #include "rocket/net/coder/tinypb_protocol.h"
 #include "rocket/net/tcp/tcp_client.h"
+#include "rocket/net/tcp/tcp_client_pool.h"
+#include "rocket/net/eventloop.h"
 #include "rocket/common/msg_id_util.h"
 #include "rocket/common/log.h"
 #include "rocket/common/error_code.h" 
@@ -15,7 +17,6 @@ namespace rocket
 {
     RpcChannel::RpcChannel(NetAddr::s_ptr peer_addr) : m_peer_addr(peer_addr)
     {
-        m_client = std::make_shared<TcpClient>(m_peer_addr);
     }
     RpcChannel::~RpcChannel()
     {
@@ -48,7 +49,7 @@ namespace rocket
         }
         // 2.设置方法名
         req_protocol->m_method_name = method->full_name();
-        INFOLOG("%s | call method name [%s]", req_protocol->m_msg_id.c_str(), req_protocol->m_method_name.c_str());
+        INFOLOG_SAMPLED("%s | call method name [%s]", req_protocol->m_msg_id.c_str(), req_protocol->m_method_name.c_str());
 
         // 确保调用rpc前初始化，设置好智能指针
         if (!m_is_init)
@@ -60,7 +61,12 @@ namespace rocket
         }
 
         // 3.请求request pb_data的序列化
-        if (!request->SerializeToString(&(req_protocol->m_pb_data)))
+        // request就是Init时保存的智能指针对象, 可以推迟到encode时直接序列化到发送缓冲区
+        if (request == m_request.get() && request->IsInitialized())
+        {
+            req_protocol->m_pb_message = m_request;
+        }
+        else if (!request->SerializeToString(&(req_protocol->m_pb_data)))
         {
             std::string err_info = "failed to serialize";
             my_controller->SetError(ERROR_FAILED_SERIALIZE, err_info);
@@ -71,9 +77,16 @@ namespace rocket
         // 构造对象的时候一定要用智能指针去构造，不要用栈或者new，不然会会造成野指针的问题
         s_ptr channel = shared_from_this(); // 将channel转换为智能指针对象
         //创建定时任务,下一步将定时任务添加到epoll里面
-        m_timer_event = std::make_shared<TimerEvent>(my_controller->GetTimeout(), false, [my_controller, channel]() mutable {
+        m_timer_event = std::make_shared<TimerEvent>(my_controller->GetTimeoutUs(), false, [my_controller, channel]() mutable {
             my_controller->StartCancel();
-            my_controller->SetError(ERROR_RPC_CALL_TIMEOUT, "rpc call timeout" + std::to_string(my_controller->GetTimeout()));
+            my_controller->SetError(ERROR_RPC_CALL_TIMEOUT, "rpc call timeout " + std::to_string(my_controller->GetTimeoutUs()) + "us");
+            //不再等回包,迟到的回包会被丢掉;只是这一个请求慢,连接上其他请求不受影响,还可以继续复用
+            //连接出错或者协议出错才会关掉连接
+            if (channel->getTcpClient())
+            {
+                channel->getTcpClient()->cancelReadMessage(my_controller->GetMsgId());
+            }
+            channel->releaseClient(true);
             //如果客户端有回调，执行客户端回调
             if (channel->getClosure())
             {
@@ -81,60 +94,109 @@ namespace rocket
             }
             //将智能指针reste一下防止无法析构
             channel.reset();
-        });
+        }, true);
         //将定时任务添加进去
-        m_client->addTimerEvent(m_timer_event);
+        EventLoop::GetCurrentEventLoop()->addTimerEvent(m_timer_event);
 
-        // 4.连接
-        m_client->connect([=]() mutable { // 连接成功后调用回调函数
+        // 4.从连接池借一个连接,连接数到上限时会排队
+        TcpClientPool::GetTcpClientPool()->acquire(m_peer_addr, [channel, req_protocol](TcpClient::s_ptr client) mutable {
+            channel->m_client = client;
             RpcController * my_controller = dynamic_cast<RpcController *>(channel->getController());
-            if (channel->getTcpClient()->getConnectErrorCode() != 0)
+            if (my_controller->IsCanceled())
             {
-                my_controller->SetError(channel->getTcpClient()->getConnectErrorCode(), channel->getTcpClient()->getConnectErrorInfo());
-                ERRORLOG("%s | connect error, error code [%d], error info[%s], peer addr [%s]", req_protocol->m_msg_id.c_str(), my_controller->GetErrorCode(), my_controller->GetErrorInfo().c_str(), channel->getTcpClient()->getPeerAddr()->toString().c_str());
+                //排队的时候已经超时了
+                channel->releaseClient(true);
                 return;
             }
+            if (client->isConnected())
+            {
+                //复用的连接已经连上了,直接发
+                channel->callWithClient(req_protocol);
+                return;
+            }
+            client->connect([channel, req_protocol]() mutable { // 连接成功后调用回调函数
+                RpcController * my_controller = dynamic_cast<RpcController *>(channel->getController());
+                if (my_controller->IsCanceled())
+                {
+                    //连接的时候已经超时了,连接已经还回去,回调也执行过了
+                    return;
+                }
+                if (channel->getTcpClient()->getConnectErrorCode() != 0)
+                {
+                    my_controller->SetError(channel->getTcpClient()->getConnectErrorCode(), channel->getTcpClient()->getConnectErrorInfo());
+                    ERRORLOG("%s | connect error, error code [%d], error info[%s], peer addr [%s]", req_protocol->m_msg_id.c_str(), my_controller->GetErrorCode(), my_controller->GetErrorInfo().c_str(), channel->getTcpClient()->getPeerAddr()->toString().c_str());
+                    channel->releaseClient(false);
+                    channel->finish();
+                    return;
+                }
+                channel->callWithClient(req_protocol);
+            });
+        });
+    }
 
-            // 将请求的协议对象发送给对方
-            channel->getTcpClient()->writeMessage(req_protocol, [=](AbstractProtocol::s_ptr) mutable
-                                {
-                INFOLOG("%s | send rpc request success. call method name [%s], peer addr [%s], local addr [%s]", req_protocol->m_msg_id.c_str(), req_protocol->m_method_name.c_str(), channel->getTcpClient()->getPeerAddr()->toString().c_str(),  channel->getTcpClient()->getLocalAddr()->toString().c_str());
-                //协程结合到这里就不用这么多回调函数了
-                //发送成功后读回包
-                channel->getTcpClient()->readMessage(req_protocol->m_msg_id, [=](AbstractProtocol::s_ptr msg) mutable {
-                    //成功获取回包
-                    std::shared_ptr<rocket::TinyPBProtocol> rsp_protocol = std::dynamic_pointer_cast<rocket::TinyPBProtocol>(msg);
-                    //打印回包数据
-                    INFOLOG("%s | succcess get rpc response, call method name [%s], peer addr [%s], local addr [%s]", rsp_protocol->m_msg_id.c_str(), rsp_protocol->m_method_name.c_str(), channel->getTcpClient()->getPeerAddr()->toString().c_str(), channel->getTcpClient()->getLocalAddr()->toString().c_str());
-                    
-                    //序列化
-                    if (!(channel->getResponse()->ParseFromString(rsp_protocol->m_pb_data)))
-                    {
-                        ERRORLOG("deserilize error"); 
-                        //在controller中设置信息后才能在外能拿到rpc调用结果
-                        my_controller->SetError(ERROR_FAILED_SERIALIZE, "serialize error");
-                        return;
-                    }
-                     //读包成功取消timer，防止触发定时任务
-                    channel->getTimerEvent()->setCancel(true); 
-                    if (rsp_protocol->m_err_code != 0)
-                    {
-                        ERRORLOG("%s | call rpc method[%s] failed, error code [%d], error info[%s]", rsp_protocol->m_msg_id.c_str(), rsp_protocol->m_method_name.c_str(), rsp_protocol->m_err_code, rsp_protocol->m_err_info.c_str());
-                        my_controller->SetError(rsp_protocol->m_err_code, rsp_protocol->m_err_info);
-                        return;
-                    }
-                    INFOLOG("%s | call rpc success, call method name [%s], peer addr [%s], local addr [%s]", rsp_protocol->m_msg_id.c_str(), rsp_protocol->m_method_name.c_str(), channel->getTcpClient()->getPeerAddr()->toString().c_str(), channel->getTcpClient()->getLocalAddr()->toString().c_str());
-
-                   
+    void RpcChannel::callWithClient(std::shared_ptr<TinyPBProtocol> req_protocol)
+    {
+        s_ptr channel = shared_from_this();
+        RpcController * my_controller = dynamic_cast<RpcController *>(getController());
+        //先登记回包的回调再发送,同一个连接上可以同时有多个请求在等回包,按msg_id匹配
+        m_client->readMessage(req_protocol->m_msg_id, [=](AbstractProtocol::s_ptr msg) mutable {
+            //成功获取回包
+            std::shared_ptr<rocket::TinyPBProtocol> rsp_protocol = std::dynamic_pointer_cast<rocket::TinyPBProtocol>(msg);
+            //打印回包数据
+            INFOLOG_SAMPLED("%s | succcess get rpc response, call method name [%s], peer addr [%s], local addr [%s]", rsp_protocol->m_msg_id.c_str(), rsp_protocol->m_method_name.c_str(), channel->getTcpClient()->getPeerAddr()->toString().c_str(), channel->getTcpClient()->getLocalAddr()->toString().c_str());
+            //回包已经收完,连接可以还给连接池了
+            channel->releaseClient(true);
 
-                    //执行客户端传入的回调函数
-                    if (!(my_controller->IsCanceled()) && channel->getClosure())  //获取回调函数
-                    {
-                        channel->getClosure()->Run();  //如果有回调函数就执行
-                    }
-                    channel.reset();    //将channel智能指针引用-1，如果析构的话，成员指针也会-1 
-                }); });
+            //序列化
+            if (!(channel->getResponse()->ParseFromArray(rsp_protocol->pbData(), rsp_protocol->pbDataLen())))
+            {
+                ERRORLOG("deserilize error"); 
+                //在controller中设置信息后才能在外能拿到rpc调用结果
+                my_controller->SetError(ERROR_FAILED_SERIALIZE, "serialize error");
+            }
+            else if (rsp_protocol->m_err_code != 0)
+            {
+                ERRORLOG("%s | call rpc method[%s] failed, error code [%d], error info[%s]", rsp_protocol->m_msg_id.c_str(), rsp_protocol->m_method_name.c_str(), rsp_protocol->m_err_code, rsp_protocol->m_err_info.c_str());
+                my_controller->SetError(rsp_protocol->m_err_code, rsp_protocol->m_err_info);
+            }
+            else
+            {
+                INFOLOG_SAMPLED("%s | call rpc success, call method name [%s], peer addr [%s], local addr [%s]", rsp_protocol->m_msg_id.c_str(), rsp_protocol->m_method_name.c_str(), channel->getTcpClient()->getPeerAddr()->toString().c_str(), channel->getTcpClient()->getLocalAddr()->toString().c_str());
+            }
+            //不管成功失败都要取消timer并执行客户端传入的回调函数,否则超时的时候还会再执行一次
+            channel->finish();
+            channel.reset();    //将channel智能指针引用-1，如果析构的话，成员指针也会-1 
         });
+        // 将请求的协议对象发送给对方,连续的多个请求会在下一次可写事件时一起发出去
+        m_client->writeMessage(req_protocol, [=](AbstractProtocol::s_ptr) mutable
+                            {
+            INFOLOG_SAMPLED("%s | send rpc request success. call method name [%s], peer addr [%s], local addr [%s]", req_protocol->m_msg_id.c_str(), req_protocol->m_method_name.c_str(), channel->getTcpClient()->getPeerAddr()->toString().c_str(),  channel->getTcpClient()->getLocalAddr()->toString().c_str());
+        });
+    }
+
+    void RpcChannel::releaseClient(bool is_reusable)
+    {
+        if (m_client_released || !m_client)
+        {
+            return;
+        }
+        m_client_released = true;
+        TcpClientPool::GetTcpClientPool()->release(m_client, is_reusable);
+    }
+
+    void RpcChannel::finish()
+    {
+        if (m_timer_event)
+        {
+            //从定时器里删掉,不会再触发超时;定时器的回调里持有channel,这里也要释放,否则互相引用
+            EventLoop::GetCurrentEventLoop()->deleteTimerEvent(m_timer_event);
+            m_timer_event.reset();
+        }
+        RpcController * my_controller = dynamic_cast<RpcController *>(getController());
+        if (!my_controller->IsCanceled() && m_closure)
+        {
+            m_closure->Run();
+        }
     }
 
     // 保存对象的智能指针,防止回调的时候对象析构
@@ -6,12 +6,19 @@
 #include "rocket/net/tcp/net_addr.h"
 #include "rocket/net/tcp/tcp_client.h"
 #include "rocket/net/timer_event.h"
+#include "rocket/net/coder/tinypb_protocol.h"
+#include "rocket/net/rpc/rpc_arena.h"
 
 namespace rocket 
 {
 #define NEWMESSAGE(type, var_name) \
     std::shared_ptr<type> var_name = std::make_shared<type>();  \
 
+//消息分配在当前线程的arena上,子消息多的时候省掉大量malloc;消息一直被持有的话arena也不会释放,不要长期保存
+#define NEWARENAMESSAGE(type, var_name) \
+    rocket::RpcArena::s_ptr var_name##_arena = rocket::RpcArena::GetThreadArena(); \
+    std::shared_ptr<type> var_name(var_name##_arena, google::protobuf::Arena::CreateMessage<type>(var_name##_arena->get())); \
+
 #define NEWRPCCONTROLLER(var_name) \
     std::shared_ptr<rocket::RpcController> var_name = std::make_shared<rocket::RpcController>(); \
 
@@ -51,6 +58,14 @@ public:
     TcpClient * getTcpClient();
     TimerEvent::s_ptr getTimerEvent();
 
+private:
+    //拿到连接池里的连接之后发送请求,读回包
+    void callWithClient(std::shared_ptr<TinyPBProtocol> req_protocol);
+    //把连接还给连接池,只会还一次;is_reusable为false时连接直接关掉
+    void releaseClient(bool is_reusable);
+    //收到回包或者出错时结束调用:删掉超时定时器再执行回调;超时由定时器执行回调,两者只会有一个执行
+    void finish();
+
 private:
     NetAddr::s_ptr m_peer_addr {nullptr}; 
     NetAddr::s_ptr m_local_addr {nullptr};
@@ -59,7 +74,8 @@ private:
     message_s_ptr m_response {nullptr};
     closure_s_ptr m_closure {nullptr};
     bool m_is_init {false};
-    TcpClient::s_ptr m_client {nullptr};
+    TcpClient::s_ptr m_client {nullptr};   //从连接池借来的连接
+    bool m_client_released {false};
 
     TimerEvent::s_ptr m_timer_event {nullptr};
 };
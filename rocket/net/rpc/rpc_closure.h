@@ -10,15 +10,22 @@ class RpcClosure : public google::protobuf::Closure
 {
 public:
     RpcClosure(std::function<void()> cb) : m_cb(cb) {}
+    //self_delete为true时Run执行完释放自己,和protobuf的NewCallback一样,只能Run一次
+    RpcClosure(std::function<void()> cb, bool self_delete) : m_cb(cb), m_self_delete(self_delete) {}
     void Run() override 
     {
         if (m_cb != nullptr)
         {
             m_cb();
         }
+        if (m_self_delete)
+        {
+            delete this;
+        }
     }
 private:
     std::function<void()> m_cb {nullptr};
+    bool m_self_delete {false};
 
 
 };
@@ -10,9 +10,10 @@ namespace rocket
         m_msg_id = "";
         m_is_failed = false;
         m_is_canceled = false;
+        m_is_async = false;
         m_local_addr = nullptr;
         m_peer_addr = nullptr;
-        m_timeout = 1000;   //ms
+        m_timeout_us = 1000000;   //1s
     }
     bool RpcController::Failed() const
     {
@@ -79,11 +80,27 @@ namespace rocket
     }
     void RpcController::SetTimeout(int timeout)
     {
-        m_timeout = timeout;
+        m_timeout_us = (int64_t)timeout * 1000;
     }
     int RpcController::GetTimeout()
     {
-        return m_timeout;
+        return (int)(m_timeout_us / 1000);
+    }
+    void RpcController::SetTimeoutUs(int64_t timeout_us)
+    {
+        m_timeout_us = timeout_us;
+    }
+    int64_t RpcController::GetTimeoutUs()
+    {
+        return m_timeout_us;
+    }
+    void RpcController::StartAsync()
+    {
+        m_is_async = true;
+    }
+    bool RpcController::IsAsync()
+    {
+        return m_is_async;
     }
 
 
@@ -30,8 +30,13 @@ public:
     void SetPeerAddr(NetAddr::s_ptr addr);
     NetAddr::s_ptr GetLocalAddr();
     NetAddr::s_ptr GetPeerAddr();
-    void SetTimeout(int timeout);
+    void SetTimeout(int timeout);   //ms
     int GetTimeout();
+    void SetTimeoutUs(int64_t timeout_us);  //us,可以设置小于1ms的超时
+    int64_t GetTimeoutUs();
+    //服务端:业务方法返回之后才会执行done(比如要先调用下游服务),调用后框架不再在方法返回时替它回包
+    void StartAsync();
+    bool IsAsync();
 
 
 private:
@@ -41,11 +46,12 @@ private:
 
     bool m_is_failed {false};   //rpc调用是否成功
     bool m_is_canceled {false}; //rpc调用是否取消
+    bool m_is_async {false};    //服务端异步处理,由业务方法自己执行done
 
     NetAddr::s_ptr m_local_addr;    //本地地址
     NetAddr::s_ptr m_peer_addr;     //对端地址
 
-    int m_timeout {1000};   //超时时间
+    int64_t m_timeout_us {1000000};   //超时时间,us
 
 
 };
@@ -1,12 +1,16 @@
 #include <google/protobuf/service.h>
 #include <google/protobuf/descriptor.h>
 #include <google/protobuf/message.h>
+#include <atomic>
 #include "rocket/net/rpc/rpc_dispatcher.h"
 #include "rocket/net/coder/tinypb_protocol.h"
 #include "rocket/common/log.h"
 #include "rocket/common/error_code.h"
 #include "rocket/common/run_time.h"
 #include "rocket/net/rpc/rpc_controller.h"
+#include "rocket/net/rpc/rpc_closure.h"
+#include "rocket/net/rpc/rpc_arena.h"
+#include "rocket/net/rpc/rpc_message_pool.h"
 #include "rocket/net/tcp/net_addr.h"
 #include "rocket/net/tcp/tcp_connection.h"
 
@@ -35,91 +39,119 @@ namespace rocket
         return g_rpc_dispatcher;
     }
 
-    void RpcDispatcher::dispatcher(AbstractProtocol::s_ptr request, AbstractProtocol::s_ptr response, TcpConnection *connection)
+    void RpcDispatcher::dispatcher(AbstractProtocol::s_ptr request, NetAddr::s_ptr local_addr, NetAddr::s_ptr peer_addr, ReplyCallback reply)
+    {
+        std::shared_ptr<TinyPBProtocol> req_protocol = std::dynamic_pointer_cast<TinyPBProtocol>(request);
+        dispatcher(request, findMethod(req_protocol->m_method_name), local_addr, peer_addr, reply);
+    }
+
+    void RpcDispatcher::dispatcher(AbstractProtocol::s_ptr request, const RpcMethodEntry *entry, NetAddr::s_ptr local_addr, NetAddr::s_ptr peer_addr, ReplyCallback reply)
     {
         // 拿到协议的对象
         std::shared_ptr<TinyPBProtocol> req_protocol = std::dynamic_pointer_cast<TinyPBProtocol>(request);
-        std::shared_ptr<TinyPBProtocol> rsp_protocol = std::dynamic_pointer_cast<TinyPBProtocol>(response);
-        std::string method_full_name = req_protocol->m_method_name;
-        std::string service_name; // 可以找到service对象
-        std::string method_name;
+        std::shared_ptr<TinyPBProtocol> rsp_protocol = std::make_shared<TinyPBProtocol>();
 
         rsp_protocol->m_msg_id = req_protocol->m_msg_id;
         rsp_protocol->m_method_name = req_protocol->m_method_name;
-        if (!parseServiceFullName(method_full_name, service_name, method_name))
+        if (entry == NULL)
         {
-            setTinyPBError(rsp_protocol, ERROR_PARSE_SERVICE_NAME, "parse service name error");
+            // 查表失败才去拆分方法名,区分具体的错误原因
+            std::string service_name;
+            std::string method_name;
+            if (!parseServiceFullName(req_protocol->m_method_name, service_name, method_name))
+            {
+                setTinyPBError(rsp_protocol, ERROR_PARSE_SERVICE_NAME, "parse service name error");
+            }
+            else if (m_service_map.find(service_name) == m_service_map.end())
+            {
+                ERRORLOG("%s | service name [%s] not found", req_protocol->m_msg_id.c_str(), service_name.c_str());
+                setTinyPBError(rsp_protocol, ERROR_SERVICE_NOT_FOUND, "service not found");
+            }
+            else
+            {
+                ERRORLOG("method name [%s] not found in service [%s]", method_name.c_str(), service_name.c_str());
+                setTinyPBError(rsp_protocol, ERROR_SERVICE_NOT_FOUND, "method not found");
+            }
+            reply(rsp_protocol);
             return;
         }
-        auto it = m_service_map.find(service_name);
-        if (it == m_service_map.end())
+        // 通过service指针调用方法,method和request/response的原型在注册时已经找好了
+        service_s_ptr service = entry->m_service;
+        const google::protobuf::MethodDescriptor *method = entry->m_method;
+        // 反序列化，将pb_data反序列化为rst_msg
+        // 配置了对象池就从当前线程的空闲列表里取,否则分配在当前线程的arena上,这一批请求处理完之后统一释放
+        bool use_pool = RpcMessagePool::GetMaxSize() > 0;
+        RpcArena::s_ptr arena;
+        std::shared_ptr<google::protobuf::Message> req_msg;
+        if (use_pool)
         {
-            ERRORLOG("%s | service name [%s] not found", req_protocol->m_msg_id.c_str(), service_name.c_str());
-            setTinyPBError(rsp_protocol, ERROR_SERVICE_NOT_FOUND, "service not found");
-            return;
+            req_msg = RpcMessagePool::Acquire(*entry->m_request_prototype);
         }
-        // 找到service对象
-        service_s_ptr service = (*it).second; // 通过service指针可以找到方法、request response
-        // 找到method对象
-        const google::protobuf::MethodDescriptor *method = service->GetDescriptor()->FindMethodByName(method_name);
-        if (method == NULL)
+        else
         {
-            ERRORLOG("method name [%s] not found in service [%s]", method_name.c_str(), service_name.c_str());
-            setTinyPBError(rsp_protocol, ERROR_SERVICE_NOT_FOUND, "method not found");
-            return;
+            arena = RpcArena::GetThreadArena();
+            req_msg = RpcArena::NewMessage(arena, *entry->m_request_prototype);
         }
-        // 反序列化，将pb_data反序列化为rst_msg
-        google::protobuf::Message *req_msg = service->GetRequestPrototype(method).New();
-        if (!req_msg->ParseFromString(req_protocol->m_pb_data))
+        if (!req_msg->ParseFromArray(req_protocol->pbData(), req_protocol->pbDataLen()))
         {
             ERRORLOG("%s | deserilize error", req_protocol->m_msg_id.c_str());
             setTinyPBError(rsp_protocol, ERROR_FAILED_DESERIALIZE, "deserilize error");
-            if (req_msg != NULL)
-            {
-                delete req_msg;
-                req_msg = NULL;
-            }
+            reply(rsp_protocol);
             return;
         }
-        INFOLOG("%s | req_id[%s], get rpc request [%s]", req_protocol->m_msg_id.c_str(), req_protocol->m_msg_id.c_str(), req_msg->ShortDebugString().c_str());
+        // 打印整个消息的开销比处理请求本身还大,只在DEBUG级别打印
+        DEBUGLOG_SAMPLED("%s | get rpc request [%s]", req_protocol->m_msg_id.c_str(), req_msg->ShortDebugString().c_str());
+
+        // 响应对象交给rsp_protocol持有,encode时直接序列化到输出缓冲区
+        std::shared_ptr<google::protobuf::Message> rsp_msg = use_pool ? RpcMessagePool::Acquire(*entry->m_response_prototype) : RpcArena::NewMessage(arena, *entry->m_response_prototype);
 
-        google::protobuf::Message *rsp_msg = service->GetResponsePrototype(method).New();
+        // 通过controller对象可以获取本次调用的一些信息
+        // 业务方法可能在返回之后才执行done,请求、响应和controller都要活到done执行完
+        std::shared_ptr<RpcController> rpc_controller = std::make_shared<RpcController>();
+        rpc_controller->SetLocalAddr(local_addr);
+        rpc_controller->SetPeerAddr(peer_addr);
+        rpc_controller->SetMsgId(req_protocol->m_msg_id);
 
-        // 通过controller对象可以获取本次调用的一些信息,该线程处理rpc请求方法
-        RpcController rpcController;
-        rpcController.SetLocalAddr(connection->getLocalAddr());
-        rpcController.SetPeerAddr(connection->getPeerAddr());
-        rpcController.SetMsgId(req_protocol->m_msg_id);
+        // 检查响应并交给reply发送,可以在任意线程执行
+        std::function<void()> finish = [this, req_protocol, rsp_protocol, req_msg, rsp_msg, rpc_controller, reply]() {
+            // 序列化推迟到encode,这里先检查能不能序列化
+            if (!rsp_msg->IsInitialized())
+            {
+                ERRORLOG("%s | serilize error, origin message [%s]", req_protocol->m_msg_id.c_str(), rsp_msg->ShortDebugString().c_str());
+                setTinyPBError(rsp_protocol, ERROR_FAILED_SERIALIZE, "serilize error");
+                reply(rsp_protocol);
+                return;
+            }
+            rsp_protocol->m_pb_message = rsp_msg;
+            rsp_protocol->m_err_code = 0;
+            INFOLOG_SAMPLED("%s | dispatch success", req_protocol->m_msg_id.c_str());
+            DEBUGLOG_SAMPLED("%s | request[%s], response[%s]", req_protocol->m_msg_id.c_str(), req_msg->ShortDebugString().c_str(), rsp_msg->ShortDebugString().c_str());
+            reply(rsp_protocol);
+        };
+        // 谁先把is_replied置为true谁回包;done执行完自己释放
+        std::shared_ptr<std::atomic<bool>> is_replied = std::make_shared<std::atomic<bool>>(false);
+        RpcClosure * done = new RpcClosure([req_protocol, finish, is_replied]() {
+            if (is_replied->exchange(true))
+            {
+                ERRORLOG("%s | done run more than once", req_protocol->m_msg_id.c_str());
+                return;
+            }
+            finish();
+        }, true);
 
         //进入RPC处理，也就是业务方法
         RunTime::GetRunTime()->m_msgid = req_protocol->m_msg_id;
         RunTime::GetRunTime()->m_method_name = req_protocol->m_method_name;
-        service->CallMethod(method, &rpcController, req_msg, rsp_msg, NULL);
+        service->CallMethod(method, rpc_controller.get(), req_msg.get(), rsp_msg.get(), done);
 
-        // 将rsp_msg对象序列化成字节流,然后返回到m_pd_data中
-        if (!rsp_msg->SerializeToString(&(rsp_protocol->m_pb_data)))
+        // 没有调用StartAsync的业务方法返回时就算处理完了,它没有执行done的话这里替它回包
+        // 业务方法执行过done的话done可能已经释放了(也可能正在其他线程里执行),这里只能看is_replied,不能再碰done
+        // 抢到is_replied说明done还没执行过,同步的业务方法返回之后不会再执行done,由这里释放
+        if (!rpc_controller->IsAsync() && !is_replied->exchange(true))
         {
-            ERRORLOG("%s | serilize error, origin message [%s]", req_protocol->m_msg_id.c_str(), rsp_msg->ShortDebugString().c_str());
-            setTinyPBError(rsp_protocol, ERROR_FAILED_SERIALIZE, "serilize error");
-            return;
-            if (req_msg != NULL)
-            {
-                delete req_msg;
-                req_msg = NULL;
-            }
-            if (rsp_msg != NULL)
-            {
-                delete rsp_msg;
-                rsp_msg = NULL;
-            }
+            finish();
+            delete done;
         }
-
-        rsp_protocol->m_err_code = 0;
-        INFOLOG("%s | dispatch success, request[%s], response[%s]", req_protocol->m_msg_id.c_str(), req_msg->ShortDebugString().c_str(), rsp_msg->ShortDebugString().c_str());
-        delete req_msg;
-        delete rsp_msg;
-        req_msg = NULL;
-        rsp_msg = NULL;
     }
 
     bool RpcDispatcher::parseServiceFullName(const std::string &full_name, std::string &service_name, std::string &method_name)
@@ -143,8 +175,58 @@ namespace rocket
 
     void RpcDispatcher::registerService(service_s_ptr service)
     {
-        std::string service_name = service->GetDescriptor()->full_name();
+        const google::protobuf::ServiceDescriptor *descriptor = service->GetDescriptor();
+        std::string service_name = descriptor->full_name();
         m_service_map[service_name] = service;
+        for (int i = 0; i < descriptor->method_count(); i++)
+        {
+            const google::protobuf::MethodDescriptor *method = descriptor->method(i);
+            RpcMethodEntry &entry = m_method_map[service_name + "." + method->name()];
+            entry.m_service = service;
+            entry.m_method = method;
+            entry.m_request_prototype = &service->GetRequestPrototype(method);
+            entry.m_response_prototype = &service->GetResponsePrototype(method);
+            INFOLOG("register method [%s.%s]", service_name.c_str(), method->name().c_str());
+        }
+        resolveWorkerPools();
+    }
+
+    const RpcMethodEntry *RpcDispatcher::findMethod(const std::string &method_full_name)
+    {
+        auto it = m_method_map.find(method_full_name);
+        if (it == m_method_map.end())
+        {
+            return NULL;
+        }
+        return &(it->second);
+    }
+
+    void RpcDispatcher::setWorkerPool(const std::string &name, RpcWorkerPool::s_ptr worker_pool)
+    {
+        if (name.empty())
+        {
+            m_default_worker_pool = worker_pool;
+        }
+        else
+        {
+            m_worker_pools[name] = worker_pool;
+        }
+        resolveWorkerPools();
+    }
+
+    void RpcDispatcher::resolveWorkerPools()
+    {
+        // 方法全名的设置优先,其次是服务名,最后是默认的线程池
+        for (auto it = m_method_map.begin(); it != m_method_map.end(); ++it)
+        {
+            RpcMethodEntry &entry = it->second;
+            auto pool = m_worker_pools.find(it->first);
+            if (pool == m_worker_pools.end())
+            {
+                pool = m_worker_pools.find(entry.m_method->service()->full_name());
+            }
+            entry.m_worker_pool = pool != m_worker_pools.end() ? pool->second.get() : m_default_worker_pool.get();
+        }
     }
 
     void RpcDispatcher::setTinyPBError(std::shared_ptr<TinyPBProtocol> msg, int32_t err_code, const std::string err_info)
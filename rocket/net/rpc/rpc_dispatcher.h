@@ -2,34 +2,65 @@
 #define ROCKET_NET_RPC_RPC_DISPATCHER_H
 
 #include <map>
+#include <unordered_map>
 #include <memory>
+#include <functional>
 #include <google/protobuf/service.h>
 #include "rocket/net/coder/abstract_protocol.h"
 #include "rocket/net/tcp/tcp_connection.h"
 #include "rocket/net/coder/tinypb_protocol.h"
+#include "rocket/net/tcp/net_addr.h"
+#include "rocket/net/rpc/rpc_worker_pool.h"
 
 namespace rocket 
 {
 class TcpConnection;
+//registerService时为每个方法预先算好的分发信息,请求来了只需要按方法全名查一次表
+struct RpcMethodEntry {
+    std::shared_ptr<google::protobuf::Service> m_service;
+    const google::protobuf::MethodDescriptor * m_method {NULL};
+    const google::protobuf::Message * m_request_prototype {NULL};
+    const google::protobuf::Message * m_response_prototype {NULL};
+    RpcWorkerPool * m_worker_pool {NULL};   //NULL表示直接在IO线程里执行
+};
+
 class RpcDispatcher
 {
 public:
     static RpcDispatcher * GetRpcDispatcher();
 public:
     typedef std::shared_ptr<google::protobuf::Service> service_s_ptr;
-    //根据请求的message对象，调用rpc方法，最终得到响应的message对象
-    void dispatcher(AbstractProtocol::s_ptr request, AbstractProtocol::s_ptr response, TcpConnection * connection);
+    //拿到响应之后的回调,可能在任意线程执行
+    typedef std::function<void(AbstractProtocol::s_ptr)> ReplyCallback;
+    //根据请求的message对象，调用rpc方法，得到响应的message对象后调用reply,每个请求只调用一次
+    //业务方法执行done的时候才算处理完,done可以在业务方法返回之后、在其他线程里执行(先调用controller的StartAsync)
+    //不依赖连接对象,可以在业务线程里调用
+    void dispatcher(AbstractProtocol::s_ptr request, NetAddr::s_ptr local_addr, NetAddr::s_ptr peer_addr, ReplyCallback reply);
+    //entry是findMethod的结果,调用方已经查过表的话不用再查一次
+    void dispatcher(AbstractProtocol::s_ptr request, const RpcMethodEntry * entry, NetAddr::s_ptr local_addr, NetAddr::s_ptr peer_addr, ReplyCallback reply);
+    //按方法全名(Order.makeOrder)查分发表,找不到返回NULL
+    const RpcMethodEntry * findMethod(const std::string & method_full_name);
     
     void registerService(service_s_ptr service);
+    //指定服务或者方法在业务线程池里执行,name是服务名(Order)或者方法全名(Order.makeOrder),方法的设置优先
+    //name为空表示所有没有单独指定的方法;需要在服务启动之前设置
+    void setWorkerPool(const std::string & name, RpcWorkerPool::s_ptr worker_pool);
     
     void setTinyPBError(std::shared_ptr<TinyPBProtocol> msg, int32_t err_code, const std::string err_info);
 
 private:
     bool parseServiceFullName(const std::string & full_name, std::string & service_name, std::string & method_name);
+    //按m_worker_pools重新确定每个方法的业务线程池
+    void resolveWorkerPools();
 
 private:
     //服务对象,string 是服务名称, value是service对象
     std::map<std::string, service_s_ptr> m_service_map; 
+    //方法全名到分发信息,只在启动前注册的时候修改,之后只读
+    std::unordered_map<std::string, RpcMethodEntry> m_method_map;
+    //key是服务名或者方法全名
+    std::map<std::string, RpcWorkerPool::s_ptr> m_worker_pools;
+    RpcWorkerPool::s_ptr m_default_worker_pool;
 
 
 
@@ -0,0 +1,146 @@
+#include <atomic>
+#include <vector>
+#include <unordered_map>
+#include "rocket/net/rpc/rpc_message_pool.h"
+#include "rocket/common/mutex.h"
+#include "rocket/common/util.h"
+
+namespace rocket {
+    static std::atomic<int> g_max_size {0};
+
+    //一个线程的空闲列表,只有所属线程会修改,统计值其他线程只读
+    struct ThreadMessagePool {
+        std::atomic<pid_t> m_owner {0};     //线程退出后置0,之后释放的消息直接delete
+        std::unordered_map<const google::protobuf::Message *, std::vector<google::protobuf::Message *>> m_free;   //key是原型
+        std::atomic<uint64_t> m_hit {0};
+        std::atomic<uint64_t> m_miss {0};
+        std::atomic<uint64_t> m_pooled {0};
+    };
+
+    //统计时遍历所有线程,线程退出后也保留,线程数不多
+    static Mutex g_pools_mutex;
+    static std::vector<std::shared_ptr<ThreadMessagePool>> g_pools;
+
+    //线程退出时释放缓存的消息
+    struct ThreadMessagePoolHolder {
+        std::shared_ptr<ThreadMessagePool> m_pool;
+        ~ThreadMessagePoolHolder()
+        {
+            if (!m_pool)
+            {
+                return;
+            }
+            m_pool->m_owner.store(0, std::memory_order_release);
+            for (auto it = m_pool->m_free.begin(); it != m_pool->m_free.end(); ++it)
+            {
+                for (size_t i = 0; i < it->second.size(); i++)
+                {
+                    delete it->second[i];
+                }
+            }
+            m_pool->m_free.clear();
+            m_pool->m_pooled.store(0, std::memory_order_relaxed);
+        }
+    };
+    static thread_local ThreadMessagePoolHolder t_pool;
+
+    static std::shared_ptr<ThreadMessagePool> getThreadPool()
+    {
+        if (!t_pool.m_pool)
+        {
+            t_pool.m_pool = std::make_shared<ThreadMessagePool>();
+            t_pool.m_pool->m_owner.store(getThreadId(), std::memory_order_relaxed);
+            ScopeMutex<Mutex> lock(g_pools_mutex);
+            g_pools.push_back(t_pool.m_pool);
+        }
+        return t_pool.m_pool;
+    }
+
+    std::shared_ptr<google::protobuf::Message> RpcMessagePool::Acquire(const google::protobuf::Message & prototype)
+    {
+        std::shared_ptr<ThreadMessagePool> pool = getThreadPool();
+        const google::protobuf::Message * key = &prototype;
+        google::protobuf::Message * msg = NULL;
+        std::vector<google::protobuf::Message *> & free_list = pool->m_free[key];
+        if (!free_list.empty())
+        {
+            msg = free_list.back();
+            free_list.pop_back();
+            pool->m_pooled.fetch_sub(1, std::memory_order_relaxed);
+            pool->m_hit.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            msg = prototype.New();
+            pool->m_miss.fetch_add(1, std::memory_order_relaxed);
+        }
+        return std::shared_ptr<google::protobuf::Message>(msg, [pool, key](google::protobuf::Message * msg) {
+            //不是分配它的线程,或者已经缓存够了,直接释放
+            if (pool->m_owner.load(std::memory_order_acquire) != getThreadId())
+            {
+                delete msg;
+                return;
+            }
+            std::vector<google::protobuf::Message *> & free_list = pool->m_free[key];
+            if ((int)free_list.size() >= g_max_size.load(std::memory_order_relaxed))
+            {
+                delete msg;
+                return;
+            }
+            msg->Clear();
+            free_list.push_back(msg);
+            pool->m_pooled.fetch_add(1, std::memory_order_relaxed);
+        });
+    }
+
+    void RpcMessagePool::SetMaxSize(int max_size)
+    {
+        g_max_size.store(max_size, std::memory_order_relaxed);
+    }
+
+    int RpcMessagePool::GetMaxSize()
+    {
+        return g_max_size.load(std::memory_order_relaxed);
+    }
+
+    uint64_t RpcMessagePool::GetHitCount()
+    {
+        uint64_t count = 0;
+        ScopeMutex<Mutex> lock(g_pools_mutex);
+        for (size_t i = 0; i < g_pools.size(); i++)
+        {
+            count += g_pools[i]->m_hit.load(std::memory_order_relaxed);
+        }
+        return count;
+    }
+
+    uint64_t RpcMessagePool::GetMissCount()
+    {
+        uint64_t count = 0;
+        ScopeMutex<Mutex> lock(g_pools_mutex);
+        for (size_t i = 0; i < g_pools.size(); i++)
+        {
+            count += g_pools[i]->m_miss.load(std::memory_order_relaxed);
+        }
+        return count;
+    }
+
+    double RpcMessagePool::GetHitRate()
+    {
+        uint64_t hit = GetHitCount();
+        uint64_t total = hit + GetMissCount();
+        return total == 0 ? 0 : (double)hit / total;
+    }
+
+    uint64_t RpcMessagePool::GetPooledCount()
+    {
+        uint64_t count = 0;
+        ScopeMutex<Mutex> lock(g_pools_mutex);
+        for (size_t i = 0; i < g_pools.size(); i++)
+        {
+            count += g_pools[i]->m_pooled.load(std::memory_order_relaxed);
+        }
+        return count;
+    }
+
+}
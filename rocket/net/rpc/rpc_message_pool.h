@@ -0,0 +1,35 @@
+#ifndef ROCKET_NET_RPC_RPC_MESSAGE_POOL_H
+#define ROCKET_NET_RPC_RPC_MESSAGE_POOL_H
+
+#include <stdint.h>
+#include <memory>
+#include <google/protobuf/message.h>
+
+namespace rocket {
+
+/*
+    请求/响应消息的对象池,protobuf不能用arena的时候代替RpcArena
+    每个线程、每种消息(也就是每个方法的请求/响应原型)一个有上限的空闲列表
+    取的时候优先拿空闲列表里的,shared_ptr释放时Clear()之后放回去,Clear保留repeated字段和string的容量,下次不用再分配
+    只放回分配它的那个线程的空闲列表,在其他线程释放(比如交给业务线程的请求)就直接delete
+*/
+class RpcMessagePool {
+public:
+    //取一个和prototype同类型的空消息
+    static std::shared_ptr<google::protobuf::Message> Acquire(const google::protobuf::Message & prototype);
+    //每个线程每种消息最多缓存的个数,0表示不使用对象池;需要在服务启动之前设置
+    static void SetMaxSize(int max_size);
+    static int GetMaxSize();
+
+    //所有线程加起来的统计
+    static uint64_t GetHitCount();
+    static uint64_t GetMissCount();
+    //命中率,0~1
+    static double GetHitRate();
+    //当前缓存的消息个数
+    static uint64_t GetPooledCount();
+};
+
+}
+
+#endif
@@ -0,0 +1,85 @@
+#include <semaphore.h>
+#include "rocket/net/rpc/rpc_worker_pool.h"
+#include "rocket/common/log.h"
+
+namespace rocket {
+
+    RpcWorkerPool::RpcWorkerPool(int size)
+    {
+        for (int i = 0; i < size; i++)
+        {
+            Worker * worker = new Worker();
+            worker->m_thread = new IOThread();
+            m_workers.push_back(worker);
+        }
+        for (size_t i = 0; i < m_workers.size(); i++)
+        {
+            m_workers[i]->m_thread->start();
+        }
+        INFOLOG("RpcWorkerPool start %d threads", (int)m_workers.size());
+    }
+
+    RpcWorkerPool::~RpcWorkerPool()
+    {
+        //任务按投递顺序执行,最后再投一个任务,等它执行完说明前面的都执行完了
+        sem_t drained;
+        sem_init(&drained, 0, 0);
+        for (size_t i = 0; i < m_workers.size(); i++)
+        {
+            m_workers[i]->m_thread->getEventLoop()->addTask([&drained]() {
+                sem_post(&drained);
+            }, true);
+        }
+        for (size_t i = 0; i < m_workers.size(); i++)
+        {
+            sem_wait(&drained);
+        }
+        sem_destroy(&drained);
+        for (size_t i = 0; i < m_workers.size(); i++)
+        {
+            //~IOThread会停掉EventLoop并join线程
+            delete m_workers[i]->m_thread;
+            delete m_workers[i];
+        }
+        m_workers.clear();
+    }
+
+    void RpcWorkerPool::addTask(std::function<void()> cb)
+    {
+        if (m_workers.empty())
+        {
+            cb();
+            return;
+        }
+        //线程数不多,直接找排队最少的
+        Worker * worker = m_workers[0];
+        for (size_t i = 1; i < m_workers.size(); i++)
+        {
+            if (m_workers[i]->m_pending.load(std::memory_order_relaxed) < worker->m_pending.load(std::memory_order_relaxed))
+            {
+                worker = m_workers[i];
+            }
+        }
+        worker->m_pending.fetch_add(1, std::memory_order_relaxed);
+        worker->m_thread->getEventLoop()->addTask([worker, cb]() {
+            cb();
+            worker->m_pending.fetch_sub(1, std::memory_order_relaxed);
+        }, true);
+    }
+
+    int RpcWorkerPool::getQueueSize()
+    {
+        int count = 0;
+        for (size_t i = 0; i < m_workers.size(); i++)
+        {
+            count += m_workers[i]->m_pending.load(std::memory_order_relaxed);
+        }
+        return count;
+    }
+
+    int RpcWorkerPool::size()
+    {
+        return (int)m_workers.size();
+    }
+
+}
@@ -0,0 +1,39 @@
+#ifndef ROCKET_NET_RPC_RPC_WORKER_POOL_H
+#define ROCKET_NET_RPC_RPC_WORKER_POOL_H
+
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <functional>
+#include "rocket/net/io_thread.h"
+
+namespace rocket {
+
+/*
+    业务线程池,执行比较慢的rpc方法,避免阻塞IO线程上的其他连接
+    IO线程decode之后把请求交给线程池,业务线程执行完再通过EventLoop::addTask把回包交回IO线程发送
+    每个业务线程也跑一个EventLoop,任务通过addTask投递,业务方法里可以直接发起下游rpc调用
+    任务交给排队数最少的线程
+*/
+class RpcWorkerPool {
+public:
+    typedef std::shared_ptr<RpcWorkerPool> s_ptr;
+    RpcWorkerPool(int size);
+    ~RpcWorkerPool();
+    //可以在任意线程调用
+    void addTask(std::function<void()> cb);
+    //还没执行完的任务数
+    int getQueueSize();
+    int size();
+
+private:
+    struct Worker {
+        IOThread * m_thread {NULL};
+        std::atomic<int> m_pending {0};     //投递了但还没执行完的任务数
+    };
+    std::vector<Worker *> m_workers;
+};
+
+}
+
+#endif
@@ -10,6 +10,7 @@ namespace rocket {
         m_addr.sin_family = AF_INET;
         m_addr.sin_addr.s_addr = inet_addr(m_ip.c_str());
         m_addr.sin_port = htons(m_port);
+        m_addr_str = m_ip + ":" + std::to_string(m_port);
     }
     IPNetAddr::IPNetAddr(const std::string & addr) {
         size_t i = addr.find_first_of(":");
@@ -22,11 +23,13 @@ namespace rocket {
         m_addr.sin_family = AF_INET;
         m_addr.sin_addr.s_addr = inet_addr(m_ip.c_str());
         m_addr.sin_port = htons(m_port);
+        m_addr_str = m_ip + ":" + std::to_string(m_port);
     }
     IPNetAddr::IPNetAddr(sockaddr_in addr): m_addr(addr) {
         //将网络字节序转换成ascii码
         m_ip = std::string(inet_ntoa(m_addr.sin_addr));
         m_port = ntohs(m_addr.sin_port);
+        m_addr_str = m_ip + ":" + std::to_string(m_port);
     }
     sockaddr * IPNetAddr::getSockAddr() {
         return reinterpret_cast<sockaddr *>(&m_addr);
@@ -38,9 +41,7 @@ namespace rocket {
         return AF_INET;
     }
     std::string IPNetAddr::toString() {
-        std::string re;
-        re = m_ip + ":" + std::to_string(m_port);
-        return re;
+        return m_addr_str;
     }
 
     bool IPNetAddr::checkValid() {
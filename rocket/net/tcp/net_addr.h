@@ -33,6 +33,7 @@ private:
     std::string m_ip;
     uint16_t m_port;
     sockaddr_in m_addr;
+    std::string m_addr_str;     //"ip:port",构造时生成,打日志时不用每次拼接
 };
 
 
@@ -9,9 +9,15 @@ namespace rocket {
 class TcpAcceptor {
 public:
     typedef std::shared_ptr<TcpAcceptor> s_ptr;//由于是多线程，使用智能指针可以保证线程安全    typedef std::shared_ptr<TcpAcceptor> s_ptr;
-    TcpAcceptor(NetAddr::s_ptr local_addr);
+    //reuse_port为true时设置SO_REUSEPORT,多个acceptor可以绑定同一个地址,由内核分配连接
+    TcpAcceptor(NetAddr::s_ptr local_addr, bool reuse_port = false);
     ~TcpAcceptor();
+    //非阻塞的accept4,新连接直接带上SOCK_NONBLOCK|SOCK_CLOEXEC
+    //失败时返回的fd为-1,errno留给调用方判断,EAGAIN表示已经取完了
     std::pair<int, NetAddr::s_ptr> accept();
+    //fd用完(EMFILE/ENFILE)时调用,先让出预留的fd把一个连接接下来马上关掉,
+    //否则这个连接一直留在队列里,监听套接字会一直可读
+    void discardOne();
     int getListenFd();
 private:
     //服务端监听的地址 addr -> ip:port
@@ -20,6 +26,8 @@ private:
 
     //监听套接字
     int m_listenfd {-1};
+    //预留的空闲fd
+    int m_idle_fd {-1};
 };
 
 }
@@ -4,22 +4,38 @@
 
 namespace rocket
 {
-    TcpBuffer::TcpBuffer(int size) : m_size(size)
+    // 向上取整到2的幂次,这样取模可以用与运算
+    static int roundUpPowerOfTwo(int size)
     {
-        m_buffer.resize(size);
+        int n = 1;
+        while (n < size)
+        {
+            n <<= 1;
+        }
+        return n;
+    }
+
+    TcpBuffer::TcpBuffer(int size) : m_size(roundUpPowerOfTwo(size > 0 ? size : 1))
+    {
+        m_buffer = new char[m_size];
     }
     TcpBuffer::~TcpBuffer()
     {
+        if (m_buffer)
+        {
+            delete[] m_buffer;
+            m_buffer = NULL;
+        }
     }
     // 返回可读字节数
     int TcpBuffer::readAble()
     {
-        return m_write_index - m_read_index;
+        return m_read_able;
     }
     // 返回可写的字节数
     int TcpBuffer::writeAble()
     {
-        return m_buffer.size() - m_write_index;
+        return m_size - m_read_able;
     }
     // 获取index
     int TcpBuffer::readIndex()
@@ -28,18 +44,25 @@ namespace rocket
     }
     int TcpBuffer::writeIndex()
     {
-        return m_write_index;
+        return (m_read_index + m_read_able) & (m_size - 1);
+    }
+    int TcpBuffer::capacity()
+    {
+        return m_size;
     }
     void TcpBuffer::writeToBuffer(const char *buf, int size)
     {
         if (size > writeAble())
         {
             // 调整Buffer大小，本质上是扩容
-            int new_size = (int)(1.5 * (m_write_index + size));
-            resizeBuffer(new_size);
+            resizeBuffer((int)(1.5 * (m_read_able + size)));
         }
-        memcpy(&m_buffer[m_write_index], buf, size);
-        m_write_index += size;
+        // 最多分成两段拷贝
+        int write_index = writeIndex();
+        int first = std::min(size, m_size - write_index);
+        memcpy(m_buffer + write_index, buf, first);
+        memcpy(m_buffer, buf + first, size - first);
+        m_read_able += size;
     }
     void TcpBuffer::readFromBuffer(std::vector<char> &re, int size)
     {
@@ -49,58 +72,144 @@ namespace rocket
         }
         int read_size = readAble() > size ? size : readAble();
         std::vector<char> tmp(read_size);
-        memcpy(&tmp[0], &m_buffer[m_read_index], read_size);
+        peek(&tmp[0], read_size);
         re.swap(tmp);
-        m_read_index += read_size;
-
-        adjustBuffer();
+        moveReadIndex(read_size);
     }
     void TcpBuffer::resizeBuffer(int new_size)
     {
-        std::vector<char> tmp(new_size);
-        int count = std::min(new_size, readAble());
-        memcpy(&tmp[0], &m_buffer[m_read_index], count);
-        m_buffer.swap(tmp);
-        m_read_index = 0;
-        m_write_index = m_read_index + count;
-    }
-    // 数组的平移
-    void TcpBuffer::adjustBuffer()
-    {
-        // 调整条件
-        if (m_read_index < int(m_buffer.size()) / 3)
+        // 不能丢掉已有数据
+        new_size = roundUpPowerOfTwo(std::max(new_size, m_read_able));
+        if (new_size == m_size)
         {
             return;
         }
-        std::vector<char> buffer(m_buffer.size());
-        int count = readAble();
-
-        memcpy(&buffer[0], &m_buffer[m_read_index], count);
-        m_buffer.swap(buffer);
+        char *tmp = new char[new_size];
+        // 扩容的时候顺便把数据摆正到开头
+        peek(tmp, m_read_able);
+        delete[] m_buffer;
+        m_buffer = tmp;
+        m_size = new_size;
         m_read_index = 0;
-        m_write_index = m_read_index + count;
-        buffer.clear();
     }
 
     void TcpBuffer::moveReadIndex(int size)
     {
-        // 移动的距离不能超过数组大小, 先获得移动后的距离
-        size_t j = m_read_index + size;
-        if (j >= m_buffer.size())
+        // 移动的距离不能超过可读的字节数
+        if (size > m_read_able)
         {
-            ERRORLOG("moveReadIndex error, invalid size %d, old_read_index %d, buffer size %d", size, m_read_index, m_buffer.size());
+            ERRORLOG("moveReadIndex error, invalid size %d, old_read_index %d, read able %d", size, m_read_index, m_read_able);
+            size = m_read_able;
+        }
+        m_read_index = (m_read_index + size) & (m_size - 1);
+        m_read_able -= size;
+        // 读空了直接把读位置归零, 尽量让后面的数据保持连续, 不需要拷贝
+        if (m_read_able == 0)
+        {
+            m_read_index = 0;
         }
-        m_read_index = j;
-        adjustBuffer();
     }
     void TcpBuffer::moveWriteIndex(int size)
     {
-        size_t j = m_write_index + size;
-        if (j >= m_buffer.size())
+        if (size > writeAble())
+        {
+            ERRORLOG("moveWriteIndex error, invalid size %d, old_read_index %d, buffer size %d", size, m_read_index, m_size);
+            size = writeAble();
+        }
+        m_read_able += size;
+    }
+
+    int TcpBuffer::readIovec(struct iovec *iov)
+    {
+        if (m_read_able == 0)
+        {
+            return 0;
+        }
+        int first = std::min(m_read_able, m_size - m_read_index);
+        iov[0].iov_base = m_buffer + m_read_index;
+        iov[0].iov_len = first;
+        if (first == m_read_able)
+        {
+            return 1;
+        }
+        iov[1].iov_base = m_buffer;
+        iov[1].iov_len = m_read_able - first;
+        return 2;
+    }
+    int TcpBuffer::writeIovec(struct iovec *iov)
+    {
+        int write_able = writeAble();
+        if (write_able == 0)
         {
-            ERRORLOG("moveWriteIndex error, invalid size %d, old_read_index %d, buffer size %d", size, m_read_index, m_buffer.size());
+            return 0;
+        }
+        int write_index = writeIndex();
+        int first = std::min(write_able, m_size - write_index);
+        iov[0].iov_base = m_buffer + write_index;
+        iov[0].iov_len = first;
+        if (first == write_able)
+        {
+            return 1;
+        }
+        iov[1].iov_base = m_buffer;
+        iov[1].iov_len = write_able - first;
+        return 2;
+    }
+
+    void TcpBuffer::peek(char *dst, int size, int offset /*= 0*/)
+    {
+        if (offset + size > m_read_able)
+        {
+            ERRORLOG("peek error, invalid size %d, offset %d, read able %d", size, offset, m_read_able);
+            return;
+        }
+        int index = (m_read_index + offset) & (m_size - 1);
+        int first = std::min(size, m_size - index);
+        memcpy(dst, m_buffer + index, first);
+        memcpy(dst + first, m_buffer, size - first);
+    }
+    const char *TcpBuffer::peekContiguous(int size, int offset /*= 0*/)
+    {
+        if (offset + size > m_read_able)
+        {
+            ERRORLOG("peekContiguous error, invalid size %d, offset %d, read able %d", size, offset, m_read_able);
+            return NULL;
+        }
+        int index = (m_read_index + offset) & (m_size - 1);
+        if (index + size <= m_size)
+        {
+            return m_buffer + index;
+        }
+        // 跨越了环尾, 只有这一段需要拷贝
+        m_peek_scratch.resize(size);
+        peek(&m_peek_scratch[0], size, offset);
+        return m_peek_scratch.data();
+    }
+
+    char *TcpBuffer::reserveWrite(int size)
+    {
+        if (size > writeAble())
+        {
+            resizeBuffer((int)(1.5 * (m_read_able + size)));
+        }
+        int write_index = writeIndex();
+        if (write_index + size <= m_size)
+        {
+            m_reserve_in_scratch = false;
+            return m_buffer + write_index;
+        }
+        m_reserve_in_scratch = true;
+        m_reserve_scratch.resize(size);
+        return &m_reserve_scratch[0];
+    }
+    void TcpBuffer::commitWrite(int size)
+    {
+        if (m_reserve_in_scratch)
+        {
+            m_reserve_in_scratch = false;
+            writeToBuffer(m_reserve_scratch.data(), size);
+            return;
         }
-        m_write_index = j;
-        adjustBuffer();
+        moveWriteIndex(size);
     }
-}
\ No newline at end of file
+}
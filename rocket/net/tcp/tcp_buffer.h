@@ -1,40 +1,72 @@
 #ifndef ROCKET_NET_TCP_TCP_BUFFER_H
 #define ROCKET_NET_TCP_TCP_BUFFER_H
 
+#include <sys/uio.h>
 #include <vector>
+#include <string>
 #include <memory>
 
 namespace rocket {
+/*
+    环形缓冲区,容量是2的幂次,读写下标对容量取模
+    读写只移动下标,不会再平移数组;只有数据放不下的时候才会扩容
+    可读/可写区域最多被环尾分成两段,通过iovec交给readv/writev
+    扩容和缩容(resizeBuffer)仍然会重新分配一块内存并把可读数据拷贝过去,代价是一次O(可读字节数)的拷贝
+    容量稳定之后读写都不会再分配;扩容/缩容之后,之前peekContiguous/reserveWrite返回的环内地址都会失效
+*/
 class TcpBuffer {
 public:
     typedef std::shared_ptr<TcpBuffer> s_ptr;
     TcpBuffer(int size);
     ~TcpBuffer();
+    TcpBuffer(const TcpBuffer &) = delete;
+    TcpBuffer & operator=(const TcpBuffer &) = delete;
     //返回可读字节数
     int readAble();
     //返回可写的字节数
     int writeAble();
-    //获取index
+    //获取index,都是在环里面的位置
     int readIndex();
     int writeIndex();
+    //容量
+    int capacity();
     void writeToBuffer(const char * buf, int size);
     void readFromBuffer(std::vector<char> & re, int size);
+    //调整容量,保留已有数据,可以扩容也可以缩容(不小于可读字节数)
     void resizeBuffer(int new_size);
-    void adjustBuffer();
     //往右调整,调整已读位置
     void  moveReadIndex(int size);
-    //往右调整,调整可写位置 
+    //往右调整,调整可写位置
     void moveWriteIndex(int size);
 
+    //获取可读区域,返回段数(0~2),用于writev
+    int readIovec(struct iovec * iov);
+    //获取可写区域,返回段数(0~2),用于readv
+    int writeIovec(struct iovec * iov);
+
+    //从读位置偏移offset处拷贝size个字节到dst,不移动读指针
+    void peek(char * dst, int size, int offset = 0);
+    //返回从读位置偏移offset处开始size个字节的连续内存,不移动读指针
+    //数据跨越环尾时会拷贝到内部的临时区,临时区在下一次peekContiguous之前有效
+    const char * peekContiguous(int size, int offset = 0);
+
+    //预留size个字节的连续可写空间,写完调用commitWrite(size)
+    //环尾连续空间不够时返回内部临时区的地址,commitWrite时再拷贝进环里
+    //和peekContiguous用不同的临时区,预留期间可以peek
+    char * reserveWrite(int size);
+    void commitWrite(int size);
+
 private:
-    int m_read_index {0};
-    int m_write_index {0};
-    int m_size {0};
-public:
-    std::vector<char> m_buffer; //双端队列性能更好
+    int m_read_index {0};   //读位置
+    int m_read_able {0};    //可读字节数,写位置 = (读位置 + 可读字节数) & (容量 - 1)
+    int m_size {0};         //容量,2的幂次
+    char * m_buffer {NULL}; //不需要初始化内容,所以不用vector
+    std::string m_peek_scratch;     //peekContiguous跨越环尾时使用的临时区
+    std::string m_reserve_scratch;  //reserveWrite跨越环尾时使用的临时区
+    bool m_reserve_in_scratch {false};
 };
 
 }
 
 
-#endif
\ No newline at end of file
+#endif
@@ -32,6 +32,11 @@ namespace rocket
         DEBUGLOG("TcpClient::~TcpClient()");
         if (m_fd > 0)
         {
+            if (m_fd_event)
+            {
+                m_event_loop->delEpollEvent(m_fd_event);
+            }
+            FdEventGroup::GetFdEventGroup()->releaseFdEvent(m_fd);
             close(m_fd);
         }
     }
@@ -39,6 +44,19 @@ namespace rocket
     // 如果connect成功，done会被执行
     void TcpClient::connect(std::function<void()> done)
     {
+        if (isConnected())
+        {
+            if (done)
+            {
+                done();
+            }
+            return;
+        }
+        if (m_is_connecting)
+        {
+            m_connect_waiters.push_back(done);
+            return;
+        }
         int rt = ::connect(m_fd, m_peer_addr->getSockAddr(), m_peer_addr->getSockLen());
         if (rt == 0)
         {
@@ -55,6 +73,7 @@ namespace rocket
             if (errno == EINPROGRESS)
             {
                 // epoll监听可写事件，监听错误码
+                m_is_connecting = true;
                 m_fd_event->listen(
                     FdEvent::OUT_EVENT,
                     [=]()
@@ -104,11 +123,21 @@ namespace rocket
                         // 连接完成后需要去掉可写事件的监听，不然会一直触发
                         m_event_loop->delEpollEvent(m_fd_event);
                         DEBUGLOG("now begin to done");
+                        m_is_connecting = false;
+                        std::vector<std::function<void()>> waiters;
+                        waiters.swap(m_connect_waiters);
                         // 如果连接成功，才会执行回调函数
                         if (done)
                         {
                             done();
                         }
+                        for (size_t i = 0; i < waiters.size(); i++)
+                        {
+                            if (waiters[i])
+                            {
+                                waiters[i]();
+                            }
+                        }
                     });
 
                 m_event_loop->addEpollEvent(m_fd_event);
@@ -153,6 +182,10 @@ namespace rocket
         m_connection->pushReadMessage(req_id, done);
         m_connection->listenRead();
     }
+    void TcpClient::cancelReadMessage(const std::string &req_id)
+    {
+        m_connection->cancelReadMessage(req_id);
+    }
     int TcpClient::getConnectErrorCode()
     {
         return m_connect_error_code;
@@ -188,4 +221,21 @@ namespace rocket
         m_event_loop->addTimerEvent(timer_event);
     }
 
+    bool TcpClient::isConnected()
+    {
+        return m_connection && m_connection->getState() == Connected;
+    }
+
+    bool TcpClient::checkAlive()
+    {
+        if (!isConnected())
+        {
+            return false;
+        }
+        // 空闲连接上不应该有数据,读到0说明对端已经关闭,读到数据说明连接状态乱了,都不能再用
+        char c;
+        int rt = ::recv(m_fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+        return rt < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    }
+
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define ROCKET_NET_TCP_TCP_CLIENT_H
 
 #include <memory>
+#include <vector>
 #include "rocket/net/tcp/net_addr.h"
 #include "rocket/net/eventloop.h"
 #include "rocket/net/tcp/tcp_connection.h"
@@ -18,6 +19,7 @@ public:
     //异步的进行connect,因此需要一个回调来获取结果
     //如果connect完成，done会被执行（只是连接动作完成，成功失败根据错误码判断）
     //注意eventloop下，所有的读、写、connect都是异步的
+    //多路复用时可能有多个请求同时等同一个连接建立,正在连接时再调用只登记done,连接完成后一起执行
     void connect(std::function<void()> done);
 
     //异步的发送Message,Message是什么都行
@@ -28,6 +30,8 @@ public:
     //异步的读取Message
     //如果读取message成功，会调用done函数，函数的入参就是message对象 
     void readMessage(const std::string & req_id, std::function<void(AbstractProtocol::s_ptr)>done);
+    //不再等req_id的回包
+    void cancelReadMessage(const std::string & req_id);
     //结束loop循环
     void stop();
 
@@ -41,6 +45,11 @@ public:
 
     void addTimerEvent(TimerEvent::s_ptr timer_event);
 
+    //连接已经建立并且没有被关闭
+    bool isConnected();
+    //连接池复用前的健康检查:已连接,并且socket上没有对端的FIN或者多余的数据
+    bool checkAlive();
+
 private:
     NetAddr::s_ptr m_peer_addr;     //对端地址
     NetAddr::s_ptr m_local_addr;
@@ -50,6 +59,8 @@ private:
     TcpConnection::s_ptr m_connection;  //利用connection对象实现数据收发
     int m_connect_error_code {0};
     std::string m_connect_error_info;
+    bool m_is_connecting {false};
+    std::vector<std::function<void()>> m_connect_waiters;   //连接过程中后来的connect调用
 };
 
     
@@ -0,0 +1,208 @@
+#include <algorithm>
+#include "rocket/net/tcp/tcp_client_pool.h"
+#include "rocket/net/eventloop.h"
+#include "rocket/common/config.h"
+#include "rocket/common/log.h"
+#include "rocket/common/util.h"
+
+namespace rocket {
+    static thread_local TcpClientPool * t_client_pool = NULL;
+    static const int g_reap_interval = 1000;    //空闲连接最长的扫描间隔,ms
+
+    TcpClientPool * TcpClientPool::GetTcpClientPool()
+    {
+        if (t_client_pool == NULL)
+        {
+            t_client_pool = new TcpClientPool();
+        }
+        return t_client_pool;
+    }
+
+    TcpClientPool::TcpClientPool()
+    {
+        Config * config = Config::GetGlobalConfig();
+        if (config)
+        {
+            m_max_per_peer = config->m_client_pool_max_per_peer;
+            m_max_idle = config->m_client_pool_max_idle;
+            m_idle_timeout = config->m_client_pool_idle_timeout;
+            m_max_inflight = config->m_client_max_inflight;
+        }
+        if (m_max_inflight < 1)
+        {
+            m_max_inflight = 1;
+        }
+        //超时时间比扫描间隔短时按超时时间扫描,连接最多多留一个间隔
+        int interval = std::max(1, std::min(m_idle_timeout, g_reap_interval));
+        m_reap_timer = std::make_shared<TimerEvent>(interval, true, std::bind(&TcpClientPool::onReapTimer, this));
+        EventLoop::GetCurrentEventLoop()->addTimerEvent(m_reap_timer);
+    }
+    TcpClientPool::~TcpClientPool()
+    {
+        m_reap_timer->setCancel(true);
+    }
+
+    void TcpClientPool::acquire(NetAddr::s_ptr peer_addr, AcquireCallback cb)
+    {
+        PeerPool & pool = m_peers[peer_addr->toString()];
+        reapIdle(pool, getNowUs());
+        //按顺序找第一个还有空位的连接,请求集中在前面的连接上,后面的连接空闲下来会被回收
+        for (size_t i = 0; i < pool.m_clients.size(); )
+        {
+            PooledClient & entry = pool.m_clients[i];
+            if (entry.m_inflight >= m_max_inflight)
+            {
+                i++;
+                continue;
+            }
+            if (entry.m_inflight == 0 && !entry.m_client->checkAlive())
+            {
+                DEBUGLOG("drop dead connection to [%s]", peer_addr->toString().c_str());
+                drop(entry.m_client);
+                pool.m_clients.erase(pool.m_clients.begin() + i);
+                continue;
+            }
+            entry.m_inflight++;
+            TcpClient::s_ptr client = entry.m_client;
+            cb(client);
+            return;
+        }
+        if (m_max_per_peer > 0 && (int)pool.m_clients.size() >= m_max_per_peer)
+        {
+            DEBUGLOG("connections to [%s] reach max %d, wait", peer_addr->toString().c_str(), m_max_per_peer);
+            pool.m_waiters.push_back(cb);
+            return;
+        }
+        cb(newClient(pool, peer_addr));
+    }
+
+    void TcpClientPool::release(TcpClient::s_ptr client, bool is_reusable)
+    {
+        NetAddr::s_ptr peer_addr = client->getPeerAddr();
+        PeerPool & pool = m_peers[peer_addr->toString()];
+        size_t i = 0;
+        while (i < pool.m_clients.size() && pool.m_clients[i].m_client != client)
+        {
+            i++;
+        }
+        if (i == pool.m_clients.size())
+        {
+            //已经被摘掉的连接,上面剩下的请求完成后直接关掉
+            drop(client);
+            return;
+        }
+        if (!is_reusable || !client->isConnected())
+        {
+            //连接上其他还没完成的请求继续等各自的回包或者超时,但不会再有新请求用它
+            pool.m_clients.erase(pool.m_clients.begin() + i);
+            drop(client);
+            if (!pool.m_waiters.empty())
+            {
+                AcquireCallback cb = pool.m_waiters.front();
+                pool.m_waiters.pop_front();
+                cb(newClient(pool, peer_addr));
+            }
+            return;
+        }
+        PooledClient & entry = pool.m_clients[i];
+        if (!pool.m_waiters.empty())
+        {
+            //有人在排队,空出来的位置直接给他;和acquire一样,连接空下来时先检查是否还活着
+            AcquireCallback cb = pool.m_waiters.front();
+            pool.m_waiters.pop_front();
+            if (entry.m_inflight == 1 && !client->checkAlive())
+            {
+                DEBUGLOG("drop dead connection to [%s]", peer_addr->toString().c_str());
+                pool.m_clients.erase(pool.m_clients.begin() + i);
+                drop(client);
+                cb(newClient(pool, peer_addr));
+                return;
+            }
+            cb(client);
+            return;
+        }
+        entry.m_inflight--;
+        if (entry.m_inflight > 0)
+        {
+            return;
+        }
+        int64_t now = getNowUs();
+        entry.m_idle_since = now;
+        int idle_count = 0;
+        for (size_t j = 0; j < pool.m_clients.size(); j++)
+        {
+            if (pool.m_clients[j].m_inflight == 0)
+            {
+                idle_count++;
+            }
+        }
+        if (idle_count > m_max_idle)
+        {
+            pool.m_clients.erase(pool.m_clients.begin() + i);
+            drop(client);
+        }
+        reapIdle(pool, now);
+    }
+
+    int TcpClientPool::getConnectionCount(NetAddr::s_ptr peer_addr)
+    {
+        auto it = m_peers.find(peer_addr->toString());
+        return it == m_peers.end() ? 0 : (int)it->second.m_clients.size();
+    }
+
+    int TcpClientPool::getInflightCount(NetAddr::s_ptr peer_addr)
+    {
+        auto it = m_peers.find(peer_addr->toString());
+        if (it == m_peers.end())
+        {
+            return 0;
+        }
+        int count = 0;
+        for (size_t i = 0; i < it->second.m_clients.size(); i++)
+        {
+            count += it->second.m_clients[i].m_inflight;
+        }
+        return count;
+    }
+
+    void TcpClientPool::drop(TcpClient::s_ptr client)
+    {
+        EventLoop::GetCurrentEventLoop()->addTask([client]() {
+            DEBUGLOG("close pooled connection to [%s]", client->getPeerAddr()->toString().c_str());
+        });
+    }
+
+    void TcpClientPool::reapIdle(PeerPool & pool, int64_t now)
+    {
+        for (size_t i = 0; i < pool.m_clients.size(); )
+        {
+            PooledClient & entry = pool.m_clients[i];
+            if (entry.m_inflight == 0 && now - entry.m_idle_since >= (int64_t)m_idle_timeout * 1000)
+            {
+                drop(entry.m_client);
+                pool.m_clients.erase(pool.m_clients.begin() + i);
+                continue;
+            }
+            i++;
+        }
+    }
+
+    void TcpClientPool::onReapTimer()
+    {
+        int64_t now = getNowUs();
+        for (auto it = m_peers.begin(); it != m_peers.end(); ++it)
+        {
+            reapIdle(it->second, now);
+        }
+    }
+
+    TcpClient::s_ptr TcpClientPool::newClient(PeerPool & pool, NetAddr::s_ptr peer_addr)
+    {
+        PooledClient entry;
+        entry.m_client = std::make_shared<TcpClient>(peer_addr);
+        entry.m_inflight = 1;
+        pool.m_clients.push_back(entry);
+        return entry.m_client;
+    }
+
+}
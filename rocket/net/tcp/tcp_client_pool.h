@@ -0,0 +1,73 @@
+#ifndef ROCKET_NET_TCP_TCP_CLIENT_POOL_H
+#define ROCKET_NET_TCP_TCP_CLIENT_POOL_H
+
+#include <deque>
+#include <vector>
+#include <string>
+#include <functional>
+#include <unordered_map>
+#include "rocket/net/tcp/tcp_client.h"
+#include "rocket/net/tcp/net_addr.h"
+#include "rocket/net/timer_event.h"
+
+namespace rocket {
+
+/*
+    客户端连接池,每个线程一个,池里的TcpClient都挂在这个线程的EventLoop上,不需要加锁
+    按对端地址分组,每个连接上最多同时有max_inflight个请求在路上:
+    1. max_inflight为1时一个连接同一时刻只给一个请求用
+    2. 大于1时是多路复用,请求按msg_id匹配回包,先把前面的连接填满,少量连接就能跑满
+    借的时候优先用已有的连接,空闲连接复用前检查是否还活着,空闲太久的直接关掉
+    没有新的借还时,定时器定期扫描所有对端,把空闲超时的连接关掉
+    连接都满了并且连接数达到上限后排队,等有请求完成时再给
+*/
+class TcpClientPool {
+public:
+    typedef std::function<void(TcpClient::s_ptr)> AcquireCallback;
+
+    TcpClientPool();
+    ~TcpClientPool();
+    //拿到连接后调用cb,可能马上调用,也可能排队等到别人归还连接时调用
+    //拿到的连接可能还没有connect,由调用方去连接
+    void acquire(NetAddr::s_ptr peer_addr, AcquireCallback cb);
+    //一个请求用完归还,is_reusable为false表示连接不可靠了(连接失败,超时),不再分给新请求
+    void release(TcpClient::s_ptr client, bool is_reusable);
+    //连接数
+    int getConnectionCount(NetAddr::s_ptr peer_addr);
+    //在路上的请求数
+    int getInflightCount(NetAddr::s_ptr peer_addr);
+
+public:
+    static TcpClientPool * GetTcpClientPool();
+
+private:
+    struct PooledClient {
+        TcpClient::s_ptr m_client;
+        int m_inflight {0};     //在这个连接上还没完成的请求数
+        int64_t m_idle_since {0};   //m_inflight变成0的时间,us
+    };
+    struct PeerPool {
+        std::vector<PooledClient> m_clients;
+        std::deque<AcquireCallback> m_waiters;
+    };
+    //关闭连接,可能正在这个连接自己的回调里面,放到下一轮loop再析构
+    void drop(TcpClient::s_ptr client);
+    //关掉空闲超时的连接
+    void reapIdle(PeerPool & pool, int64_t now);
+    //定时扫描所有对端
+    void onReapTimer();
+    //新建连接并占用一个请求位置
+    TcpClient::s_ptr newClient(PeerPool & pool, NetAddr::s_ptr peer_addr);
+
+private:
+    std::unordered_map<std::string, PeerPool> m_peers;
+    int m_max_per_peer {64};    //每个对端最多的连接数,0表示不限制
+    int m_max_idle {8};         //每个对端最多保留的空闲连接数
+    int m_idle_timeout {30000}; //空闲连接最多保留多久,ms
+    int m_max_inflight {1};     //每个连接上最多同时在路上的请求数
+    TimerEvent::s_ptr m_reap_timer;
+};
+
+}
+
+#endif
@@ -1,17 +1,24 @@
 #include <unistd.h>
 #include <string.h>
+#include <sys/uio.h>
+#include <algorithm>
 #include "rocket/net/tcp/tcp_connection.h"
 #include "rocket/net/coder/string_coder.h"
 #include "rocket/net/coder/tinypb_coder.h"
+#include "rocket/common/util.h"
+#include "rocket/net/rpc/rpc_arena.h"
 
 namespace rocket
 {
     TcpConnection::TcpConnection(EventLoop *event_loop, int fd, int buffer_size, NetAddr::s_ptr peer_addr, NetAddr::s_ptr local_addr,TcpConnectionType type)
         : m_event_loop(event_loop), m_peer_addr(peer_addr), m_local_addr(local_addr), m_state(NotConnected), m_fd(fd), m_connection_type(type)
     {
+        m_event_loop->incConnectionCount();
+        m_last_active_time = getNowUs();
         m_in_buffer = std::make_shared<TcpBuffer>(buffer_size);
         m_out_buffer = std::make_shared<TcpBuffer>(buffer_size);
         m_fd_event = FdEventGroup::GetFdEventGroup()->getFdEvent(fd);
+        m_fd_generation = m_fd_event->getGeneration();
         m_fd_event->setNonBlock();
         m_coder = new TinyPBCoder();
         // 发生可读事件后，会调用read函数
@@ -26,6 +33,10 @@ namespace rocket
     TcpConnection::~TcpConnection()
     {
         DEBUGLOG("~TcpConnection");
+        if (m_state != Closed)
+        {
+            m_event_loop->decConnectionCount();
+        }
         if (m_coder)
         {
             delete m_coder;
@@ -35,27 +46,48 @@ namespace rocket
     void TcpConnection::onRead()
     {
         // 1.从socket缓冲区调用系统的read函数读取字节流到in_buffer里面
+        // shutdown之后socket一直可读(read返回0),不再读数据,直接清理,否则每轮epoll都会触发
+        if (m_state == HalfClosing)
+        {
+            DEBUGLOG("connection half closed, clear it, addr[%s], clienfd[%d]", m_peer_addr->toString().c_str(), m_fd);
+            clear();
+            return;
+        }
         if (m_state != Connected)
         {
             ERRORLOG("onRead error, client has already disconnected, addr[%s], clienfd[%d]", m_peer_addr->toString().c_str(), m_fd);
             return;
         }
+        m_last_active_time = getNowUs();
         // 一次性读完,LT模式
         bool is_read_all = false;
         bool is_close = false;
+        // 栈上的溢出区, in_buffer放不下的部分先读到这里, 一次readv就能把socket读空, 不用先扩容
+        char extra_buf[65536];
         while (!is_read_all)
         {
-            if (m_in_buffer->writeAble() == 0)
-            {
-                m_in_buffer->resizeBuffer(2 * m_in_buffer->m_buffer.size());
-            }
-            int read_count = m_in_buffer->writeAble();   // 获取当前能够写入的字节数
-            int write_index = m_in_buffer->writeIndex(); // 写入的起始位置
-            int rt = ::read(m_fd, &(m_in_buffer->m_buffer[write_index]), read_count);
-            DEBUGLOG("success read %d bytes form add[%s], client fd [%d]", rt, m_peer_addr->toString().c_str(), m_fd);
+            // 可写区域可能被环尾分成两段, 再加上栈上的溢出区
+            struct iovec iov[3];
+            int iov_count = m_in_buffer->writeIovec(iov);
+            int write_able = m_in_buffer->writeAble();
+            iov[iov_count].iov_base = extra_buf;
+            iov[iov_count].iov_len = sizeof(extra_buf);
+            iov_count++;
+            int read_count = write_able + sizeof(extra_buf);   // 本次最多能读的字节数
+            int rt = ::readv(m_fd, iov, iov_count);
+            DEBUGLOG_SAMPLED("success read %d bytes form add[%s], client fd [%d]", rt, m_peer_addr->toString().c_str(), m_fd);
             if (rt > 0)
             { // 读取成功
-                m_in_buffer->moveWriteIndex(rt);
+                if (rt <= write_able)
+                {
+                    m_in_buffer->moveWriteIndex(rt);
+                }
+                else
+                {
+                    // 溢出区里的数据追加进去, 只在这里扩容一次
+                    m_in_buffer->moveWriteIndex(write_able);
+                    m_in_buffer->writeToBuffer(extra_buf, rt - write_able);
+                }
                 if (rt == read_count)
                 {
                     // 没读完
@@ -79,6 +111,13 @@ namespace rocket
                 is_read_all = true;
                 break;
             }
+            else if (rt == -1 && errno != EINTR)
+            {
+                // 连接出错, 比如ECONNRESET, 按对端关闭处理
+                ERRORLOG("read error, errno = %d, error = %s, peer addr [%s]", errno, strerror(errno), m_peer_addr->toString().c_str());
+                is_close = true;
+                break;
+            }
         }
         if (is_close)
         {
@@ -104,21 +143,27 @@ namespace rocket
             // tmp.resize(size);
             // m_in_buffer->readFromBuffer(tmp, size);
             std::vector<AbstractProtocol::s_ptr> result;
-            std::vector<AbstractProtocol::s_ptr> replay_messages;
             m_coder->decode(result, m_in_buffer);
             for (size_t i = 0; i < result.size(); i++)
             {
                 //1.针对每一个请求，调用rpc方法，获取响应message
                 //2.将响应messge编码后放入到发送缓冲区，监听可写事件回包
-                INFOLOG("success get request [%s] from client[%s]", result[i]->m_msg_id.c_str(), m_peer_addr->toString().c_str());
-                std::shared_ptr<TinyPBProtocol> message = std::make_shared<TinyPBProtocol>();
-                // message->m_pb_data = "hello, this is rocket rpc test data";
-                // message->m_msg_id = result[i]->m_msg_id;
-                RpcDispatcher::GetRpcDispatcher()->dispatcher(result[i], message, this);
-                replay_messages.emplace_back(message);
+                INFOLOG_SAMPLED("success get request [%s] from client[%s]", result[i]->m_msg_id.c_str(), m_peer_addr->toString().c_str());
+                std::shared_ptr<TinyPBProtocol> request = std::dynamic_pointer_cast<TinyPBProtocol>(result[i]);
+                // 每个请求都会回一次包,回包之前连接不算空闲
+                m_pending_replies++;
+                // 方法对应的分发信息只查一次表,决定在哪个线程执行之后直接交给dispatcher
+                const RpcMethodEntry * entry = RpcDispatcher::GetRpcDispatcher()->findMethod(request->m_method_name);
+                if (entry && entry->m_worker_pool)
+                {
+                    dispatchToWorker(entry, request);
+                    continue;
+                }
+                // 同步处理完的回包直接编码进发送缓冲区,可写事件只注册一次,这一批回包还是一起发出去
+                RpcDispatcher::GetRpcDispatcher()->dispatcher(request, entry, m_local_addr, m_peer_addr, makeReplyCallback());
             }
-            m_coder->encode(replay_messages, m_out_buffer);           
-            listenWrite();
+            //同步处理的回包已经编码进发送缓冲区,这一批消息用完了
+            RpcArena::ResetThreadArena();
         } else {
             //从buffer中decode得到message对象,判断是否req_id相等，相等则成功,执行其回调
             std::vector<AbstractProtocol::s_ptr> result;
@@ -126,14 +171,21 @@ namespace rocket
             for (size_t i = 0; i < result.size(); ++i) {
                 //获取req_id
                 std::string req_id = result[i]->m_msg_id;
-                //找到req_id对应的回调函数
+                //找到req_id对应的回调函数,多个请求同时在路上,回包的顺序不一定和发送顺序一致
                 auto it = m_read_dones.find(req_id);
-                //执行回调函数注册的方法
-                if (it != m_read_dones.end()) {
-                    //获取智能指针
-                    it->second(result[i]);
+                if (it == m_read_dones.end()) {
+                    //已经超时取消了的请求,回包直接丢掉
+                    DEBUGLOG("%s | no pending call for response, drop it", req_id.c_str());
+                    continue;
                 }
+                //先从表里删掉再执行,回调里面可能会再注册新的请求,也可能把连接释放掉
+                std::function<void(AbstractProtocol::s_ptr)> done;
+                done.swap(it->second);
+                m_read_dones.erase(it);
+                done(result[i]);
             }
+            //NEWARENAMESSAGE创建的消息在回调里用完了的话,arena可以复用
+            RpcArena::ResetThreadArena();
         }
     }
     void TcpConnection::onWrite()
@@ -144,14 +196,19 @@ namespace rocket
             ERRORLOG("onWrite error, client has already disconnected, addr[%s], clienfd[%d]", m_peer_addr->toString().c_str(), m_fd);
             return;
         }
+        m_last_active_time = getNowUs();
+        // 先把待发送的请求取出来,回调里面新加的请求留到下一次发送
+        std::vector<std::pair<AbstractProtocol::s_ptr, std::function<void(AbstractProtocol::s_ptr)>>> write_dones;
+        write_dones.swap(m_write_dones);
         if (m_connection_type == TcpConnectionByClient)
         {
             // 1.将messge编码得到字节流
             // 2.将字节流写入到buffer里面,然后全部发送
+            // 两次可写事件之间写入的请求一起编码,一次writev发出去
             std::vector<AbstractProtocol::s_ptr> message;
-            for (size_t i = 0; i < m_write_dones.size(); i++)
+            for (size_t i = 0; i < write_dones.size(); i++)
             {
-                message.push_back(m_write_dones[i].first);
+                message.push_back(write_dones[i].first);
             }
             m_coder->encode(message, m_out_buffer); // 写入到发送缓冲区中
         }
@@ -164,15 +221,15 @@ namespace rocket
                 is_write_all = true;
                 break;
             }
-            int write_size = m_out_buffer->readAble();
-            int read_index = m_out_buffer->readIndex();
-            int rt = write(m_fd, &(m_out_buffer->m_buffer[read_index]), write_size);
-            if (rt >= write_size)
+            // 可读区域最多被环尾分成两段, 一次writev把所有编码好的回包都发出去
+            struct iovec iov[2];
+            int iov_count = m_out_buffer->readIovec(iov);
+            int rt = ::writev(m_fd, iov, iov_count);
+            if (rt > 0)
             {
-                // 说明数据发送成功
-                DEBUGLOG("success sending all data, now no data need to send to cilent [%s]", m_peer_addr->toString().c_str());
-                is_write_all = true;
-                break;
+                // 发出去的数据要从缓冲区移除, 否则下次会重复发送
+                m_out_buffer->moveReadIndex(rt);
+                continue;
             }
             if (errno == EAGAIN && rt == -1)
             { // 表示发送缓冲区满了,不能发送数据了
@@ -180,22 +237,26 @@ namespace rocket
                 DEBUGLOG("write data error, errno = EAGAIN and rt == -1");
                 break;
             }
+            if (rt == -1 && errno != EINTR)
+            {
+                ERRORLOG("write data error, errno = %d, error = %s, peer addr [%s]", errno, strerror(errno), m_peer_addr->toString().c_str());
+                break;
+            }
         }
-        if (is_write_all) // 发送完数据取消写事件监听，否则会一直触发写事件
+        if (is_write_all && isFdEventValid()) // 发送完数据取消写事件监听，否则会一直触发写事件
         {
             m_fd_event->cancel(FdEvent::OUT_EVENT);
             m_event_loop->addEpollEvent(m_fd_event);
+            m_listen_write = false;
         }
         // 执行回调函数
         if (m_connection_type == TcpConnectionByClient)
         {
-            for (size_t i = 0; i < m_write_dones.size(); i++)
+            for (size_t i = 0; i < write_dones.size(); i++)
             {
-                m_write_dones[i].second(m_write_dones[i].first);
+                write_dones[i].second(write_dones[i].first);
             }
         }
-        // 清空
-        m_write_dones.clear();
     }
     void TcpConnection::setState(const TcpState state)
     {
@@ -212,14 +273,35 @@ namespace rocket
         {
             return;
         }
-        m_fd_event->cancel(FdEvent::IN_EVENT);
-        m_fd_event->cancel(FdEvent::OUT_EVENT);
-        m_event_loop->delEpollEvent(m_fd_event); // 不会监听读写数据了
+        if (isFdEventValid())
+        {
+            m_fd_event->cancel(FdEvent::IN_EVENT);
+            m_fd_event->cancel(FdEvent::OUT_EVENT);
+            m_event_loop->delEpollEvent(m_fd_event); // 不会监听读写数据了
+        }
+        m_listen_read = false;
+        m_listen_write = false;
+        m_event_loop->decConnectionCount();
         m_state = Closed;
+        // 还在等回包的请求不会再有回包了,由各自的超时定时器处理
+        m_read_dones.clear();
+        // 服务端的fd由连接自己关闭,客户端的fd由TcpClient关闭
+        // 先清空FdEvent再close,fd号被复用时拿到的是干净的FdEvent
+        if (m_connection_type == TcpConnectionByServer)
+        {
+            FdEventGroup::GetFdEventGroup()->releaseFdEvent(m_fd);
+            ::close(m_fd);
+        }
+        if (m_close_callback)
+        {
+            std::function<void()> cb;
+            cb.swap(m_close_callback);
+            cb();
+        }
     }
     void TcpConnection::shutdown()
     {
-        if (m_state == Closed && m_state == NotConnected)
+        if (m_state == Closed || m_state == NotConnected)
         {
             return;
         }
@@ -237,24 +319,103 @@ namespace rocket
         m_connection_type = type;
     }
 
+    bool TcpConnection::isFdEventValid()
+    {
+        // FdEvent按fd号在所有IO线程之间共享,fd关闭(reset)之后同一个槽位可能已经属于别的连接了
+        return m_fd_event != NULL && m_fd_event->getGeneration() == m_fd_generation;
+    }
     void TcpConnection::listenWrite()
     {
+        // 已经在监听了就不用再调epoll_ctl,连续写入的请求等同一次可写事件一起发
+        if (m_listen_write || !isFdEventValid())
+        {
+            return;
+        }
+        m_listen_write = true;
         m_fd_event->listen(FdEvent::OUT_EVENT, std::bind(&TcpConnection::onWrite, this));
         m_event_loop->addEpollEvent(m_fd_event);
     }
     void TcpConnection::listenRead()
     {
-
+        if (m_listen_read || !isFdEventValid())
+        {
+            return;
+        }
+        m_listen_read = true;
         m_fd_event->listen(FdEvent::IN_EVENT, std::bind(&TcpConnection::onRead, this));
         m_event_loop->addEpollEvent(m_fd_event);
     }
 
+    void TcpConnection::reply(AbstractProtocol::s_ptr message)
+    {
+        if (m_pending_replies > 0)
+        {
+            m_pending_replies--;
+        }
+        if (m_state != Connected)
+        {
+            DEBUGLOG("%s | connection closed before response ready, drop it", message->m_msg_id.c_str());
+            return;
+        }
+        std::vector<AbstractProtocol::s_ptr> replay_messages(1, message);
+        m_coder->encode(replay_messages, m_out_buffer);
+        listenWrite();
+    }
+
+    std::function<void(AbstractProtocol::s_ptr)> TcpConnection::makeReplyCallback()
+    {
+        //done可能在连接关闭之后才执行,只持有weak_ptr,回到IO线程之后再确认连接还在
+        std::weak_ptr<TcpConnection> weak_connection = shared_from_this();
+        EventLoop * event_loop = m_event_loop;
+        return [weak_connection, event_loop](AbstractProtocol::s_ptr message) {
+            auto send = [weak_connection, message]() {
+                TcpConnection::s_ptr connection = weak_connection.lock();
+                if (!connection)
+                {
+                    DEBUGLOG("%s | connection released before response ready, drop it", message->m_msg_id.c_str());
+                    return;
+                }
+                connection->reply(message);
+            };
+            if (event_loop->isInLoopThread())
+            {
+                send();
+                return;
+            }
+            //其他线程执行的done,交回连接所在的IO线程发送
+            event_loop->addTask(send, true);
+        };
+    }
+
+    void TcpConnection::dispatchToWorker(const RpcMethodEntry * entry, std::shared_ptr<TinyPBProtocol> request)
+    {
+        //请求体是指向输入缓冲区的视图,交给其他线程之前要拷贝出来
+        request->materialize();
+        NetAddr::s_ptr local_addr = m_local_addr;
+        NetAddr::s_ptr peer_addr = m_peer_addr;
+        RpcDispatcher::ReplyCallback reply = makeReplyCallback();
+        //分发表启动后只读,entry在业务线程里可以直接用
+        entry->m_worker_pool->addTask([request, entry, local_addr, peer_addr, reply]() {
+            RpcDispatcher::GetRpcDispatcher()->dispatcher(request, entry, local_addr, peer_addr, reply);
+            RpcArena::ResetThreadArena();
+        });
+    }
+
     void TcpConnection::pushSendMessage(AbstractProtocol::s_ptr message, std::function<void(AbstractProtocol::s_ptr)> done)
     {
         m_write_dones.push_back(std::make_pair(message, done));
     }
     void TcpConnection::pushReadMessage(const std::string & req_id, std::function<void(AbstractProtocol::s_ptr)> done) {
-        m_read_dones.insert(std::make_pair(req_id, done));
+        //连接会被复用,同一个msg_id以最新注册的回调为准
+        m_read_dones[req_id] = done;
+    }
+    void TcpConnection::cancelReadMessage(const std::string & req_id)
+    {
+        m_read_dones.erase(req_id);
+    }
+    int TcpConnection::getPendingReadCount()
+    {
+        return (int)m_read_dones.size();
     }
 
     NetAddr::s_ptr TcpConnection::getLocalAddr()
@@ -265,4 +426,28 @@ namespace rocket
     {
         return m_peer_addr;
     }
+    void TcpConnection::setCloseCallback(std::function<void()> cb)
+    {
+        m_close_callback = cb;
+    }
+    int64_t TcpConnection::getLastActiveTime()
+    {
+        return m_last_active_time;
+    }
+    int TcpConnection::getPendingReplyCount()
+    {
+        return m_pending_replies;
+    }
+    void TcpConnection::shrinkBuffers(int baseline)
+    {
+        // 留4倍的余量,避免在边界上反复扩容缩容
+        if (m_in_buffer->capacity() > baseline * 4)
+        {
+            m_in_buffer->resizeBuffer(std::max(baseline, m_in_buffer->readAble()));
+        }
+        if (m_out_buffer->capacity() > baseline * 4)
+        {
+            m_out_buffer->resizeBuffer(std::max(baseline, m_out_buffer->readAble()));
+        }
+    }
 }
\ No newline at end of file
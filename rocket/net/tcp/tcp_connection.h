@@ -3,6 +3,7 @@
 
 #include <memory>
 #include <map>
+#include <unordered_map>
 #include <queue>
 #include "rocket/net/tcp/net_addr.h"
 #include "rocket/net/tcp/tcp_buffer.h"
@@ -10,11 +11,14 @@
 #include "rocket/net/fd_event_group.h"
 #include "rocket/net/coder/abstract_protocol.h"
 #include "rocket/net/coder/abstract_coder.h"
+#include "rocket/net/coder/tinypb_protocol.h"
+#include "rocket/net/rpc/rpc_worker_pool.h"
 #include "rocket/net/rpc/rpc_dispatcher.h"
 
 namespace rocket
 {
     class RpcDispatcher;
+    struct RpcMethodEntry;
     enum TcpState
     {
         // 当前连接的状态
@@ -29,7 +33,7 @@ namespace rocket
         TcpConnectionByClient = 2,    //作为客户端使用，代表跟对端服务端的连接
     };
 
-    class TcpConnection
+    class TcpConnection : public std::enable_shared_from_this<TcpConnection>
     {
     public:
         typedef std::shared_ptr<TcpConnection> s_ptr;
@@ -48,10 +52,32 @@ namespace rocket
         void listenWrite();
         //启动监听可读事件
         void listenRead();
+        //把回包编码进发送缓冲区并监听可写事件,只能在IO线程调用
+        void reply(AbstractProtocol::s_ptr message);
         void pushSendMessage(AbstractProtocol::s_ptr message, std::function<void(AbstractProtocol::s_ptr)> done);
         void pushReadMessage(const std::string & req_id, std::function<void(AbstractProtocol::s_ptr)> done);
+        //请求超时后不再等回包,迟到的回包会被丢掉
+        void cancelReadMessage(const std::string & req_id);
+        //还在等回包的请求数
+        int getPendingReadCount();
         NetAddr::s_ptr getLocalAddr();
         NetAddr::s_ptr getPeerAddr();
+        //clear的时候调用,通知连接的管理者
+        void setCloseCallback(std::function<void()> cb);
+        //最后一次读写的时间,us
+        int64_t getLastActiveTime();
+        //服务端收到了还没回包的请求数,包括在业务线程里执行和异步执行的
+        int getPendingReplyCount();
+        //缓冲区比baseline大很多的时候缩回去,保留里面的数据
+        void shrinkBuffers(int baseline);
+
+    private:
+        //把请求交给业务线程池,执行完之后回到IO线程发送回包
+        void dispatchToWorker(const RpcMethodEntry * entry, std::shared_ptr<TinyPBProtocol> request);
+        //dispatcher拿到回包后的回调,可以在任意线程执行,回包总是在本连接的IO线程发送
+        std::function<void(AbstractProtocol::s_ptr)> makeReplyCallback();
+        //m_fd_event还属于这个连接,fd关闭之后槽位可能被复用
+        bool isFdEventValid();
 
     private:
         EventLoop *m_event_loop {NULL};   // 代表持有该连接的IO线程
@@ -60,14 +86,20 @@ namespace rocket
         TcpBuffer::s_ptr m_in_buffer;  // 接收缓冲区
         TcpBuffer::s_ptr m_out_buffer; // 发送缓冲区
         FdEvent *m_fd_event{NULL};
+        uint32_t m_fd_generation{0};    // 拿到m_fd_event时的代数,fd关闭后FdEvent会被复用,不能再修改
         AbstractCoder * m_coder {NULL};
         TcpState m_state;
         int m_fd{0};
         TcpConnectionType m_connection_type {TcpConnectionByServer};
         //写回调
         std::vector<std::pair<AbstractProtocol::s_ptr, std::function<void(AbstractProtocol::s_ptr)>>> m_write_dones;
-        //读回调,key 为req_id
-        std::map<std::string, std::function<void(AbstractProtocol::s_ptr)>> m_read_dones;
+        //读回调,key 为req_id,收到回包后删除
+        std::unordered_map<std::string, std::function<void(AbstractProtocol::s_ptr)>> m_read_dones;
+        std::function<void()> m_close_callback;
+        int64_t m_last_active_time {0};
+        int m_pending_replies {0};  //只在IO线程里读写
+        bool m_listen_read {false};     //已经注册了可读事件
+        bool m_listen_write {false};    //已经注册了可写事件,数据全部发完后取消
 
     };
 
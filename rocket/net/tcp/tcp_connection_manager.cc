@@ -0,0 +1,89 @@
+#include "rocket/net/tcp/tcp_connection_manager.h"
+#include "rocket/common/log.h"
+#include "rocket/common/util.h"
+
+namespace rocket {
+    static const int g_scan_interval = 1000;   //扫描间隔,ms
+
+    TcpConnectionManager::TcpConnectionManager(EventLoop * event_loop, int idle_timeout, int buffer_baseline)
+        : m_event_loop(event_loop), m_idle_timeout(idle_timeout), m_buffer_baseline(buffer_baseline)
+    {
+        m_last_scan_time = getNowUs();
+        m_scan_timer = std::make_shared<TimerEvent>(g_scan_interval, true, std::bind(&TcpConnectionManager::onScan, this));
+        m_event_loop->addTimerEvent(m_scan_timer);
+    }
+    TcpConnectionManager::~TcpConnectionManager()
+    {
+        m_scan_timer->setCancel(true);
+    }
+
+    void TcpConnectionManager::addConnection(TcpConnection::s_ptr connection)
+    {
+        if (!m_event_loop->isInLoopThread())
+        {
+            m_event_loop->addTask([this, connection]() {
+                addConnection(connection);
+            }, true);
+            return;
+        }
+        TcpConnection * key = connection.get();
+        m_connections[key] = connection;
+        //关闭的时候clear还在连接自己的调用栈里,不能马上析构,放到下一轮再删
+        connection->setCloseCallback([this, key]() {
+            m_event_loop->addTask([this, key]() {
+                removeConnection(key);
+            });
+        });
+    }
+
+    int TcpConnectionManager::size()
+    {
+        return (int)m_connections.size();
+    }
+
+    void TcpConnectionManager::removeConnection(TcpConnection * connection)
+    {
+        m_connections.erase(connection);
+        DEBUGLOG("remove closed connection, %d connections left", (int)m_connections.size());
+    }
+
+    void TcpConnectionManager::onScan()
+    {
+        int64_t now = getNowUs();
+        for (auto it = m_connections.begin(); it != m_connections.end(); ++it)
+        {
+            TcpConnection::s_ptr connection = it->second;
+            if (connection->getState() == Closed)
+            {
+                continue;
+            }
+            int64_t last_active = connection->getLastActiveTime();
+            //请求还在业务线程或者异步处理中,没有读写也不算空闲,等回包发出去之后再重新计时
+            if (connection->getPendingReplyCount() > 0)
+            {
+                continue;
+            }
+            if (m_idle_timeout > 0 && now - last_active >= (int64_t)m_idle_timeout * 1000)
+            {
+                if (connection->getState() == HalfClosing)
+                {
+                    //上次已经shutdown了,对端还是没有关,直接清掉
+                    connection->clear();
+                }
+                else
+                {
+                    INFOLOG("connection idle timeout, peer addr [%s]", connection->getPeerAddr()->toString().c_str());
+                    connection->shutdown();
+                }
+                continue;
+            }
+            //上一个扫描周期内都没有读写,突发流量已经过去了,把缓冲区缩回去
+            if (last_active < m_last_scan_time)
+            {
+                connection->shrinkBuffers(m_buffer_baseline);
+            }
+        }
+        m_last_scan_time = now;
+    }
+
+}
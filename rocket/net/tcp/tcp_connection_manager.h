@@ -0,0 +1,38 @@
+#ifndef ROCKET_NET_TCP_TCP_CONNECTION_MANAGER_H
+#define ROCKET_NET_TCP_TCP_CONNECTION_MANAGER_H
+
+#include <unordered_map>
+#include "rocket/net/tcp/tcp_connection.h"
+#include "rocket/net/eventloop.h"
+#include "rocket/net/timer_event.h"
+
+namespace rocket {
+
+/*
+    每个IO线程一个,管理挂在这个线程上的服务端连接,只在IO线程里访问,不加锁
+    连接关闭后从表里删掉,连接的缓冲区和coder跟着释放
+    定时扫描: 空闲超时的连接主动关闭,还有请求没回包的不算空闲;上一个周期没有读写的连接把缓冲区缩回初始大小
+*/
+class TcpConnectionManager {
+public:
+    //idle_timeout为0表示不回收空闲连接,单位ms
+    TcpConnectionManager(EventLoop * event_loop, int idle_timeout, int buffer_baseline);
+    ~TcpConnectionManager();
+    //可以在任意线程调用,不在IO线程时转成任务
+    void addConnection(TcpConnection::s_ptr connection);
+    int size();
+private:
+    void removeConnection(TcpConnection * connection);
+    void onScan();
+private:
+    EventLoop * m_event_loop {NULL};
+    int m_idle_timeout {0};     //ms
+    int m_buffer_baseline {128};
+    std::unordered_map<TcpConnection *, TcpConnection::s_ptr> m_connections;
+    TimerEvent::s_ptr m_scan_timer;
+    int64_t m_last_scan_time {0};   //us
+};
+
+}
+
+#endif
@@ -1,13 +1,32 @@
 #include "rocket/net/tcp/tcp_server.h"
+#include <errno.h>
+#include <string.h>
 #include "rocket/common/config.h"
+#include "rocket/common/util.h"
+#include "rocket/net/rpc/rpc_dispatcher.h"
+#include "rocket/net/rpc/rpc_message_pool.h"
 
 
 namespace rocket {
+    static const int g_accept_pause_ms = 100;  //fd用完之后暂停accept的时间
+    static const int g_conn_buffer_size = 128;  //连接缓冲区的初始大小,也是空闲时缩回去的大小
+
     TcpServer::TcpServer(NetAddr::s_ptr local_addr): m_local_addr(local_addr) {
         init();
         INFOLOG("rocket TcpServer listen  success on [%s]", m_local_addr->toString().c_str());
     }
     TcpServer::~TcpServer() {
+        //连接管理器的扫描定时器和连接的关闭回调都在IO线程里执行,先把IO线程停掉再释放
+        if (m_io_thread_group && m_is_started) {
+            for (int i = 0; i < m_io_thread_group->size(); ++i) {
+                m_io_thread_group->getIOThread(i)->getEventLoop()->stop();
+            }
+            m_io_thread_group->join();
+        }
+        for (auto it = m_connection_managers.begin(); it != m_connection_managers.end(); ++it) {
+            delete it->second;
+        }
+        m_connection_managers.clear();
         if (m_main_event_loop) {
             delete m_main_event_loop;
             m_main_event_loop = NULL;
@@ -15,35 +34,158 @@ namespace rocket {
     }
     //设置回调函数
     void TcpServer::init() {
-        m_acceptor = std::make_shared<TcpAcceptor>(m_local_addr);
+        //主线程负责accept,在这里绑核
+        if (!bindCurrentThreadToCpus(Config::GetGlobalConfig()->m_main_thread_cpus)) {
+            ERRORLOG("main thread bind cpus [%s] error", Config::GetGlobalConfig()->m_main_thread_cpus.c_str());
+        }
+        m_create_in_io_thread = !Config::GetGlobalConfig()->m_io_thread_cpus.empty();
         m_main_event_loop = EventLoop::GetCurrentEventLoop(); 
         //可以把所有连接放到一个公共队列中，每个IO线程从公共队列中取
         m_io_thread_group = new IOThreadGroup(Config::GetGlobalConfig()->m_io_threads);
+        m_io_thread_group->setPlacement(IOThreadGroup::ParsePlacement(Config::GetGlobalConfig()->m_io_placement));
+        for (int i = 0; i < m_io_thread_group->size(); ++i) {
+            EventLoop * event_loop = m_io_thread_group->getIOThread(i)->getEventLoop();
+            m_connection_managers[event_loop] = new TcpConnectionManager(event_loop, Config::GetGlobalConfig()->m_conn_idle_timeout, g_conn_buffer_size);
+        }
+        if (Config::GetGlobalConfig()->m_worker_threads > 0) {
+            initWorkerPool();
+        }
+        RpcMessagePool::SetMaxSize(Config::GetGlobalConfig()->m_message_pool_size);
+        m_reuse_port = Config::GetGlobalConfig()->m_reuse_port != 0 && m_io_thread_group->size() > 0;
+        if (Config::GetGlobalConfig()->m_accept_batch > 0) {
+            m_accept_batch = Config::GetGlobalConfig()->m_accept_batch;
+        }
+        //每秒统计一次accept速率
+        m_accept_rate_timer = std::make_shared<TimerEvent>(1000, true, std::bind(&TcpServer::onAcceptRateTimer, this));
+        m_main_event_loop->addTimerEvent(m_accept_rate_timer);
+        if (m_reuse_port) {
+            initReusePortAcceptors();
+            return;
+        }
+        m_acceptor = std::make_shared<TcpAcceptor>(m_local_addr);
         m_listen_fd_event =  new FdEvent(m_acceptor->getListenFd());
         //当listenfd可读的时候就会调用onAccept函数
-        m_listen_fd_event->listen(FdEvent::IN_EVENT, std::bind(&TcpServer::onAccept, this));
+        m_listen_fd_event->listen(FdEvent::IN_EVENT, std::bind(&TcpServer::onAccept, this, m_acceptor, m_listen_fd_event, (IOThread *)NULL));
         m_main_event_loop->addEpollEvent(m_listen_fd_event);
     }
 
-    void TcpServer::onAccept() {
-        auto re = m_acceptor->accept();
-        int client_fd = re.first;
-        NetAddr::s_ptr peer_addr = re.second;
-        m_client_counts++;
-        //把client_fd添加到任意IO线程里面
-        IOThread * io_thread = m_io_thread_group->getIOThread();
-        TcpConnection::s_ptr connection = std::make_shared<TcpConnection>(io_thread->getEventLoop(), client_fd, 128, peer_addr, m_local_addr); 
-        /*
-        老师最后一节留的任务，就是加入定时任务，通过状态来判断是否要析构connection 
-        */
+    void TcpServer::initWorkerPool() {
+        m_worker_pool = std::make_shared<RpcWorkerPool>(Config::GetGlobalConfig()->m_worker_threads);
+        //没有指定服务/方法时所有请求都交给业务线程池
+        const std::string & names = Config::GetGlobalConfig()->m_worker_services;
+        if (names.empty()) {
+            RpcDispatcher::GetRpcDispatcher()->setWorkerPool("", m_worker_pool);
+            return;
+        }
+        size_t begin = 0;
+        while (begin <= names.length()) {
+            size_t end = names.find(',', begin);
+            if (end == std::string::npos) {
+                end = names.length();
+            }
+            std::string name = names.substr(begin, end - begin);
+            if (!name.empty()) {
+                INFOLOG("[%s] run in worker pool", name.c_str());
+                RpcDispatcher::GetRpcDispatcher()->setWorkerPool(name, m_worker_pool);
+            }
+            begin = end + 1;
+        }
+    }
+
+    void TcpServer::initReusePortAcceptors() {
+        //在主线程里bind,出错可以马上退出;监听套接字交给各自的IO线程,新连接不用再跨线程转交
+        for (int i = 0; i < m_io_thread_group->size(); ++i) {
+            IOThread * io_thread = m_io_thread_group->getIOThread(i);
+            TcpAcceptor::s_ptr acceptor = std::make_shared<TcpAcceptor>(m_local_addr, true);
+            FdEvent * listen_fd_event = new FdEvent(acceptor->getListenFd());
+            listen_fd_event->listen(FdEvent::IN_EVENT, std::bind(&TcpServer::onAccept, this, acceptor, listen_fd_event, io_thread));
+            io_thread->getEventLoop()->addEpollEvent(listen_fd_event);
+            m_reuse_port_acceptors.push_back(acceptor);
+            m_reuse_port_fd_events.push_back(listen_fd_event);
+        }
+        INFOLOG("TcpServer use SO_REUSEPORT, %d acceptors", (int)m_reuse_port_acceptors.size());
+    }
+
+    void TcpServer::onAccept(TcpAcceptor::s_ptr acceptor, FdEvent * listen_fd_event, IOThread * io_thread) {
+        //一次把积压的连接尽量取完,不用等下一轮epoll_wait
+        for (int i = 0; i < m_accept_batch; ++i) {
+            auto re = acceptor->accept();
+            int client_fd = re.first;
+            NetAddr::s_ptr peer_addr = re.second;
+            if (client_fd < 0) {
+                int err = errno;
+                if (err == EAGAIN || err == EWOULDBLOCK) {   //已经取完了
+                    break;
+                }
+                if (err == EINTR || err == ECONNABORTED) {  //对端在accept之前就断开了,继续取下一个
+                    continue;
+                }
+                ERRORLOG("accept error, errno=%d, error=%s", err, strerror(err));
+                if (err == EMFILE || err == ENFILE) {
+                    acceptor->discardOne();
+                    pauseAccept(listen_fd_event, io_thread ? io_thread->getEventLoop() : m_main_event_loop);
+                }
+                break;
+            }
+            m_accept_count++;
+            if (io_thread != NULL) {
+                newConnection(io_thread->getEventLoop(), client_fd, peer_addr);
+                continue;
+            }
+            //把client_fd添加到任意IO线程里面
+            EventLoop * event_loop = m_io_thread_group->getIOThread()->getEventLoop();
+            if (!m_create_in_io_thread) {
+                newConnection(event_loop, client_fd, peer_addr);
+                continue;
+            }
+            //IO线程绑了核,连接交给IO线程自己创建,主线程只负责accept
+            //先占一个连接数,避免同一批accept的连接按旧的计数都选到同一个线程,创建完再还回去
+            event_loop->incConnectionCount();
+            event_loop->addTask([this, event_loop, client_fd, peer_addr]() {
+                newConnection(event_loop, client_fd, peer_addr);
+                event_loop->decConnectionCount();
+            }, true);
+        }
+    }
+
+    void TcpServer::newConnection(EventLoop * event_loop, int client_fd, NetAddr::s_ptr peer_addr) {
+        TcpConnection::s_ptr connection = std::make_shared<TcpConnection>(event_loop, client_fd, g_conn_buffer_size, peer_addr, m_local_addr); 
         connection->setState(Connected);
-        m_client.insert(connection);
+        m_client_counts++;
+        //交给IO线程的连接管理,关闭后删除,空闲超时回收
+        m_connection_managers.find(event_loop)->second->addConnection(connection);
         INFOLOG("TcpServer succ get client, fd = %d", client_fd);
     }
 
+    void TcpServer::pauseAccept(FdEvent * listen_fd_event, EventLoop * event_loop) {
+        //监听套接字是水平触发,fd不够的时候不停下来会一直空转
+        event_loop->delEpollEvent(listen_fd_event);
+        TimerEvent::s_ptr resume = std::make_shared<TimerEvent>(g_accept_pause_ms, false, [listen_fd_event, event_loop]() {
+            INFOLOG("resume accept on listen fd %d", listen_fd_event->getFd());
+            event_loop->addEpollEvent(listen_fd_event);
+        });
+        event_loop->addTimerEvent(resume);
+        ERRORLOG("pause accept on listen fd %d for %d ms", listen_fd_event->getFd(), g_accept_pause_ms);
+    }
+
+    void TcpServer::onAcceptRateTimer() {
+        uint64_t count = m_accept_count.load();
+        m_accept_rate.store(count - m_last_accept_count);
+        m_last_accept_count = count;
+    }
+
+    uint64_t TcpServer::getAcceptCount() {
+        return m_accept_count.load();
+    }
+
+    uint64_t TcpServer::getAcceptRate() {
+        return m_accept_rate.load();
+    }
+
     void TcpServer::start() {
         //开启主线程和IO线程的eventloop
         m_io_thread_group->start();
+        m_is_started = true;
         m_main_event_loop->loop();  //主线程阻塞在这里
     }
 
@@ -1,13 +1,16 @@
 #ifndef ROCKET_NET_TCP_TCP_SERVER_H
 #define ROCKET_NET_TCP_TCP_SERVER_H
 
-#include <set>
+#include <map>
+#include <vector>
+#include <atomic>
 #include "rocket/net/tcp/tcp_acceptor.h"
 #include "rocket/net/tcp/tcp_connection.h"
 #include "rocket/net/tcp/net_addr.h"
 #include "rocket/net/eventloop.h"
 #include "rocket/net/io_thread_group.h"
-#include "rocket/net/tcp/tcp_connection.h"
+#include "rocket/net/tcp/tcp_connection_manager.h"
+#include "rocket/net/rpc/rpc_worker_pool.h"
 
 namespace rocket {
 
@@ -16,20 +19,46 @@ public:
     TcpServer(NetAddr::s_ptr local_addr);   //全局的单例对象，只能再主线程中构建
     ~TcpServer();
     void start();
+    //累计accept的连接数,以及最近一秒的accept数
+    uint64_t getAcceptCount();
+    uint64_t getAcceptRate();
     
 private:
     void init();
     //当有先客户端连接之后需要执行
-    void onAccept();
-    
+    //io_thread为NULL表示在主线程accept,需要选一个IO线程;否则就在这个IO线程里accept,连接也留在这个线程
+    //一次最多accept m_accept_batch个,直到EAGAIN
+    void onAccept(TcpAcceptor::s_ptr acceptor, FdEvent * listen_fd_event, IOThread * io_thread);
+    //在event_loop上创建连接
+    void newConnection(EventLoop * event_loop, int client_fd, NetAddr::s_ptr peer_addr);
+    //fd用完了,暂时不监听这个套接字,过一会再恢复
+    void pauseAccept(FdEvent * listen_fd_event, EventLoop * event_loop);
+    void onAcceptRateTimer();
+    //SO_REUSEPORT模式,每个IO线程一个监听套接字
+    void initReusePortAcceptors();
+    //按配置创建业务线程池,指定的服务/方法交给它执行
+    void initWorkerPool();
+
 private:
     TcpAcceptor::s_ptr m_acceptor;
     NetAddr::s_ptr m_local_addr;    //本地监听地址
     EventLoop * m_main_event_loop {NULL};   //mainReactor,负责连接的建立
     IOThreadGroup * m_io_thread_group {NULL};   //subReactor组
-    FdEvent * m_listen_fd_event;
-    int m_client_counts {0};    //计数器
-    std::set<TcpConnection::s_ptr> m_client;
+    FdEvent * m_listen_fd_event {NULL};
+    bool m_reuse_port {false};
+    bool m_create_in_io_thread {false};     //IO线程绑核时,连接在IO线程里创建
+    bool m_is_started {false};  //IO线程已经启动,析构时需要停掉
+    std::vector<TcpAcceptor::s_ptr> m_reuse_port_acceptors;
+    std::vector<FdEvent *> m_reuse_port_fd_events;
+    std::atomic<int> m_client_counts {0};    //计数器
+    int m_accept_batch {64};
+    std::atomic<uint64_t> m_accept_count {0};
+    std::atomic<uint64_t> m_accept_rate {0};
+    uint64_t m_last_accept_count {0};
+    TimerEvent::s_ptr m_accept_rate_timer;
+    //每个IO线程的连接管理,init之后只读,不需要加锁
+    std::map<EventLoop *, TcpConnectionManager *> m_connection_managers;
+    RpcWorkerPool::s_ptr m_worker_pool;
 };
 
 
@@ -1,5 +1,6 @@
 #include <sys/timerfd.h>
 #include <string.h>
+#include <algorithm>
 #include "rocket/net/timer.h"
 #include "rocket/common/util.h"
 
@@ -12,7 +13,9 @@ namespace rocket {
         listen(FdEvent::IN_EVENT, std::bind(&Timer::onTimer, this));
     }
     Timer::~Timer() {
-        
+        for (auto & i : m_heap) {
+            i->m_heap_index = -1;
+        }
     } 
 
     void Timer::onTimer() { //触发可读事件后，执行的回调函数
@@ -24,27 +27,21 @@ namespace rocket {
                 break;
             }
         }
+        //timerfd是一次性的,已经触发过了
+        m_armed_time = -1;
         //执行定时任务
-        int64_t now = getNowMs();
+        int64_t now = getNowUs();
         std::vector<TimerEvent::s_ptr> tmps;
-        std::vector<std::pair<int64_t, std::function<void()>>> tasks;   //需要执行的任务
-        ScopeMutex<Mutex> lock(m_mutex);
-        auto it = m_pending_events.begin();
-
-        for (it = m_pending_events.begin(); it != m_pending_events.end(); ++it) {
-            if ((*it).first <= now ) {   //该定时任务到期了
-                if (!(*it).second->isCancel()) {
-                    tmps.push_back((*it).second);
-                    tasks.push_back(std::make_pair((*it).second->getArriveTime(), (*it).second->getCallBack()));
-                }
-            } else {
-                break;      //第一个没到期，说明后面的都没到期  
-            }        
+        //到期的都从堆顶取出来,第一个没到期，说明后面的都没到期
+        while (!m_heap.empty() && m_heap[0]->getArriveTime() <= now) {
+            TimerEvent::s_ptr event = m_heap[0];
+            removeAt(0);
+            if (!event->isCancel()) {
+                tmps.push_back(event);
+            }
         }
-        m_pending_events.erase(m_pending_events.begin(), it);   //由于已经缓存了，就清空，防止重复执行
-        lock.unlock();
 
-        //把重复的Event事件再次添加进去
+        //把重复的Event事件再次添加进去,先全部取出来再加,避免间隔为0的任务一直在堆顶
         for (auto i = tmps.begin(); i != tmps.end(); ++i) {
             if ((*i)->isRepeated()) {   //周期性的定时任务
                 //调整arriveTime
@@ -53,82 +50,138 @@ namespace rocket {
             }
         }
         resetArriveTime();
-        for (auto i : tasks) {
-            if (i.second) {
-                i.second();
+        for (auto i : tmps) {
+            //前面的任务可能把后面的取消了
+            if (i->isCancel()) {
+                continue;
+            }
+            std::function<void()> cb = i->getCallBack();
+            if (cb) {
+                cb();
             }
         }
     }
     void Timer::resetArriveTime() {
-        ScopeMutex<Mutex> lock(m_mutex);
-        auto tmp = m_pending_events;
-        lock.unlock();
-
-        if (tmp.size() == 0) {   //map为空，没有定时任务,退出就行了
+        if (m_heap.empty()) {   //没有定时任务,timerfd就算还设着,到期空跑一次也没关系,省掉一次系统调用
             return;
         }
-        int64_t now = getNowMs();
         //取第一个定时任务的时间
-        auto it = tmp.begin();
-        int64_t inteval = 0;
-        if (it->second->getArriveTime() > now) {    //说明第一个定时任务时间还没到
-            inteval = it->second->getArriveTime() - now;
-        } else { //说明定时任务已经过期了
-           inteval = 100;   //100ms后执行定时任务,拯救一下
+        int64_t arrive_time = m_heap[0]->getArriveTime();
+        if (arrive_time == m_armed_time) {  //最早到期时间没变,不用重新设置
+            return;
         }
-
+        //用绝对时间设置timerfd,已经过期的时间点会立刻触发,不需要再单独处理过期的情况
         timespec ts;
         memset(&ts, 0, sizeof(ts));
-        ts.tv_sec = inteval / 1000;
-        ts.tv_nsec = (inteval % 1000) * 1000000;    //获得纳秒
+        ts.tv_sec = arrive_time / 1000000;
+        ts.tv_nsec = (arrive_time % 1000000) * 1000;    //获得纳秒
+        if (ts.tv_sec == 0 && ts.tv_nsec == 0) {
+            ts.tv_nsec = 1;     //全0表示关闭定时器
+        }
 
         itimerspec value;
         memset(&value, 0, sizeof(value));
         value.it_value = ts;
-        int rt = timerfd_settime(m_fd, 0, &value, NULL);
+        int rt = timerfd_settime(m_fd, TFD_TIMER_ABSTIME, &value, NULL);
         if (rt != 0) {
             ERRORLOG("timer fd_settime errno=%d, error=%s\n", errno, strerror(errno));
+            return;
         }
-        DEBUGLOG("timer reset to %lld", now + inteval);
+        m_armed_time = arrive_time;
+        m_arm_count++;
+        DEBUGLOG("timer reset to %lld us", arrive_time);
     }
 
     void Timer::addTimerEvent(TimerEvent::s_ptr event) {
-        bool is_reset_timerfd = false;  //默认不需要重新设置
-        ScopeMutex<Mutex> lock(m_mutex);
-        if (m_pending_events.empty())   //当前事件为空
-        {
-            is_reset_timerfd = true;    //设置fd时间，否则不会触发
-        } else {
-            auto it = m_pending_events.begin();
-            if ((*it).second->getArriveTime() > event->getArriveTime()) {
-                //需要插入的定时任务指定时间比任务队列中所有定时任务指定时间都早,需要重新设置
-                is_reset_timerfd = true;
-            }
+        if (event->m_heap_index >= 0) {
+            //已经在堆里了,相当于重新设置到期时间
+            removeAt(event->m_heap_index);
+        }
+        if (m_slack > 1) {
+            //只会推迟不会提前,最多晚slack
+            event->m_arrive_time = (event->m_arrive_time + m_slack - 1) / m_slack * m_slack;
         }
-        m_pending_events.emplace(event->getArriveTime(), event);
-        lock.unlock();
-        if (is_reset_timerfd) {
+        event->m_seq = m_seq++;
+        event->m_heap_index = (int)m_heap.size();
+        m_heap.push_back(event);
+        siftUp(event->m_heap_index);
+        //插到了堆顶才需要重新设置timerfd
+        if (m_heap[0] == event) {
             resetArriveTime();
         }
     }
     void Timer::deleteTimerEvent(TimerEvent::s_ptr event) {
         event->setCancel(true);    // 确保后面的定时器不会触发
-        ScopeMutex<Mutex> lock(m_mutex);
-        auto begin = m_pending_events.lower_bound(event->getArriveTime());
-        auto end = m_pending_events.upper_bound(event->getArriveTime());
+        int index = event->m_heap_index;
+        if (index < 0 || index >= (int)m_heap.size() || m_heap[index] != event) {
+            return;
+        }
+        removeAt(index);
+        //timerfd不用马上改,堆顶被删了到期会空跑一次,然后按新的堆顶重新设置
+        DEBUGLOG("success delete TimerEvent at time %lld us", event->getArriveTime());
+    }
+
+    void Timer::setSlack(int64_t slack_us) {
+        m_slack = slack_us > 0 ? slack_us : 0;
+    }
 
-        auto it = begin;
-        for (it = begin; it != end; it++) {
-            if (it->second == event) {
+    bool Timer::earlier(int i, int j) {
+        int64_t ti = m_heap[i]->getArriveTime();
+        int64_t tj = m_heap[j]->getArriveTime();
+        if (ti != tj) {
+            return ti < tj;
+        }
+        return m_heap[i]->m_seq < m_heap[j]->m_seq;
+    }
+    void Timer::swapNode(int i, int j) {
+        m_heap[i].swap(m_heap[j]);
+        m_heap[i]->m_heap_index = i;
+        m_heap[j]->m_heap_index = j;
+    }
+    void Timer::siftUp(int i) {
+        while (i > 0) {
+            int parent = (i - 1) / 4;
+            if (!earlier(i, parent)) {
+                break;
+            }
+            swapNode(i, parent);
+            i = parent;
+        }
+    }
+    void Timer::siftDown(int i) {
+        int n = (int)m_heap.size();
+        while (1) {
+            int first = 4 * i + 1;
+            if (first >= n) {
+                break;
+            }
+            //4个孩子里面最早的那个
+            int min = first;
+            int last = std::min(first + 4, n);
+            for (int c = first + 1; c < last; ++c) {
+                if (earlier(c, min)) {
+                    min = c;
+                }
+            }
+            if (!earlier(min, i)) {
                 break;
             }
+            swapNode(i, min);
+            i = min;
+        }
+    }
+    void Timer::removeAt(int i) {
+        int last = (int)m_heap.size() - 1;
+        if (i != last) {
+            swapNode(i, last);
         }
-        if (it != end) {
-            m_pending_events.erase(it);
+        m_heap[last]->m_heap_index = -1;
+        m_heap.pop_back();
+        if (i < last) {
+            //换过来的元素可能需要上移也可能需要下移
+            siftUp(i);
+            siftDown(i);
         }
-        lock.unlock();
-        DEBUGLOG("success delete TimerEvent at time %lld", event->getArriveTime());
     }
 
 }
-
@@ -1,27 +1,52 @@
 #ifndef ROCKET_NET_TIMER_H
 #define ROCKET_NET_TIMER_H
 
-#include <map>
+#include <vector>
 #include "rocket/net/fd_event.h"
 #include "rocket/net/timer_event.h"
 #include "rocket/common/log.h"
 
 namespace rocket {
+/*
+    每个EventLoop一个定时器,只在所属的IO线程里访问,不需要加锁
+    (其他线程要添加定时任务通过EventLoop::addTimerEvent转成addTask)
+    定时任务放在4叉小顶堆里,TimerEvent记录自己在堆中的下标:
+    添加/删除O(log n),取最早到期O(1),setCancel只打标记O(1),出堆时丢弃
+    只有最早到期时间变化时才重新设置timerfd
+*/
 class Timer : public FdEvent {
 public:
     Timer();
-    ~Timer(); 
+    ~Timer();
     void addTimerEvent(TimerEvent::s_ptr event);
     void deleteTimerEvent(TimerEvent::s_ptr event);
     void onTimer(); //当发生了IO事件后，eventloop会执行这个回调函数,绑定到read call_back上面就可以
+    int size() {
+        return (int)m_heap.size();
+    }
+    //到期时间向上取整到slack_us的整数倍,同一个区间内的定时任务共用一次timerfd设置,0表示不合并
+    void setSlack(int64_t slack_us);
+    //timerfd_settime调用次数
+    uint64_t getArmCount() {
+        return m_arm_count;
+    }
 private:
     void resetArriveTime();
+    //堆操作
+    bool earlier(int i, int j);
+    void swapNode(int i, int j);
+    void siftUp(int i);
+    void siftDown(int i);
+    void removeAt(int i);
 private:
-    std::multimap<int64_t, TimerEvent::s_ptr> m_pending_events; //到达事件和定时时间的map
-    Mutex m_mutex;  //可以替换成读写锁，性能更好
+    std::vector<TimerEvent::s_ptr> m_heap;  //4叉堆,堆顶是最早到期的定时任务
+    uint64_t m_seq {0};
+    int64_t m_armed_time {-1};   //timerfd当前设置的到期时间,-1表示没有设置
+    int64_t m_slack {0};    //us
+    uint64_t m_arm_count {0};
 };
 
 }
 
 
-#endif
\ No newline at end of file
+#endif
@@ -4,14 +4,14 @@
 
 
 namespace rocket {
-TimerEvent::TimerEvent(int interval, bool is_repeated, std::function<void()> cb)
-    :m_interval(interval), m_is_repeated(is_repeated), m_task(cb) {
+TimerEvent::TimerEvent(int64_t interval, bool is_repeated, std::function<void()> cb, bool is_interval_us /*= false*/)
+    :m_interval(is_interval_us ? interval : interval * 1000), m_is_repeated(is_repeated), m_task(cb) {
     resetArriveTime();
 }
 
 void TimerEvent::resetArriveTime() {
-    m_arrive_time = getNowMs() + m_interval;
-    DEBUGLOG("success create timer event, will excute at [%lld]", m_arrive_time);
+    m_arrive_time = getNowUs() + m_interval;
+    DEBUGLOG("success create timer event, will excute at [%lld us]", m_arrive_time);
 }
 
 
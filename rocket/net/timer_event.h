@@ -5,10 +5,12 @@
 #include <functional>
 
 namespace rocket {
+class Timer;
 class TimerEvent {
 public:
     typedef std::shared_ptr<TimerEvent> s_ptr;
-    TimerEvent(int interval, bool is_repeated, std::function<void()> cb);
+    //interval默认是毫秒,is_interval_us为true时是微秒
+    TimerEvent(int64_t interval, bool is_repeated, std::function<void()> cb, bool is_interval_us = false);
     int64_t getArriveTime() {
         return m_arrive_time;
     }
@@ -26,12 +28,19 @@ public:
     }
 
     void resetArriveTime();
+    //是否还挂在定时器的堆里面
+    bool isPending() {
+        return m_heap_index >= 0;
+    }
 private:
-    int64_t m_arrive_time;  //ms
-    int64_t m_interval; //ms 
+    friend class Timer;     //堆下标和序号只由Timer维护
+    int64_t m_arrive_time;  //us,单调时钟
+    int64_t m_interval; //us
     bool m_is_repeated {false};
     bool m_is_calceled {false};
     std::function<void()> m_task;
+    int m_heap_index {-1};  //在Timer堆中的下标,-1表示不在堆里,删除时直接按下标定位
+    uint64_t m_seq {0};     //加入堆的序号,到期时间相同时先加入的先执行
 };
 }
 
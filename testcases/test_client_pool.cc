@@ -0,0 +1,313 @@
+#include <pthread.h>
+#include <semaphore.h>
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <functional>
+#include <memory>
+#include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/net/eventloop.h"
+#include "rocket/net/io_thread.h"
+#include "rocket/net/tcp/net_addr.h"
+#include "rocket/net/tcp/tcp_client.h"
+#include "rocket/net/tcp/tcp_client_pool.h"
+
+static const int TEST_PORT = 12360;
+
+static rocket::EventLoop * g_loop = NULL;
+static sem_t g_step_done;
+static rocket::NetAddr::s_ptr g_addr;
+
+//连接池只能在所属的线程里用,每一步都放到loop线程执行,fn调用done表示这一步结束
+void runInLoop(std::function<void(std::function<void()>)> fn)
+{
+    g_loop->addTask([fn]() {
+        fn([]() {
+            sem_post(&g_step_done);
+        });
+    }, true);
+    sem_wait(&g_step_done);
+}
+
+rocket::TcpClientPool * pool()
+{
+    return rocket::TcpClientPool::GetTcpClientPool();
+}
+
+//对端只listen不accept,内核完成三次握手,连接就能建立;需要对端关闭时再accept出来close
+int startListen(int port)
+{
+    int listenfd = socket(AF_INET, SOCK_STREAM, 0);
+    int opt = 1;
+    setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_port = htons(port);
+    addr.sin_family = AF_INET;
+    inet_aton("127.0.0.1", &addr.sin_addr);
+    int rt = bind(listenfd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+    assert(rt == 0);
+    rt = listen(listenfd, 64);
+    assert(rt == 0);
+    return listenfd;
+}
+
+//每个测试一个新的IO线程,连接池按当时的配置创建
+rocket::IOThread * startIOThread(int max_per_peer, int max_idle, int idle_timeout, int max_inflight)
+{
+    rocket::Config * config = rocket::Config::GetGlobalConfig();
+    config->m_client_pool_max_per_peer = max_per_peer;
+    config->m_client_pool_max_idle = max_idle;
+    config->m_client_pool_idle_timeout = idle_timeout;
+    config->m_client_max_inflight = max_inflight;
+    rocket::IOThread * io_thread = new rocket::IOThread();
+    g_loop = io_thread->getEventLoop();
+    io_thread->start();
+    return io_thread;
+}
+
+struct TestState {
+    rocket::TcpClient::s_ptr m_c1;
+    rocket::TcpClient::s_ptr m_c2;
+    rocket::TcpClient::s_ptr m_c3;
+    rocket::TcpClient::s_ptr m_waiter_got;  //排队的请求拿到的连接
+};
+
+//连接要在loop线程里析构,并且要在IO线程退出之前
+void stopIOThread(rocket::IOThread * io_thread, std::shared_ptr<TestState> state)
+{
+    runInLoop([state](std::function<void()> done) {
+        state->m_c1.reset();
+        state->m_c2.reset();
+        state->m_c3.reset();
+        state->m_waiter_got.reset();
+        done();
+    });
+    //连接池关掉的连接放到下一轮loop析构,再跑一轮
+    runInLoop([](std::function<void()> done) {
+        done();
+    });
+    delete io_thread;
+}
+
+//空闲连接复用;连接满了排队,归还时直接给排队的请求;对端关掉的连接不会再分出去;超时的连接不再复用
+void test_client_pool_reuse_and_wait(int listenfd)
+{
+    rocket::IOThread * io_thread = startIOThread(2, 8, 30000, 1);
+    std::shared_ptr<TestState> state = std::make_shared<TestState>();
+
+    runInLoop([state](std::function<void()> done) {
+        pool()->acquire(g_addr, [state](rocket::TcpClient::s_ptr client) {
+            state->m_c1 = client;
+        });
+        assert(state->m_c1 && !state->m_c1->isConnected());
+        assert(pool()->getConnectionCount(g_addr) == 1 && pool()->getInflightCount(g_addr) == 1);
+        state->m_c1->connect(done);
+    });
+
+    runInLoop([state](std::function<void()> done) {
+        assert(state->m_c1->isConnected());
+        pool()->release(state->m_c1, true);
+        assert(pool()->getConnectionCount(g_addr) == 1 && pool()->getInflightCount(g_addr) == 0);
+        //空闲的连接直接复用
+        rocket::TcpClient::s_ptr got;
+        pool()->acquire(g_addr, [&got](rocket::TcpClient::s_ptr client) {
+            got = client;
+        });
+        assert(got == state->m_c1);
+        pool()->acquire(g_addr, [state](rocket::TcpClient::s_ptr client) {
+            state->m_c2 = client;
+        });
+        assert(state->m_c2 && state->m_c2 != state->m_c1);
+        assert(pool()->getConnectionCount(g_addr) == 2);
+        state->m_c2->connect(done);
+    });
+
+    runInLoop([state](std::function<void()> done) {
+        //连接数到上限,排队
+        pool()->acquire(g_addr, [state](rocket::TcpClient::s_ptr client) {
+            state->m_waiter_got = client;
+        });
+        assert(!state->m_waiter_got);
+        pool()->release(state->m_c2, true);
+        assert(state->m_waiter_got == state->m_c2);
+        assert(pool()->getInflightCount(g_addr) == 2);
+        state->m_waiter_got.reset();
+        done();
+    });
+
+    //对端把两个连接都关掉
+    for (int i = 0; i < 2; ++i)
+    {
+        int fd = accept(listenfd, NULL, NULL);
+        assert(fd >= 0);
+        close(fd);
+    }
+    usleep(50 * 1000);
+
+    runInLoop([state](std::function<void()> done) {
+        pool()->acquire(g_addr, [state](rocket::TcpClient::s_ptr client) {
+            state->m_waiter_got = client;
+        });
+        assert(!state->m_waiter_got);
+        //对端已经关闭的连接不能交给排队的请求,换一个新连接
+        pool()->release(state->m_c2, true);
+        assert(state->m_waiter_got && state->m_waiter_got != state->m_c2);
+        assert(pool()->getConnectionCount(g_addr) == 2 && pool()->getInflightCount(g_addr) == 2);
+        state->m_c3 = state->m_waiter_got;
+
+        //请求超时,连接不再复用
+        pool()->release(state->m_c1, false);
+        assert(pool()->getConnectionCount(g_addr) == 1 && pool()->getInflightCount(g_addr) == 1);
+        //没有连上的连接也不复用
+        pool()->release(state->m_c3, true);
+        assert(pool()->getConnectionCount(g_addr) == 0);
+        done();
+    });
+
+    stopIOThread(io_thread, state);
+    printf("test_client_pool_reuse_and_wait ok\n");
+}
+
+//多路复用:一个连接上同时有多个请求;超时的请求让连接不再分给新请求,其他请求归还时关掉
+void test_client_pool_multiplex()
+{
+    rocket::IOThread * io_thread = startIOThread(1, 8, 30000, 2);
+    std::shared_ptr<TestState> state = std::make_shared<TestState>();
+
+    runInLoop([state](std::function<void()> done) {
+        pool()->acquire(g_addr, [state](rocket::TcpClient::s_ptr client) {
+            state->m_c1 = client;
+        });
+        pool()->acquire(g_addr, [state](rocket::TcpClient::s_ptr client) {
+            state->m_c2 = client;
+        });
+        assert(state->m_c1 && state->m_c1 == state->m_c2);
+        assert(pool()->getConnectionCount(g_addr) == 1 && pool()->getInflightCount(g_addr) == 2);
+        pool()->acquire(g_addr, [state](rocket::TcpClient::s_ptr client) {
+            state->m_waiter_got = client;
+        });
+        assert(!state->m_waiter_got);
+        state->m_c1->connect(done);
+    });
+
+    runInLoop([state](std::function<void()> done) {
+        pool()->release(state->m_c1, false);
+        assert(state->m_waiter_got && state->m_waiter_got != state->m_c1);
+        assert(pool()->getConnectionCount(g_addr) == 1 && pool()->getInflightCount(g_addr) == 1);
+        //已经摘掉的连接上剩下的请求完成
+        pool()->release(state->m_c2, true);
+        assert(pool()->getConnectionCount(g_addr) == 1 && pool()->getInflightCount(g_addr) == 1);
+        pool()->release(state->m_waiter_got, false);
+        assert(pool()->getConnectionCount(g_addr) == 0);
+        done();
+    });
+
+    stopIOThread(io_thread, state);
+    printf("test_client_pool_multiplex ok\n");
+}
+
+//空闲连接超过上限直接关掉,空闲太久的下次借的时候关掉
+void test_client_pool_idle()
+{
+    rocket::IOThread * io_thread = startIOThread(0, 1, 50, 1);
+    std::shared_ptr<TestState> state = std::make_shared<TestState>();
+
+    runInLoop([state](std::function<void()> done) {
+        pool()->acquire(g_addr, [state](rocket::TcpClient::s_ptr client) {
+            state->m_c1 = client;
+        });
+        pool()->acquire(g_addr, [state](rocket::TcpClient::s_ptr client) {
+            state->m_c2 = client;
+        });
+        assert(state->m_c1 != state->m_c2);
+        state->m_c1->connect([state, done]() {
+            state->m_c2->connect(done);
+        });
+    });
+
+    runInLoop([state](std::function<void()> done) {
+        pool()->release(state->m_c1, true);
+        pool()->release(state->m_c2, true);
+        assert(pool()->getConnectionCount(g_addr) == 1 && pool()->getInflightCount(g_addr) == 0);
+        done();
+    });
+
+    usleep(100 * 1000);
+
+    runInLoop([state](std::function<void()> done) {
+        pool()->acquire(g_addr, [state](rocket::TcpClient::s_ptr client) {
+            state->m_c3 = client;
+        });
+        assert(state->m_c3 != state->m_c1 && state->m_c3 != state->m_c2);
+        assert(pool()->getConnectionCount(g_addr) == 1 && pool()->getInflightCount(g_addr) == 1);
+        pool()->release(state->m_c3, false);
+        done();
+    });
+
+    stopIOThread(io_thread, state);
+    printf("test_client_pool_idle ok\n");
+}
+
+//没有新的借还,定时器也会把所有对端空闲超时的连接关掉
+void test_client_pool_reap_timer()
+{
+    rocket::IOThread * io_thread = startIOThread(0, 8, 50, 1);
+    std::shared_ptr<TestState> state = std::make_shared<TestState>();
+    int other_listenfd = startListen(TEST_PORT + 1);
+    rocket::NetAddr::s_ptr other = std::make_shared<rocket::IPNetAddr>("127.0.0.1", TEST_PORT + 1);
+
+    runInLoop([state, other](std::function<void()> done) {
+        pool()->acquire(g_addr, [state](rocket::TcpClient::s_ptr client) {
+            state->m_c1 = client;
+        });
+        pool()->acquire(other, [state](rocket::TcpClient::s_ptr client) {
+            state->m_c2 = client;
+        });
+        state->m_c1->connect([state, done]() {
+            state->m_c2->connect(done);
+        });
+    });
+
+    runInLoop([state, other](std::function<void()> done) {
+        pool()->release(state->m_c1, true);
+        pool()->release(state->m_c2, true);
+        assert(pool()->getConnectionCount(g_addr) == 1 && pool()->getConnectionCount(other) == 1);
+        done();
+    });
+
+    usleep(200 * 1000);
+
+    runInLoop([other](std::function<void()> done) {
+        assert(pool()->getConnectionCount(g_addr) == 0 && pool()->getConnectionCount(other) == 0);
+        done();
+    });
+
+    stopIOThread(io_thread, state);
+    close(other_listenfd);
+    printf("test_client_pool_reap_timer ok\n");
+}
+
+int main()
+{
+    rocket::Config::SetGlobalConfig("conf/rocket.xml");
+    rocket::Logger::InitGlobalLogger();
+
+    sem_init(&g_step_done, 0, 0);
+    g_addr = std::make_shared<rocket::IPNetAddr>("127.0.0.1", TEST_PORT);
+    int listenfd = startListen(TEST_PORT);
+
+    test_client_pool_reuse_and_wait(listenfd);
+    test_client_pool_multiplex();
+    test_client_pool_idle();
+    test_client_pool_reap_timer();
+
+    close(listenfd);
+    sem_destroy(&g_step_done);
+    return 0;
+}
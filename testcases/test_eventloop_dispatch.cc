@@ -0,0 +1,348 @@
+#include <pthread.h>
+#include <semaphore.h>
+#include <assert.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <functional>
+#include <vector>
+#include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/net/io_thread.h"
+#include "rocket/net/fd_event.h"
+
+static sem_t g_step_done;
+
+static int64_t nowMs()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+//等flag变成true,最多等timeout_ms
+static bool waitFlag(volatile bool & flag, int timeout_ms)
+{
+    int64_t deadline = nowMs() + timeout_ms;
+    while (!flag && nowMs() < deadline)
+    {
+        usleep(1000);
+    }
+    return flag;
+}
+
+//loop里的状态只在loop线程里读写,每一步都放到loop线程执行
+void runInLoop(rocket::EventLoop * loop, std::function<void()> fn)
+{
+    loop->addTask([fn]() {
+        fn();
+        sem_post(&g_step_done);
+    }, true);
+    sem_wait(&g_step_done);
+}
+
+//单次epoll_wait的事件数调小之后,一次就绪的fd比数组多,剩下的下一轮继续处理,不会丢
+void test_small_batch()
+{
+    rocket::IOThread io_thread;
+    rocket::EventLoop * loop = io_thread.getEventLoop();
+    loop->setEpollMaxEvents(2);
+    //非法值不生效
+    loop->setEpollMaxEvents(0);
+    io_thread.start();
+
+    const int count = 8;
+    int pipes[count][2];
+    std::vector<rocket::FdEvent *> events;
+    std::vector<int> fired(count, 0);
+    for (int i = 0; i < count; ++i)
+    {
+        int rt = pipe(pipes[i]);
+        assert(rt == 0);
+        rocket::FdEvent * event = new rocket::FdEvent(pipes[i][0]);
+        int fd = pipes[i][0];
+        int * counter = &fired[i];
+        event->listen(rocket::FdEvent::IN_EVENT, [fd, counter]() {
+            char c;
+            assert(read(fd, &c, 1) == 1);
+            (*counter)++;
+        });
+        events.push_back(event);
+    }
+    runInLoop(loop, [&]() {
+        for (size_t i = 0; i < events.size(); ++i)
+        {
+            loop->addEpollEvent(events[i]);
+        }
+    });
+
+    //在loop线程里同时把所有fd变成可读,下一次epoll_wait会一起就绪
+    uint64_t full_count = 0;
+    runInLoop(loop, [&]() {
+        for (int i = 0; i < count; ++i)
+        {
+            assert(write(pipes[i][1], "x", 1) == 1);
+        }
+    });
+    for (int retry = 0; retry < 100; ++retry)
+    {
+        int total = 0;
+        runInLoop(loop, [&]() {
+            for (int i = 0; i < count; ++i)
+            {
+                total += fired[i];
+            }
+            full_count = loop->getEpollFullCount();
+        });
+        if (total == count)
+        {
+            break;
+        }
+        usleep(10000);
+    }
+    runInLoop(loop, [&]() {
+        for (int i = 0; i < count; ++i)
+        {
+            assert(fired[i] == 1);
+            loop->delEpollEvent(events[i]);
+        }
+    });
+    assert(full_count > 0);
+
+    for (int i = 0; i < count; ++i)
+    {
+        delete events[i];
+        close(pipes[i][0]);
+        close(pipes[i][1]);
+    }
+    printf("test_small_batch ok\n");
+}
+
+//epoll_wait的超时时间按loop单独设置,没有事件的时候也会按这个间隔醒来
+void test_timeout()
+{
+    rocket::IOThread io_thread;
+    rocket::EventLoop * loop = io_thread.getEventLoop();
+    loop->setEpollMaxTimeout(20);
+    io_thread.start();
+
+    uint64_t begin = 0;
+    runInLoop(loop, [&]() {
+        begin = loop->getEpollWaitCount();
+    });
+    usleep(300 * 1000);
+    uint64_t end = 0;
+    runInLoop(loop, [&]() {
+        end = loop->getEpollWaitCount();
+    });
+    assert(end - begin >= 5);
+    //计数器是原子的,其他线程可以直接读
+    uint64_t before = loop->getEpollWaitCount();
+    usleep(100 * 1000);
+    assert(loop->getEpollWaitCount() > before);
+    printf("test_timeout ok\n");
+}
+
+//就绪事件的回调在epoll_wait返回后直接执行,不用等下一次epoll_wait超时;
+//回调里加入的任务也不会等满超时时间
+void test_inline_callback()
+{
+    rocket::IOThread io_thread;
+    rocket::EventLoop * loop = io_thread.getEventLoop();
+    loop->setEpollMaxTimeout(5000);
+    io_thread.start();
+
+    int fds[2];
+    int rt = pipe(fds);
+    assert(rt == 0);
+    volatile bool read_done = false;
+    volatile bool task_done = false;
+    rocket::FdEvent event(fds[0]);
+    event.listen(rocket::FdEvent::IN_EVENT, [&]() {
+        char c;
+        assert(read(fds[0], &c, 1) == 1);
+        read_done = true;
+        //不唤醒,靠loop检查任务队列
+        loop->addTask([&]() {
+            task_done = true;
+        });
+    });
+    runInLoop(loop, [&]() {
+        loop->addEpollEvent(&event);
+    });
+
+    int64_t begin = nowMs();
+    assert(write(fds[1], "x", 1) == 1);
+    assert(waitFlag(read_done, 1000));
+    assert(waitFlag(task_done, 1000));
+    assert(nowMs() - begin < 1000);
+
+    runInLoop(loop, [&]() {
+        loop->delEpollEvent(&event);
+    });
+    close(fds[0]);
+    close(fds[1]);
+    printf("test_inline_callback ok\n");
+}
+
+//EPOLLERR执行的是错误回调
+void test_error_callback()
+{
+    rocket::IOThread io_thread;
+    rocket::EventLoop * loop = io_thread.getEventLoop();
+    loop->setEpollMaxTimeout(5000);
+    io_thread.start();
+
+    int fds[2];
+    int rt = pipe(fds);
+    assert(rt == 0);
+    //读端关闭之后,写端会报EPOLLERR
+    close(fds[0]);
+    volatile bool error_done = false;
+    rocket::FdEvent event(fds[1]);
+    event.listen(rocket::FdEvent::OUT_EVENT, []() {}, [&]() {
+        error_done = true;
+    });
+    runInLoop(loop, [&]() {
+        loop->addEpollEvent(&event);
+    });
+    assert(waitFlag(error_done, 1000));
+    runInLoop(loop, [&]() {
+        loop->delEpollEvent(&event);
+    });
+    close(fds[1]);
+    printf("test_error_callback ok\n");
+}
+
+//同一批就绪事件里,前面的回调把后面的fd删掉并reset了,后面那个事件直接跳过,不会执行到新主人的回调
+void test_stale_event()
+{
+    rocket::IOThread io_thread;
+    rocket::EventLoop * loop = io_thread.getEventLoop();
+    io_thread.start();
+
+    int pipes[2][2];
+    rocket::FdEvent * events[2];
+    int fired = 0;
+    for (int i = 0; i < 2; ++i)
+    {
+        int rt = pipe(pipes[i]);
+        assert(rt == 0);
+        events[i] = new rocket::FdEvent(pipes[i][0]);
+    }
+    for (int i = 0; i < 2; ++i)
+    {
+        rocket::FdEvent * other = events[1 - i];
+        int fd = pipes[i][0];
+        events[i]->listen(rocket::FdEvent::IN_EVENT, [loop, fd, other, &fired]() {
+            char c;
+            assert(read(fd, &c, 1) == 1);
+            fired++;
+            loop->delEpollEvent(other);
+            other->reset();
+            //槽位马上被新连接拿去用,这一批里旧fd的结果不能执行到新回调
+            other->listen(rocket::FdEvent::IN_EVENT, [&fired]() {
+                fired += 100;
+            });
+        });
+    }
+    runInLoop(loop, [&]() {
+        loop->addEpollEvent(events[0]);
+        loop->addEpollEvent(events[1]);
+        assert(write(pipes[0][1], "x", 1) == 1);
+        assert(write(pipes[1][1], "x", 1) == 1);
+    });
+    usleep(100 * 1000);
+    int count = 0;
+    runInLoop(loop, [&]() {
+        count = fired;
+        for (int i = 0; i < 2; ++i)
+        {
+            loop->delEpollEvent(events[i]);
+        }
+    });
+    assert(count == 1);
+    for (int i = 0; i < 2; ++i)
+    {
+        delete events[i];
+        close(pipes[i][0]);
+        close(pipes[i][1]);
+    }
+    printf("test_stale_event ok\n");
+}
+
+//同一个fd同时就绪多个事件,前面的回调关闭了fd,后面的写/错误回调不再执行
+void test_stale_handler()
+{
+    rocket::IOThread io_thread;
+    rocket::EventLoop * loop = io_thread.getEventLoop();
+    io_thread.start();
+
+    //socketpair有数据可读同时也可写
+    int fds[2];
+    int rt = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    assert(rt == 0);
+    int stale = 0;
+    int closed = 0;
+    rocket::FdEvent rw_event(fds[0]);
+    rw_event.listen(rocket::FdEvent::IN_EVENT, [&]() {
+        closed++;
+        loop->delEpollEvent(&rw_event);
+        rw_event.reset();
+        //fd号交给了新连接
+        rw_event.listen(rocket::FdEvent::OUT_EVENT, [&stale]() {
+            stale++;
+        });
+    });
+    rw_event.listen(rocket::FdEvent::OUT_EVENT, []() {});
+
+    //读端关闭的管道写端,可写的同时报EPOLLERR
+    int pipe_fds[2];
+    rt = pipe(pipe_fds);
+    assert(rt == 0);
+    close(pipe_fds[0]);
+    rocket::FdEvent err_event(pipe_fds[1]);
+    err_event.listen(rocket::FdEvent::OUT_EVENT, [&]() {
+        closed++;
+        loop->delEpollEvent(&err_event);
+        err_event.reset();
+        err_event.listen(rocket::FdEvent::OUT_EVENT, []() {}, [&stale]() {
+            stale++;
+        });
+    }, []() {});
+
+    runInLoop(loop, [&]() {
+        assert(write(fds[1], "x", 1) == 1);
+        loop->addEpollEvent(&rw_event);
+        loop->addEpollEvent(&err_event);
+    });
+    usleep(100 * 1000);
+    int stale_count = 0;
+    int closed_count = 0;
+    runInLoop(loop, [&]() {
+        stale_count = stale;
+        closed_count = closed;
+    });
+    assert(closed_count == 2);
+    assert(stale_count == 0);
+    close(fds[0]);
+    close(fds[1]);
+    close(pipe_fds[1]);
+    printf("test_stale_handler ok\n");
+}
+
+int main()
+{
+    rocket::Config::SetGlobalConfig("conf/rocket.xml");
+    rocket::Logger::InitGlobalLogger();
+
+    sem_init(&g_step_done, 0, 0);
+    test_small_batch();
+    test_timeout();
+    test_inline_callback();
+    test_error_callback();
+    test_stale_event();
+    test_stale_handler();
+    return 0;
+}
@@ -0,0 +1,230 @@
+#include <pthread.h>
+#include <semaphore.h>
+#include <assert.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <functional>
+#include <vector>
+#include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/net/io_thread.h"
+#include "rocket/net/fd_event_group.h"
+#include "rocket/net/tcp/net_addr.h"
+#include "rocket/net/tcp/tcp_connection.h"
+
+static sem_t g_step_done;
+
+void runInLoop(rocket::EventLoop * loop, std::function<void()> fn)
+{
+    loop->addTask([fn]() {
+        fn();
+        sem_post(&g_step_done);
+    }, true);
+    sem_wait(&g_step_done);
+}
+
+static rocket::FdEventGroup * group()
+{
+    return rocket::FdEventGroup::GetFdEventGroup();
+}
+
+//同一个fd总是拿到同一个FdEvent,超出范围的fd返回NULL
+void test_lookup()
+{
+    rocket::FdEvent * event = group()->getFdEvent(5);
+    assert(event != NULL && event->getFd() == 5);
+    assert(group()->getFdEvent(5) == event);
+    //还没分配的页第一次访问时分配
+    rocket::FdEvent * far = group()->getFdEvent(70000);
+    assert(far != NULL && far->getFd() == 70000);
+    assert(group()->getFdEvent(70000) == far);
+    assert(group()->getFdEvent(-1) == NULL);
+    assert(group()->getFdEvent(rocket::FdEventGroup::g_fd_max_pages * rocket::FdEventGroup::g_fd_page_size) == NULL);
+    printf("test_lookup ok\n");
+}
+
+static const int THREAD_COUNT = 8;
+static const int FD_BASE = 200000;
+static const int FD_COUNT = 8 * rocket::FdEventGroup::g_fd_page_size;
+static std::vector<rocket::FdEvent *> g_results[THREAD_COUNT];
+static pthread_barrier_t g_barrier;
+
+void * lookup(void * arg)
+{
+    int id = (int)(long)arg;
+    pthread_barrier_wait(&g_barrier);
+    for (int i = 0; i < FD_COUNT; ++i)
+    {
+        g_results[id].push_back(group()->getFdEvent(FD_BASE + i));
+    }
+    return NULL;
+}
+
+//多个线程同时访问还没分配的页,大家拿到的是同一个FdEvent
+void test_concurrent_lookup()
+{
+    pthread_barrier_init(&g_barrier, NULL, THREAD_COUNT);
+    std::vector<pthread_t> threads(THREAD_COUNT);
+    for (int i = 0; i < THREAD_COUNT; ++i)
+    {
+        pthread_create(&threads[i], NULL, &lookup, (void *)(long)i);
+    }
+    for (int i = 0; i < THREAD_COUNT; ++i)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    for (int i = 0; i < FD_COUNT; ++i)
+    {
+        assert(g_results[0][i] != NULL && g_results[0][i]->getFd() == FD_BASE + i);
+        for (int t = 1; t < THREAD_COUNT; ++t)
+        {
+            assert(g_results[t][i] == g_results[0][i]);
+        }
+    }
+    pthread_barrier_destroy(&g_barrier);
+    printf("test_concurrent_lookup ok\n");
+}
+
+//释放之后槽位被清空,同一个fd号复用时拿到的是干净的FdEvent
+void test_release()
+{
+    rocket::FdEvent * event = group()->getFdEvent(100);
+    event->listen(rocket::FdEvent::IN_EVENT, []() {});
+    event->listen(rocket::FdEvent::OUT_EVENT, []() {});
+    assert(event->handler(rocket::FdEvent::IN_EVENT) != nullptr);
+    assert(event->getEpollEvent().events != 0);
+    uint32_t generation = event->getGeneration();
+    group()->releaseFdEvent(100);
+    assert(event->getGeneration() == generation + 1);
+    assert(group()->getFdEvent(100) == event);
+    assert(event->handler(rocket::FdEvent::IN_EVENT) == nullptr);
+    assert(event->handler(rocket::FdEvent::OUT_EVENT) == nullptr);
+    assert(event->getEpollEvent().events == 0);
+    printf("test_release ok\n");
+}
+
+//服务端连接clear之后fd被关掉,对端读到EOF
+void test_connection_close_fd()
+{
+    rocket::IOThread io_thread;
+    io_thread.start();
+    rocket::EventLoop * loop = io_thread.getEventLoop();
+    int fds[2];
+    int rt = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    assert(rt == 0);
+    rocket::NetAddr::s_ptr addr = std::make_shared<rocket::IPNetAddr>("127.0.0.1", 12345);
+    rocket::TcpConnection::s_ptr connection;
+    runInLoop(loop, [&]() {
+        connection = std::make_shared<rocket::TcpConnection>(loop, fds[0], 128, addr, addr);
+        connection->setState(rocket::Connected);
+    });
+    runInLoop(loop, [&]() {
+        connection->clear();
+    });
+    assert(fcntl(fds[0], F_GETFD) == -1);
+    char c;
+    assert(read(fds[1], &c, 1) == 0);
+    runInLoop(loop, [&]() {
+        connection.reset();
+    });
+    close(fds[1]);
+    printf("test_connection_close_fd ok\n");
+}
+
+//fd关闭时没有从epoll里删掉,fd号被复用后重新注册也能收到事件
+void test_reused_fd_number()
+{
+    rocket::IOThread io_thread;
+    io_thread.start();
+    rocket::EventLoop * loop = io_thread.getEventLoop();
+
+    int first[2];
+    int rt = pipe(first);
+    assert(rt == 0);
+    rocket::FdEvent * event = group()->getFdEvent(first[0]);
+    event->listen(rocket::FdEvent::IN_EVENT, []() {});
+    runInLoop(loop, [&]() {
+        loop->addEpollEvent(event);
+    });
+    int old_fd = first[0];
+    group()->releaseFdEvent(old_fd);
+    close(first[0]);
+    close(first[1]);
+
+    int second[2];
+    rt = pipe(second);
+    assert(rt == 0);
+    assert(second[0] == old_fd);
+    volatile bool fired = false;
+    event = group()->getFdEvent(second[0]);
+    event->listen(rocket::FdEvent::IN_EVENT, [&fired, &second]() {
+        char c;
+        assert(read(second[0], &c, 1) == 1);
+        fired = true;
+    });
+    runInLoop(loop, [&]() {
+        loop->addEpollEvent(event);
+    });
+    assert(write(second[1], "x", 1) == 1);
+    for (int i = 0; i < 100 && !fired; ++i)
+    {
+        usleep(10000);
+    }
+    assert(fired);
+    runInLoop(loop, [&]() {
+        loop->delEpollEvent(event);
+    });
+    group()->releaseFdEvent(second[0]);
+    close(second[0]);
+    close(second[1]);
+    printf("test_reused_fd_number ok\n");
+}
+
+//槽位被reset之后归新连接所有,旧连接再注册读写事件不能改到新连接的回调
+void test_stale_connection()
+{
+    rocket::IOThread io_thread;
+    io_thread.start();
+    rocket::EventLoop * loop = io_thread.getEventLoop();
+    int fds[2];
+    int rt = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    assert(rt == 0);
+    rocket::NetAddr::s_ptr addr = std::make_shared<rocket::IPNetAddr>("127.0.0.1", 12345);
+    rocket::TcpConnection::s_ptr connection;
+    rocket::FdEvent * event = group()->getFdEvent(fds[0]);
+    runInLoop(loop, [&]() {
+        connection = std::make_shared<rocket::TcpConnection>(loop, fds[0], 128, addr, addr);
+        connection->setState(rocket::Connected);
+        //模拟fd号已经交给了新连接
+        group()->releaseFdEvent(fds[0]);
+        event->listen(rocket::FdEvent::IN_EVENT, []() {});
+        connection->listenWrite();
+        connection->listenRead();
+    });
+    assert(event->handler(rocket::FdEvent::OUT_EVENT) == nullptr);
+    assert(event->getEpollEvent().events == EPOLLIN);
+    runInLoop(loop, [&]() {
+        group()->releaseFdEvent(fds[0]);
+        connection.reset();
+    });
+    close(fds[0]);
+    close(fds[1]);
+    printf("test_stale_connection ok\n");
+}
+
+int main()
+{
+    rocket::Config::SetGlobalConfig("conf/rocket.xml");
+    rocket::Logger::InitGlobalLogger();
+
+    sem_init(&g_step_done, 0, 0);
+    test_lookup();
+    test_concurrent_lookup();
+    test_release();
+    test_connection_close_fd();
+    test_reused_fd_number();
+    test_stale_connection();
+    return 0;
+}
@@ -0,0 +1,277 @@
+#include <pthread.h>
+#include <semaphore.h>
+#include <assert.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <functional>
+#include <vector>
+#include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/common/util.h"
+#include "rocket/net/io_thread.h"
+#include "rocket/net/io_thread_group.h"
+#include "rocket/net/tcp/net_addr.h"
+#include "rocket/net/tcp/tcp_connection.h"
+
+static sem_t g_step_done;
+
+void runInLoop(rocket::EventLoop * loop, std::function<void()> fn)
+{
+    loop->addTask([fn]() {
+        fn();
+        sem_post(&g_step_done);
+    }, true);
+    sem_wait(&g_step_done);
+}
+
+int indexOf(rocket::IOThreadGroup & group, rocket::IOThread * io_thread)
+{
+    for (int i = 0; i < group.size(); ++i)
+    {
+        if (group.getIOThread(i) == io_thread)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void setConnections(rocket::IOThreadGroup & group, const std::vector<int> & counts)
+{
+    for (int i = 0; i < group.size(); ++i)
+    {
+        rocket::EventLoop * loop = group.getIOThread(i)->getEventLoop();
+        while (loop->getConnectionCount() < counts[i])
+        {
+            loop->incConnectionCount();
+        }
+        while (loop->getConnectionCount() > counts[i])
+        {
+            loop->decConnectionCount();
+        }
+    }
+}
+
+void test_parse_placement()
+{
+    assert(rocket::IOThreadGroup::ParsePlacement("round_robin") == rocket::PlacementRoundRobin);
+    assert(rocket::IOThreadGroup::ParsePlacement("least_conn") == rocket::PlacementLeastConnections);
+    assert(rocket::IOThreadGroup::ParsePlacement("least_busy") == rocket::PlacementLeastBusy);
+    assert(rocket::IOThreadGroup::ParsePlacement("p2c") == rocket::PlacementPowerOfTwo);
+    assert(rocket::IOThreadGroup::ParsePlacement("") == rocket::PlacementRoundRobin);
+    assert(rocket::IOThreadGroup::ParsePlacement("unknown") == rocket::PlacementRoundRobin);
+    printf("test_parse_placement ok\n");
+}
+
+void test_round_robin()
+{
+    rocket::IOThreadGroup group(3);
+    for (int i = 0; i < 9; ++i)
+    {
+        assert(indexOf(group, group.getIOThread()) == i % 3);
+    }
+    printf("test_round_robin ok\n");
+}
+
+//每次都选连接数最少的线程
+void test_least_connections()
+{
+    rocket::IOThreadGroup group(4);
+    group.setPlacement(rocket::PlacementLeastConnections);
+    setConnections(group, {3, 1, 2, 5});
+    assert(indexOf(group, group.getIOThread()) == 1);
+    setConnections(group, {3, 4, 2, 5});
+    assert(indexOf(group, group.getIOThread()) == 2);
+    setConnections(group, {0, 0, 0, 0});
+    printf("test_least_connections ok\n");
+}
+
+//随机选两个不同的线程,取连接数少的:连接数最少的线程被选中的机会最大,最多的从不被选中
+void test_power_of_two()
+{
+    rocket::IOThreadGroup group(4);
+    group.setPlacement(rocket::PlacementPowerOfTwo);
+    setConnections(group, {0, 10, 20, 30});
+    std::vector<int> picked(4, 0);
+    for (int i = 0; i < 3000; ++i)
+    {
+        picked[indexOf(group, group.getIOThread())]++;
+    }
+    //0号被选进来的概率是1/2,一旦选进来就一定是它
+    assert(picked[0] > 1200);
+    assert(picked[0] > picked[1] && picked[1] > picked[2]);
+    assert(picked[3] == 0);
+    setConnections(group, {0, 0, 0, 0});
+
+    rocket::IOThreadGroup single(1);
+    single.setPlacement(rocket::PlacementPowerOfTwo);
+    assert(single.getIOThread() == single.getIOThread(0));
+    printf("test_power_of_two ok\n");
+}
+
+//最近忙碌的线程不会被选中;都空闲的时候轮流选,不会全落到第一个
+void test_least_busy()
+{
+    rocket::IOThreadGroup group(3);
+    group.setPlacement(rocket::PlacementLeastBusy);
+    //0号线程一直阻塞在epoll_wait里,统计值只能靠读的时候衰减
+    group.getIOThread(0)->getEventLoop()->setEpollMaxTimeout(5000);
+    group.start();
+
+    std::vector<int> picked(3, 0);
+    for (int i = 0; i < 30; ++i)
+    {
+        picked[indexOf(group, group.getIOThread())]++;
+    }
+    assert(picked[0] > 0 && picked[1] > 0 && picked[2] > 0);
+
+    //让0号线程忙200ms
+    rocket::EventLoop * busy_loop = group.getIOThread(0)->getEventLoop();
+    runInLoop(busy_loop, []() {
+        int64_t begin = rocket::getNowUs();
+        while (rocket::getNowUs() - begin < 200 * 1000)
+        {
+        }
+    });
+    //统计值在任务执行完、进入epoll_wait之前更新,等它更新出来
+    for (int i = 0; i < 100 && busy_loop->getRecentBusyUs() == 0; ++i)
+    {
+        usleep(1000);
+    }
+    assert(busy_loop->getRecentBusyUs() > 0);
+    for (int i = 0; i < 10; ++i)
+    {
+        assert(indexOf(group, group.getIOThread()) != 0);
+    }
+    //空闲超过一个统计周期之后不再算忙,又能被选中
+    usleep(150 * 1000);
+    assert(busy_loop->getRecentBusyUs() == 0);
+    std::vector<int> idle_picked(3, 0);
+    for (int i = 0; i < 30; ++i)
+    {
+        idle_picked[indexOf(group, group.getIOThread())]++;
+    }
+    assert(idle_picked[0] > 0);
+    printf("test_least_busy ok\n");
+}
+
+//自定义的选择函数优先,返回的下标不合法时退回轮询
+void test_custom_placement()
+{
+    rocket::IOThreadGroup group(3);
+    int result = 2;
+    group.setPlacement([&result](const std::vector<rocket::IOThread *> & threads) {
+        assert(threads.size() == 3);
+        return result;
+    });
+    assert(indexOf(group, group.getIOThread()) == 2);
+    result = 7;
+    assert(indexOf(group, group.getIOThread()) == 0);
+    assert(indexOf(group, group.getIOThread()) == 1);
+    //重新设置内置策略会替换掉自定义函数
+    group.setPlacement(rocket::PlacementLeastConnections);
+    setConnections(group, {1, 0, 1});
+    assert(indexOf(group, group.getIOThread()) == 1);
+    setConnections(group, {0, 0, 0});
+    printf("test_custom_placement ok\n");
+}
+
+//连接建立时计入所在loop的连接数,关闭后减掉
+void test_connection_count()
+{
+    rocket::IOThread io_thread;
+    io_thread.start();
+    rocket::EventLoop * loop = io_thread.getEventLoop();
+    int fds[2];
+    int rt = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    assert(rt == 0);
+    rocket::NetAddr::s_ptr addr = std::make_shared<rocket::IPNetAddr>("127.0.0.1", 12345);
+    rocket::TcpConnection::s_ptr connection;
+    runInLoop(loop, [&]() {
+        connection = std::make_shared<rocket::TcpConnection>(loop, fds[0], 128, addr, addr, rocket::TcpConnectionByClient);
+        connection->setState(rocket::Connected);
+    });
+    assert(loop->getConnectionCount() == 1);
+    runInLoop(loop, [&]() {
+        connection->clear();
+    });
+    assert(loop->getConnectionCount() == 0);
+    runInLoop(loop, [&]() {
+        connection.reset();
+    });
+    assert(loop->getConnectionCount() == 0);
+    close(fds[0]);
+    close(fds[1]);
+    printf("test_connection_count ok\n");
+}
+
+//当前进程允许使用的第一个cpu
+int firstAllowedCpu()
+{
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    sched_getaffinity(0, sizeof(cpus), &cpus);
+    for (int i = 0; i < CPU_SETSIZE; ++i)
+    {
+        if (CPU_ISSET(i, &cpus))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void test_cpu_list()
+{
+    assert(rocket::pickCpuList("", 3) == "");
+    assert(rocket::pickCpuList("0-3,8", 5) == "0-3,8");
+    assert(rocket::pickCpuList("0;1;2", 4) == "1");
+    assert(rocket::pickCpuList("0;;2;", 1) == "2");
+    //空串不绑定,格式错误的返回失败
+    assert(rocket::bindCurrentThreadToCpus(""));
+    assert(!rocket::bindCurrentThreadToCpus("3-1"));
+    assert(!rocket::bindCurrentThreadToCpus(","));
+    //写错的项不能当成0号核,整个列表都不用
+    assert(!rocket::bindCurrentThreadToCpus("x"));
+    assert(!rocket::bindCurrentThreadToCpus("a-b"));
+    assert(!rocket::bindCurrentThreadToCpus("0,1x"));
+    assert(!rocket::bindCurrentThreadToCpus("0-"));
+    assert(!rocket::bindCurrentThreadToCpus(std::to_string(sysconf(_SC_NPROCESSORS_CONF))));
+    printf("test_cpu_list ok\n");
+}
+
+//IO线程在创建EventLoop之前就绑好核
+void test_io_thread_bind()
+{
+    int cpu = firstAllowedCpu();
+    assert(cpu >= 0);
+    rocket::IOThread io_thread(std::to_string(cpu));
+    io_thread.start();
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    runInLoop(io_thread.getEventLoop(), [&cpus]() {
+        sched_getaffinity(0, sizeof(cpus), &cpus);
+    });
+    assert(CPU_COUNT(&cpus) == 1 && CPU_ISSET(cpu, &cpus));
+    printf("test_io_thread_bind ok\n");
+}
+
+int main()
+{
+    rocket::Config::SetGlobalConfig("conf/rocket.xml");
+    rocket::Logger::InitGlobalLogger();
+
+    sem_init(&g_step_done, 0, 0);
+    test_parse_placement();
+    test_round_robin();
+    test_least_connections();
+    test_power_of_two();
+    test_least_busy();
+    test_custom_placement();
+    test_connection_count();
+    test_cpu_list();
+    test_io_thread_bind();
+    return 0;
+}
@@ -0,0 +1,179 @@
+#include <pthread.h>
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/common/util.h"
+#include "rocket/common/run_time.h"
+
+static bool endsWith(const std::string & str, const std::string & suffix)
+{
+    return str.length() >= suffix.length() && str.compare(str.length() - suffix.length(), suffix.length(), suffix) == 0;
+}
+
+//一条日志: 头部 + [文件:行号] + 内容 + 换行
+void test_format()
+{
+    std::string msg = rocket::LogEvent(rocket::Info).format("a.cc:12", "x=%d s=%s", 5, "hi");
+    assert(msg.compare(0, 8, "[INFO]\t[") == 0);
+    assert(endsWith(msg, "\t[a.cc:12]\tx=5 s=hi\n"));
+    std::string pid_tid = "[" + std::to_string(rocket::getPid()) + ":" + std::to_string(rocket::getThreadId()) + "]";
+    assert(msg.find(pid_tid) != std::string::npos);
+    //没有参数,内容为空
+    msg = rocket::LogEvent(rocket::Error).format("b.cc:1", "");
+    assert(msg.compare(0, 9, "[ERROR]\t[") == 0);
+    assert(endsWith(msg, "[b.cc:1]\t\n"));
+    //长内容不会被截断
+    std::string long_str(10000, 'x');
+    msg = rocket::LogEvent(rocket::Debug).format("c.cc:2", "%s", long_str.c_str());
+    assert(endsWith(msg, "\t" + long_str + "\n"));
+    printf("test_format ok\n");
+}
+
+void test_file_line()
+{
+    int line = __LINE__; const char * file_line = ROCKET_LOG_FILE_LINE;
+    assert(std::string(file_line) == std::string(__FILE__) + ":" + std::to_string(line));
+    printf("test_file_line ok\n");
+}
+
+//参数只在真正打印的时候求值,每个调用点各自计数,每n次打印一次
+void test_every_n()
+{
+    int evaluated = 0;
+    for (int i = 0; i < 9; ++i)
+    {
+        INFOLOG_EVERY_N(3, "every 3, %d", evaluated++);
+    }
+    assert(evaluated == 3);
+    int other = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        INFOLOG_EVERY_N(2, "every 2, %d", other++);
+    }
+    assert(other == 2);
+    int always = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        INFOLOG_EVERY_N(0, "always, %d", always++);
+    }
+    assert(always == 4);
+    printf("test_every_n ok\n");
+}
+
+//低于运行时日志级别的调用不会对参数求值
+void test_level_filter()
+{
+    int evaluated = 0;
+    bool debug_on = rocket::Logger::GetGlobalLogger()->getLogLevel() <= rocket::Debug && ROCKET_MIN_LOG_LEVEL <= 1;
+    DEBUGLOG("debug %d", evaluated++);
+    assert(evaluated == (debug_on ? 1 : 0));
+    ERRORLOG("error %d", evaluated++);
+    assert(evaluated == (debug_on ? 2 : 1));
+    printf("test_level_filter ok\n");
+}
+
+//同步日志原样写到标准输出:内容里的%不会被当成格式符,结尾只有一个换行
+void test_sync_output()
+{
+    char path[] = "/tmp/test_log_format_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    fflush(stdout);
+    int saved = dup(1);
+    dup2(fd, 1);
+
+    rocket::Logger logger(rocket::Info, 0);
+    std::string msg = rocket::LogEvent(rocket::Info).format("d.cc:3", "%s", "100%s %d%%");
+    logger.pushLog(msg);
+    logger.pushAppLog(msg);
+    fflush(stdout);
+    dup2(saved, 1);
+    close(saved);
+
+    char buf[1024];
+    int len = pread(fd, buf, sizeof(buf), 0);
+    close(fd);
+    unlink(path);
+    assert(len > 0);
+    assert(std::string(buf, len) == msg + msg);
+    assert(endsWith(msg, "\t100%s %d%%\n"));
+    printf("test_sync_output ok\n");
+}
+
+struct DeferredRecord {
+    std::string m_data;
+    rocket::LogFormatter m_format;
+    std::string m_msg;
+};
+
+void * formatRecord(void * arg)
+{
+    DeferredRecord * record = static_cast<DeferredRecord *>(arg);
+    record->m_msg = record->m_format(record->m_data.data(), record->m_data.length());
+    return NULL;
+}
+
+//从[进程号:线程号]开始比较,前面的时间两次取的可能不一样
+static std::string fromPidTid(const std::string & msg)
+{
+    std::string pid_tid = "[" + std::to_string(rocket::getPid()) + ":" + std::to_string(rocket::getThreadId()) + "]";
+    size_t pos = msg.find(pid_tid);
+    assert(pos != std::string::npos);
+    return msg.substr(pos);
+}
+
+//延迟格式化: 调用线程只序列化参数,在其他线程格式化的结果和直接格式化一样,字符串参数是拷贝的
+void test_deferred_format()
+{
+    rocket::RunTime::GetRunTime()->m_msgid = "12345678901234567890";
+    rocket::RunTime::GetRunTime()->m_method_name = "Order.makeOrder";
+    char name[16];
+    strcpy(name, "apple");
+    std::string info = "biz error";
+    const char * null_str = NULL;
+    long long big = 1LL << 40;
+
+    DeferredRecord record;
+    record.m_format = rocket::serializeLog(record.m_data, rocket::Info, "e.cc:4", "name=%s info=%s n=%d c=%c d=%.2f big=%lld null=%s size=%zu",
+        name, info.c_str(), -7, 'z', 1.5, big, null_str, sizeof(name));
+    std::string expect = rocket::LogEvent(rocket::Info).format("e.cc:4", "name=%s info=%s n=%d c=%c d=%.2f big=%lld null=%s size=%zu",
+        name, info.c_str(), -7, 'z', 1.5, big, null_str, sizeof(name));
+    //调用返回之后参数的内存被改掉或者释放,不影响日志
+    strcpy(name, "xxxxx");
+    info.assign(100, 'y');
+    rocket::RunTime::GetRunTime()->m_msgid.clear();
+    rocket::RunTime::GetRunTime()->m_method_name.clear();
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, &formatRecord, &record);
+    pthread_join(thread, NULL);
+    assert(record.m_msg.compare(0, 8, "[INFO]\t[") == 0);
+    assert(fromPidTid(record.m_msg) == fromPidTid(expect));
+    assert(endsWith(record.m_msg, "\t[12345678901234567890]\t[Order.makeOrder]\t[e.cc:4]\tname=apple info=biz error n=-7 c=z d=1.50 big=1099511627776 null=(null) size=16\n"));
+
+    //没有参数
+    record.m_format = rocket::serializeLog(record.m_data, rocket::Error, "f.cc:5", "100%%");
+    record.m_msg = record.m_format(record.m_data.data(), record.m_data.length());
+    assert(record.m_msg.compare(0, 9, "[ERROR]\t[") == 0);
+    assert(endsWith(record.m_msg, "]\t[f.cc:5]\t100%\n"));
+    printf("test_deferred_format ok\n");
+}
+
+int main()
+{
+    rocket::Config::SetGlobalConfig("conf/rocket.xml");
+    rocket::Logger::InitGlobalLogger();
+
+    test_format();
+    test_file_line();
+    test_every_n();
+    test_level_filter();
+    test_sync_output();
+    test_deferred_format();
+    return 0;
+}
@@ -0,0 +1,157 @@
+#include <pthread.h>
+#include <assert.h>
+#include <stdio.h>
+#include <string>
+#include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/common/log_ring.h"
+
+//取一条记录并检查内容
+void popAndCheck(rocket::LogRing & ring, int type, int64_t time, const std::string & expect)
+{
+    rocket::LogRecordHeader header;
+    std::string data;
+    bool rt = ring.pop(time, header, data);
+    assert(rt);
+    assert(header.m_type == type && header.m_time == time);
+    assert(data == expect);
+}
+
+//容量向上取到2的幂次;长度不一的记录反复写入取出,记录的头部和内容都会跨越环尾
+void test_log_ring_wrap()
+{
+    rocket::LogRing ring(200);
+    assert(ring.capacity() == 256);
+    assert(ring.empty());
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        std::string msg(1 + i % 97, 'a' + i % 26);
+        assert(ring.push(i % 2, i, msg.c_str(), msg.size()));
+        if (i % 2 == 1)
+        {
+            //先攒两条再取,读写位置错开
+            std::string prev(1 + (i - 1) % 97, 'a' + (i - 1) % 26);
+            popAndCheck(ring, (i - 1) % 2, i - 1, prev);
+            popAndCheck(ring, i % 2, i, msg);
+            assert(ring.empty());
+        }
+    }
+    printf("test_log_ring_wrap ok\n");
+}
+
+//写满后push返回false,取走之后又能写;超过容量的单条日志截断
+void test_log_ring_overflow()
+{
+    rocket::LogRing ring(256);
+    std::string msg(40, 'x');
+    int count = 0;
+    while (ring.push(0, count, msg.c_str(), msg.size()))
+    {
+        count++;
+    }
+    int record_size = (int)(sizeof(rocket::LogRecordHeader) + msg.size());
+    assert(count == 256 / record_size);
+    assert(ring.used() == (uint64_t)(count * record_size));
+    assert(!ring.push(0, count, msg.c_str(), msg.size()));
+
+    popAndCheck(ring, 0, 0, msg);
+    assert(ring.push(0, count, msg.c_str(), msg.size()));
+    for (int i = 1; i <= count; ++i)
+    {
+        popAndCheck(ring, 0, i, msg);
+    }
+    assert(ring.empty());
+
+    //比整个环还大的日志截断到刚好放满
+    std::string big(1000, 'y');
+    assert(ring.push(1, 1, big.c_str(), big.size()));
+    assert(ring.used() == ring.capacity());
+    popAndCheck(ring, 1, 1, big.substr(0, 256 - sizeof(rocket::LogRecordHeader)));
+
+    //比头部还小的容量会放大,截断之后至少还能放一点内容
+    rocket::LogRing tiny(1);
+    assert(tiny.capacity() > sizeof(rocket::LogRecordHeader));
+    assert(tiny.push(1, 2, big.c_str(), big.size()));
+    popAndCheck(tiny, 1, 2, big.substr(0, tiny.capacity() - sizeof(rocket::LogRecordHeader)));
+    printf("test_log_ring_overflow ok\n");
+}
+
+//晚于deadline的记录留在环里,下次再取
+void test_log_ring_deadline()
+{
+    rocket::LogRing ring(1024);
+    assert(ring.push(0, 100, "early", 5));
+    assert(ring.push(0, 200, "late", 4));
+
+    rocket::LogRecordHeader header;
+    std::string data;
+    assert(ring.pop(150, header, data) && data == "early");
+    assert(!ring.pop(150, header, data));
+    assert(!ring.empty());
+    assert(ring.pop(200, header, data) && data == "late");
+    assert(ring.empty());
+
+    assert(ring.markNotified());
+    assert(!ring.markNotified());
+    ring.clearNotified();
+    assert(ring.markNotified());
+    printf("test_log_ring_deadline ok\n");
+}
+
+static const int SPSC_COUNT = 200000;
+static rocket::LogRing * g_ring = NULL;
+
+void * produce(void *)
+{
+    char buf[64];
+    for (int i = 0; i < SPSC_COUNT; ++i)
+    {
+        int len = snprintf(buf, sizeof(buf), "record %d", i);
+        while (!g_ring->push(0, i, buf, len))
+        {
+            //满了等消费者取
+        }
+    }
+    return NULL;
+}
+
+//一个线程写一个线程取,不丢不乱序
+void test_log_ring_spsc()
+{
+    g_ring = new rocket::LogRing(4096);
+    pthread_t thread;
+    pthread_create(&thread, NULL, &produce, NULL);
+
+    rocket::LogRecordHeader header;
+    std::string data;
+    char buf[64];
+    int next = 0;
+    while (next < SPSC_COUNT)
+    {
+        if (!g_ring->pop(SPSC_COUNT, header, data))
+        {
+            continue;
+        }
+        int len = snprintf(buf, sizeof(buf), "record %d", next);
+        assert(header.m_time == next);
+        assert(data == std::string(buf, len));
+        next++;
+    }
+    pthread_join(thread, NULL);
+    assert(g_ring->empty());
+    delete g_ring;
+    printf("test_log_ring_spsc ok, %d records\n", next);
+}
+
+int main()
+{
+    rocket::Config::SetGlobalConfig("conf/rocket.xml");
+    rocket::Logger::InitGlobalLogger();
+
+    test_log_ring_wrap();
+    test_log_ring_overflow();
+    test_log_ring_deadline();
+    test_log_ring_spsc();
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include <pthread.h>
+#include <assert.h>
+#include <stdio.h>
+#include <memory>
+#include <vector>
+#include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/net/rpc/rpc_message_pool.h"
+
+#include "order.pb.h"
+
+//释放后Clear放回空闲列表,下次取到同一个对象;每种消息各自一个列表,超过上限的直接释放
+void test_message_pool_reuse()
+{
+    rocket::RpcMessagePool::SetMaxSize(2);
+    uint64_t hit = rocket::RpcMessagePool::GetHitCount();
+    uint64_t miss = rocket::RpcMessagePool::GetMissCount();
+
+    std::vector<std::shared_ptr<google::protobuf::Message>> msgs;
+    std::vector<google::protobuf::Message *> raws;
+    for (int i = 0; i < 3; ++i)
+    {
+        msgs.push_back(rocket::RpcMessagePool::Acquire(makeOrderRequest::default_instance()));
+        raws.push_back(msgs.back().get());
+        makeOrderRequest * request = dynamic_cast<makeOrderRequest *>(msgs.back().get());
+        assert(request != NULL);
+        request->set_price(i + 1);
+        request->set_goods("goods");
+    }
+    assert(rocket::RpcMessagePool::GetMissCount() == miss + 3);
+    msgs.clear();
+    //上限是2,第三个直接释放
+    assert(rocket::RpcMessagePool::GetPooledCount() == 2);
+
+    //后放回去的先取出来
+    std::shared_ptr<google::protobuf::Message> msg = rocket::RpcMessagePool::Acquire(makeOrderRequest::default_instance());
+    assert(msg.get() == raws[1]);
+    makeOrderRequest * request = dynamic_cast<makeOrderRequest *>(msg.get());
+    assert(request->price() == 0 && request->goods().empty());
+    assert(rocket::RpcMessagePool::GetHitCount() == hit + 1);
+    assert(rocket::RpcMessagePool::GetPooledCount() == 1);
+
+    //不同类型的消息不会混用
+    std::shared_ptr<google::protobuf::Message> response = rocket::RpcMessagePool::Acquire(makeOrderResponse::default_instance());
+    assert(dynamic_cast<makeOrderResponse *>(response.get()) != NULL);
+    assert(rocket::RpcMessagePool::GetMissCount() == miss + 4);
+    assert(rocket::RpcMessagePool::GetPooledCount() == 1);
+
+    msg.reset();
+    response.reset();
+    assert(rocket::RpcMessagePool::GetPooledCount() == 3);
+    printf("test_message_pool_reuse ok, hit rate %.2f\n", rocket::RpcMessagePool::GetHitRate());
+}
+
+static std::shared_ptr<google::protobuf::Message> g_cross_msg;
+
+void * releaseMessage(void *)
+{
+    g_cross_msg.reset();
+    return NULL;
+}
+
+//在其他线程释放的消息不放回分配线程的空闲列表
+void test_message_pool_cross_thread()
+{
+    uint64_t pooled = rocket::RpcMessagePool::GetPooledCount();
+    g_cross_msg = rocket::RpcMessagePool::Acquire(makeOrderRequest::default_instance());
+    assert(rocket::RpcMessagePool::GetPooledCount() == pooled - 1);
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, &releaseMessage, NULL);
+    pthread_join(thread, NULL);
+    assert(rocket::RpcMessagePool::GetPooledCount() == pooled - 1);
+    printf("test_message_pool_cross_thread ok\n");
+}
+
+void * acquireAndExit(void *)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        std::shared_ptr<google::protobuf::Message> msg = rocket::RpcMessagePool::Acquire(makeOrderRequest::default_instance());
+    }
+    return NULL;
+}
+
+//上限为0时不缓存;线程退出时它缓存的消息都释放
+void test_message_pool_disabled_and_exit()
+{
+    rocket::RpcMessagePool::SetMaxSize(4);
+    uint64_t pooled = rocket::RpcMessagePool::GetPooledCount();
+    pthread_t thread;
+    pthread_create(&thread, NULL, &acquireAndExit, NULL);
+    pthread_join(thread, NULL);
+    assert(rocket::RpcMessagePool::GetPooledCount() == pooled);
+
+    rocket::RpcMessagePool::SetMaxSize(0);
+    uint64_t hit = rocket::RpcMessagePool::GetHitCount();
+    std::shared_ptr<google::protobuf::Message> msg = rocket::RpcMessagePool::Acquire(makeOrderResponse::default_instance());
+    assert(rocket::RpcMessagePool::GetHitCount() == hit + 1);   //之前缓存的还能取出来
+    msg.reset();
+    msg = rocket::RpcMessagePool::Acquire(makeOrderResponse::default_instance());
+    msg.reset();
+    assert(rocket::RpcMessagePool::GetHitCount() == hit + 1);
+    printf("test_message_pool_disabled_and_exit ok\n");
+}
+
+int main()
+{
+    rocket::Config::SetGlobalConfig("conf/rocket.xml");
+    rocket::Logger::InitGlobalLogger();
+
+    test_message_pool_reuse();
+    test_message_pool_cross_thread();
+    test_message_pool_disabled_and_exit();
+    return 0;
+}
@@ -0,0 +1,148 @@
+#include <pthread.h>
+#include <assert.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <atomic>
+#include <vector>
+#include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/common/mpsc_queue.h"
+#include "rocket/net/eventloop.h"
+#include "rocket/net/io_thread.h"
+
+static const int PRODUCER_COUNT = 8;
+static const int PUSH_PER_PRODUCER = 200000;
+
+struct TestNode : public rocket::MpscNode {
+    int m_producer {0};
+    int m_seq {0};
+};
+
+static rocket::MpscQueue g_queue;
+static std::vector<TestNode> g_nodes(PRODUCER_COUNT * PUSH_PER_PRODUCER);
+
+void * produce(void * arg)
+{
+    int id = (int)(long)arg;
+    for (int i = 0; i < PUSH_PER_PRODUCER; ++i)
+    {
+        TestNode & node = g_nodes[id * PUSH_PER_PRODUCER + i];
+        node.m_producer = id;
+        node.m_seq = i;
+        g_queue.push(&node);
+    }
+    return NULL;
+}
+
+//多个线程同时push,单个消费者取出来的总数不丢不重,每个生产者自己的顺序不变
+void test_mpsc_contention()
+{
+    std::vector<pthread_t> threads(PRODUCER_COUNT);
+    for (int i = 0; i < PRODUCER_COUNT; ++i)
+    {
+        pthread_create(&threads[i], NULL, &produce, (void *)(long)i);
+    }
+
+    std::vector<int> next_seq(PRODUCER_COUNT, 0);
+    int total = 0;
+    while (total < PRODUCER_COUNT * PUSH_PER_PRODUCER)
+    {
+        rocket::MpscNode * node = g_queue.pop();
+        if (node == NULL)
+        {
+            //生产者可能正在插入,稍后再取
+            continue;
+        }
+        TestNode * test_node = static_cast<TestNode *>(node);
+        assert(test_node->m_seq == next_seq[test_node->m_producer]);
+        next_seq[test_node->m_producer]++;
+        total++;
+    }
+
+    for (int i = 0; i < PRODUCER_COUNT; ++i)
+    {
+        pthread_join(threads[i], NULL);
+        assert(next_seq[i] == PUSH_PER_PRODUCER);
+    }
+    assert(g_queue.pop() == NULL);
+    assert(g_queue.empty());
+    printf("test_mpsc_contention ok, pop %d nodes from %d producers\n", total, PRODUCER_COUNT);
+}
+
+//单线程下是严格的先进先出,取空之后stub放回去还能继续用
+void test_mpsc_fifo()
+{
+    std::vector<TestNode> nodes(16);
+    for (int round = 0; round < 3; ++round)
+    {
+        assert(g_queue.empty());
+        for (size_t i = 0; i < nodes.size(); ++i)
+        {
+            nodes[i].m_seq = (int)i;
+            g_queue.push(&nodes[i]);
+        }
+        assert(!g_queue.empty());
+        for (size_t i = 0; i < nodes.size(); ++i)
+        {
+            TestNode * node = static_cast<TestNode *>(g_queue.pop());
+            assert(node != NULL && node->m_seq == (int)i);
+        }
+        assert(g_queue.pop() == NULL);
+    }
+    printf("test_mpsc_fifo ok\n");
+}
+
+static rocket::EventLoop * g_event_loop = NULL;
+static std::vector<int> g_task_next_seq(PRODUCER_COUNT, 0);    //只在loop线程里访问
+static std::atomic<int> g_task_done {0};
+static const int TASK_PER_PRODUCER = 20000;
+
+void * addTasks(void * arg)
+{
+    int id = (int)(long)arg;
+    for (int i = 0; i < TASK_PER_PRODUCER; ++i)
+    {
+        g_event_loop->addTask([id, i]() {
+            assert(g_event_loop->isInLoopThread());
+            assert(g_task_next_seq[id] == i);
+            g_task_next_seq[id]++;
+            g_task_done++;
+        }, true);
+    }
+    return NULL;
+}
+
+//EventLoop的任务队列:多个线程同时addTask,任务都在loop线程执行,每个线程提交的顺序不变
+void test_eventloop_tasks()
+{
+    rocket::IOThread * io_thread = new rocket::IOThread();
+    g_event_loop = io_thread->getEventLoop();
+    io_thread->start();
+
+    std::vector<pthread_t> threads(PRODUCER_COUNT);
+    for (int i = 0; i < PRODUCER_COUNT; ++i)
+    {
+        pthread_create(&threads[i], NULL, &addTasks, (void *)(long)i);
+    }
+    for (int i = 0; i < PRODUCER_COUNT; ++i)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    while (g_task_done < PRODUCER_COUNT * TASK_PER_PRODUCER)
+    {
+        usleep(1000);
+    }
+    delete io_thread;
+    printf("test_eventloop_tasks ok, run %d tasks\n", g_task_done.load());
+}
+
+int main()
+{
+    rocket::Config::SetGlobalConfig("conf/rocket.xml");
+    rocket::Logger::InitGlobalLogger();
+
+    test_mpsc_fifo();
+    test_mpsc_contention();
+    test_eventloop_tasks();
+    return 0;
+}
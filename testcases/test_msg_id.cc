@@ -0,0 +1,40 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string>
+#include <set>
+#include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/common/msg_id_util.h"
+
+//生成的是20位数字,同一个线程里依次加1,不会重复
+void test_gen_msg_id()
+{
+    std::string prev = rocket::MsgIDUtil::GenMsgID();
+    assert(prev.length() == 20);
+    for (size_t i = 0; i < prev.length(); ++i)
+    {
+        assert(prev[i] >= '0' && prev[i] <= '9');
+    }
+    std::set<std::string> ids;
+    ids.insert(prev);
+    for (int i = 0; i < 10000; ++i)
+    {
+        std::string id = rocket::MsgIDUtil::GenMsgID();
+        assert(id.length() == 20);
+        //等长的数字串,字典序就是数值大小
+        assert(id > prev);
+        ids.insert(id);
+        prev = id;
+    }
+    assert(ids.size() == 10001);
+    printf("test_gen_msg_id ok\n");
+}
+
+int main()
+{
+    rocket::Config::SetGlobalConfig("conf/rocket.xml");
+    rocket::Logger::InitGlobalLogger();
+
+    test_gen_msg_id();
+    return 0;
+}
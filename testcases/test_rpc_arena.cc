@@ -0,0 +1,85 @@
+#include <pthread.h>
+#include <assert.h>
+#include <stdio.h>
+#include <memory>
+#include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/net/rpc/rpc_arena.h"
+
+#include "order.pb.h"
+
+//同一个arena上分配的消息都挂在arena的引用计数上
+void test_arena_new_message()
+{
+    rocket::RpcArena::s_ptr arena = rocket::RpcArena::GetThreadArena();
+    assert(arena == rocket::RpcArena::GetThreadArena());
+
+    std::shared_ptr<google::protobuf::Message> msg = rocket::RpcArena::NewMessage(arena, makeOrderRequest::default_instance());
+    makeOrderRequest * request = dynamic_cast<makeOrderRequest *>(msg.get());
+    assert(request != NULL);
+    request->set_price(100);
+    request->set_goods("apple");
+    assert(arena.use_count() == 3);     //线程的t_arena、arena、msg
+
+    msg.reset();
+    assert(arena.use_count() == 2);
+    printf("test_arena_new_message ok\n");
+}
+
+//消息都释放了,Reset后当前线程继续用同一个arena
+void test_arena_reset_reuse()
+{
+    rocket::RpcArena * before = rocket::RpcArena::GetThreadArena().get();
+    for (int i = 0; i < 1000; ++i)
+    {
+        std::shared_ptr<google::protobuf::Message> msg = rocket::RpcArena::NewMessage(rocket::RpcArena::GetThreadArena(), makeOrderResponse::default_instance());
+        dynamic_cast<makeOrderResponse *>(msg.get())->set_res_info(std::string(200, 'r'));
+    }
+    rocket::RpcArena::ResetThreadArena();
+    assert(rocket::RpcArena::GetThreadArena().get() == before);
+    printf("test_arena_reset_reuse ok\n");
+}
+
+static std::shared_ptr<google::protobuf::Message> g_pending_msg;
+
+void * releaseMessage(void *)
+{
+    makeOrderRequest * request = dynamic_cast<makeOrderRequest *>(g_pending_msg.get());
+    assert(request->price() == 7 && request->goods() == "pending");
+    g_pending_msg.reset();
+    return NULL;
+}
+
+//还有消息在用时Reset,这个arena留给消息,当前线程换新的;最后一个消息释放时arena跟着释放
+void test_arena_pending_message()
+{
+    rocket::RpcArena::s_ptr arena = rocket::RpcArena::GetThreadArena();
+    g_pending_msg = rocket::RpcArena::NewMessage(arena, makeOrderRequest::default_instance());
+    makeOrderRequest * request = dynamic_cast<makeOrderRequest *>(g_pending_msg.get());
+    request->set_price(7);
+    request->set_goods("pending");
+
+    std::weak_ptr<rocket::RpcArena> weak_arena = arena;
+    arena.reset();
+    rocket::RpcArena::ResetThreadArena();
+    assert(rocket::RpcArena::GetThreadArena() != weak_arena.lock());
+    assert(!weak_arena.expired());
+
+    //在其他线程释放,比如交给业务线程处理的请求
+    pthread_t thread;
+    pthread_create(&thread, NULL, &releaseMessage, NULL);
+    pthread_join(thread, NULL);
+    assert(weak_arena.expired());
+    printf("test_arena_pending_message ok\n");
+}
+
+int main()
+{
+    rocket::Config::SetGlobalConfig("conf/rocket.xml");
+    rocket::Logger::InitGlobalLogger();
+
+    test_arena_new_message();
+    test_arena_reset_reuse();
+    test_arena_pending_message();
+    return 0;
+}
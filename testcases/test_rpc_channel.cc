@@ -0,0 +1,286 @@
+#include <pthread.h>
+#include <semaphore.h>
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/common/error_code.h"
+#include "rocket/net/io_thread.h"
+#include "rocket/net/tcp/tcp_buffer.h"
+#include "rocket/net/tcp/tcp_client_pool.h"
+#include "rocket/net/coder/tinypb_coder.h"
+#include "rocket/net/coder/tinypb_protocol.h"
+#include "rocket/net/rpc/rpc_channel.h"
+#include "rocket/net/rpc/rpc_controller.h"
+#include "rocket/net/rpc/rpc_closure.h"
+#include "order.pb.h"
+
+static const int TEST_PORT = 12361;
+//假服务端按价格决定怎么回包
+static const int PRICE_OK = 1;          //正常回包
+static const int PRICE_NO_REPLY = 2;    //不回包,等客户端超时
+static const int PRICE_BAD_BODY = 3;    //回包的pb数据解析不了
+static const int PRICE_BIZ_ERROR = 4;   //回包带错误码
+static const int BIZ_ERROR_CODE = 123;
+
+static rocket::EventLoop * g_loop = NULL;
+static sem_t g_step_done;
+static std::atomic<int> g_accept_count {0};
+static std::atomic<bool> g_server_stop {false};
+
+void runInLoop(std::function<void()> fn)
+{
+    g_loop->addTask([fn]() {
+        fn();
+        sem_post(&g_step_done);
+    }, true);
+    sem_wait(&g_step_done);
+}
+
+int startListen()
+{
+    int listenfd = socket(AF_INET, SOCK_STREAM, 0);
+    int opt = 1;
+    setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_port = htons(TEST_PORT);
+    addr.sin_family = AF_INET;
+    inet_aton("127.0.0.1", &addr.sin_addr);
+    int rt = bind(listenfd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+    assert(rt == 0);
+    rt = listen(listenfd, 64);
+    assert(rt == 0);
+    return listenfd;
+}
+
+void reply(int fd, std::shared_ptr<rocket::TinyPBProtocol> request)
+{
+    makeOrderRequest order;
+    assert(order.ParseFromArray(request->pbData(), request->pbDataLen()));
+    std::shared_ptr<rocket::TinyPBProtocol> response = std::make_shared<rocket::TinyPBProtocol>();
+    response->m_msg_id = request->m_msg_id;
+    response->m_method_name = request->m_method_name;
+    if (order.price() == PRICE_NO_REPLY)
+    {
+        return;
+    }
+    if (order.price() == PRICE_BAD_BODY)
+    {
+        response->m_pb_data = "\xff";
+    }
+    else if (order.price() == PRICE_BIZ_ERROR)
+    {
+        response->m_err_code = BIZ_ERROR_CODE;
+        response->m_err_info = "biz error";
+    }
+    else
+    {
+        makeOrderResponse rsp;
+        rsp.set_order_id("ok");
+        rsp.SerializeToString(&response->m_pb_data);
+    }
+
+    std::vector<rocket::AbstractProtocol::s_ptr> messages;
+    messages.push_back(response);
+    rocket::TcpBuffer::s_ptr out = std::make_shared<rocket::TcpBuffer>(128);
+    rocket::TinyPBCoder coder;
+    coder.encode(messages, out);
+    std::vector<char> bytes;
+    out->readFromBuffer(bytes, out->readAble());
+    assert(write(fd, &bytes[0], bytes.size()) == (int)bytes.size());
+}
+
+//单线程的假服务端:接受连接,按包解析请求,按价格回包
+void * serve(void * arg)
+{
+    int listenfd = *static_cast<int *>(arg);
+    std::vector<pollfd> fds;
+    std::vector<rocket::TcpBuffer::s_ptr> buffers;
+    std::vector<std::shared_ptr<rocket::TinyPBCoder>> coders;
+    fds.push_back({listenfd, POLLIN, 0});
+    buffers.push_back(NULL);
+    coders.push_back(NULL);
+    while (!g_server_stop)
+    {
+        int rt = poll(&fds[0], fds.size(), 20);
+        if (rt <= 0)
+        {
+            continue;
+        }
+        if (fds[0].revents & POLLIN)
+        {
+            int fd = accept(listenfd, NULL, NULL);
+            if (fd >= 0)
+            {
+                g_accept_count++;
+                fds.push_back({fd, POLLIN, 0});
+                buffers.push_back(std::make_shared<rocket::TcpBuffer>(128));
+                coders.push_back(std::make_shared<rocket::TinyPBCoder>());
+            }
+        }
+        for (size_t i = 1; i < fds.size(); ++i)
+        {
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+            {
+                continue;
+            }
+            char buf[4096];
+            int len = read(fds[i].fd, buf, sizeof(buf));
+            if (len <= 0)
+            {
+                close(fds[i].fd);
+                fds[i].fd = -1;
+                continue;
+            }
+            buffers[i]->writeToBuffer(buf, len);
+            std::vector<rocket::AbstractProtocol::s_ptr> messages;
+            coders[i]->decode(messages, buffers[i]);
+            for (size_t j = 0; j < messages.size(); ++j)
+            {
+                reply(fds[i].fd, std::dynamic_pointer_cast<rocket::TinyPBProtocol>(messages[j]));
+            }
+        }
+    }
+    for (size_t i = 1; i < fds.size(); ++i)
+    {
+        if (fds[i].fd >= 0)
+        {
+            close(fds[i].fd);
+        }
+    }
+    return NULL;
+}
+
+struct CallResult {
+    int m_runs {0};     //done执行的次数
+    int m_err_code {0};
+    std::string m_order_id;
+};
+
+//在loop线程里发起一次调用,结果写到result里
+void callMakeOrder(int port, int price, int timeout_ms, std::shared_ptr<CallResult> result)
+{
+    runInLoop([port, price, timeout_ms, result]() {
+        std::shared_ptr<rocket::RpcChannel> channel = std::make_shared<rocket::RpcChannel>(std::make_shared<rocket::IPNetAddr>("127.0.0.1", port));
+        NEWMESSAGE(makeOrderRequest, request);
+        NEWMESSAGE(makeOrderResponse, response);
+        NEWRPCCONTROLLER(controller);
+        request->set_price(price);
+        request->set_goods("apple");
+        controller->SetTimeout(timeout_ms);
+        std::shared_ptr<rocket::RpcClosure> closure = std::make_shared<rocket::RpcClosure>([result, controller, response]() {
+            result->m_runs++;
+            result->m_err_code = controller->GetErrorCode();
+            result->m_order_id = response->order_id();
+        });
+        channel->Init(controller, request, response, closure);
+        Order_Stub(channel.get()).makeOrder(controller.get(), request.get(), response.get(), closure.get());
+    });
+}
+
+//在loop线程里读结果,等到done执行了expect_runs次或者超时
+CallResult waitResult(std::shared_ptr<CallResult> result, int expect_runs, int timeout_ms)
+{
+    CallResult copy;
+    for (int i = 0; ; ++i)
+    {
+        runInLoop([&copy, result]() {
+            copy = *result;
+        });
+        if (copy.m_runs >= expect_runs || i >= timeout_ms / 10)
+        {
+            break;
+        }
+        usleep(10 * 1000);
+    }
+    return copy;
+}
+
+//一个请求超时只是取消这个请求,连接还回连接池继续复用,不会断开重连
+void test_timeout_keeps_connection()
+{
+    std::shared_ptr<CallResult> slow = std::make_shared<CallResult>();
+    callMakeOrder(TEST_PORT, PRICE_NO_REPLY, 100, slow);
+    CallResult result = waitResult(slow, 1, 1000);
+    assert(result.m_runs == 1 && result.m_err_code == ERROR_RPC_CALL_TIMEOUT);
+
+    rocket::NetAddr::s_ptr addr = std::make_shared<rocket::IPNetAddr>("127.0.0.1", TEST_PORT);
+    int connections = 0;
+    int inflight = 0;
+    runInLoop([&]() {
+        connections = rocket::TcpClientPool::GetTcpClientPool()->getConnectionCount(addr);
+        inflight = rocket::TcpClientPool::GetTcpClientPool()->getInflightCount(addr);
+    });
+    assert(connections == 1 && inflight == 0);
+
+    std::shared_ptr<CallResult> fast = std::make_shared<CallResult>();
+    callMakeOrder(TEST_PORT, PRICE_OK, 1000, fast);
+    result = waitResult(fast, 1, 1000);
+    assert(result.m_runs == 1 && result.m_err_code == 0 && result.m_order_id == "ok");
+    assert(g_accept_count == 1);
+    printf("test_timeout_keeps_connection ok\n");
+}
+
+//收到回包或者出错都只执行一次done,之后超时时间到了也不会再执行,错误码不会被改成超时
+void test_done_once()
+{
+    std::shared_ptr<CallResult> ok = std::make_shared<CallResult>();
+    std::shared_ptr<CallResult> bad_body = std::make_shared<CallResult>();
+    std::shared_ptr<CallResult> biz_error = std::make_shared<CallResult>();
+    std::shared_ptr<CallResult> refused = std::make_shared<CallResult>();
+    callMakeOrder(TEST_PORT, PRICE_OK, 200, ok);
+    callMakeOrder(TEST_PORT, PRICE_BAD_BODY, 200, bad_body);
+    callMakeOrder(TEST_PORT, PRICE_BIZ_ERROR, 200, biz_error);
+    //这个端口没有人监听
+    callMakeOrder(TEST_PORT + 1, PRICE_OK, 200, refused);
+    //等过超时时间
+    usleep(500 * 1000);
+
+    CallResult result = waitResult(ok, 1, 0);
+    assert(result.m_runs == 1 && result.m_err_code == 0 && result.m_order_id == "ok");
+    result = waitResult(bad_body, 1, 0);
+    assert(result.m_runs == 1 && result.m_err_code == ERROR_FAILED_SERIALIZE);
+    result = waitResult(biz_error, 1, 0);
+    assert(result.m_runs == 1 && result.m_err_code == BIZ_ERROR_CODE);
+    result = waitResult(refused, 1, 0);
+    assert(result.m_runs == 1 && result.m_err_code != 0 && result.m_err_code != ERROR_RPC_CALL_TIMEOUT);
+    printf("test_done_once ok\n");
+}
+
+int main()
+{
+    rocket::Config::SetGlobalConfig("conf/rocket.xml");
+    rocket::Logger::InitGlobalLogger();
+    rocket::Config::GetGlobalConfig()->m_client_max_inflight = 8;
+
+    sem_init(&g_step_done, 0, 0);
+    int listenfd = startListen();
+    pthread_t server;
+    pthread_create(&server, NULL, serve, &listenfd);
+
+    rocket::IOThread * io_thread = new rocket::IOThread();
+    g_loop = io_thread->getEventLoop();
+    io_thread->start();
+
+    test_timeout_keeps_connection();
+    test_done_once();
+
+    g_server_stop = true;
+    pthread_join(server, NULL);
+    close(listenfd);
+    //服务端关闭后连接池里的连接读到EOF关掉,再析构IO线程
+    usleep(100 * 1000);
+    delete io_thread;
+    return 0;
+}
@@ -55,9 +55,9 @@ void test_tcp_client()
         client.readMessage("99998888", [=](rocket::AbstractProtocol::s_ptr msg_ptr)
             { 
                 std::shared_ptr<rocket::TinyPBProtocol> message = std::dynamic_pointer_cast<rocket::TinyPBProtocol>(msg_ptr);
-                DEBUGLOG("req_id [%s], get response %s", message->m_msg_id.c_str(), message->m_pb_data.c_str()); 
+                DEBUGLOG("req_id [%s], get response %s", message->m_msg_id.c_str(), std::string(message->pbData(), message->pbDataLen()).c_str()); 
                 makeOrderResponse response;
-                if (!response.ParseFromString(message->m_pb_data))
+                if (!response.ParseFromArray(message->pbData(), message->pbDataLen()))
                 {
                     ERRORLOG("deserilize error");
                     return;
@@ -0,0 +1,247 @@
+#include <pthread.h>
+#include <semaphore.h>
+#include <assert.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <google/protobuf/service.h>
+#include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/common/error_code.h"
+#include "rocket/net/tcp/net_addr.h"
+#include "rocket/net/coder/tinypb_protocol.h"
+#include "rocket/net/rpc/rpc_controller.h"
+#include "rocket/net/rpc/rpc_worker_pool.h"
+#include "rocket/net/rpc/rpc_dispatcher.h"
+#include "rocket/net/rpc/rpc_message_pool.h"
+#include "order.pb.h"
+
+static google::protobuf::Closure * g_pending_done = NULL;
+static makeOrderResponse * g_pending_response = NULL;
+static pthread_t g_race_thread;
+static sem_t g_reply_entered;   //其他线程里的done已经开始回包
+static sem_t g_reply_release;   //放行其他线程里的回包
+
+/*
+    按goods区分业务方法的行为:
+    sync 不执行done直接返回; done 返回前自己执行done; async 调用StartAsync,把done留到之后执行
+    race 没有调用StartAsync,done在其他线程执行,回包开始之后方法就返回,回包还没结束时和兜底回包竞争
+*/
+void * runDone(void * arg)
+{
+    static_cast<google::protobuf::Closure *>(arg)->Run();
+    return NULL;
+}
+
+class OrderImpl : public Order
+{
+public:
+    void makeOrder(google::protobuf::RpcController * controller,
+                       const ::makeOrderRequest* request,
+                       ::makeOrderResponse* response,
+                       ::google::protobuf::Closure* done)
+    {
+        if (request->goods() == "async")
+        {
+            dynamic_cast<rocket::RpcController *>(controller)->StartAsync();
+            g_pending_done = done;
+            g_pending_response = response;
+            return;
+        }
+        response->set_order_id("sync_" + std::to_string(request->price()));
+        if (request->goods() == "done")
+        {
+            done->Run();
+        }
+        else if (request->goods() == "race")
+        {
+            pthread_create(&g_race_thread, NULL, &runDone, done);
+            sem_wait(&g_reply_entered);
+        }
+    }
+};
+
+struct Replies {
+    std::vector<std::shared_ptr<rocket::TinyPBProtocol>> m_messages;
+};
+
+std::shared_ptr<rocket::TinyPBProtocol> makeRequest(const std::string & method_name, const std::string & pb_data)
+{
+    std::shared_ptr<rocket::TinyPBProtocol> request = std::make_shared<rocket::TinyPBProtocol>();
+    request->m_msg_id = "123456";
+    request->m_method_name = method_name;
+    request->m_pb_data = pb_data;
+    return request;
+}
+
+std::string makeOrder(int price, const std::string & goods)
+{
+    makeOrderRequest request;
+    request.set_price(price);
+    request.set_goods(goods);
+    return request.SerializeAsString();
+}
+
+void dispatch(rocket::RpcDispatcher & dispatcher, std::shared_ptr<rocket::TinyPBProtocol> request, std::shared_ptr<Replies> replies)
+{
+    rocket::NetAddr::s_ptr addr = std::make_shared<rocket::IPNetAddr>("127.0.0.1", 12345);
+    dispatcher.dispatcher(request, addr, addr, [replies](rocket::AbstractProtocol::s_ptr message) {
+        replies->m_messages.push_back(std::dynamic_pointer_cast<rocket::TinyPBProtocol>(message));
+    });
+}
+
+std::string orderId(std::shared_ptr<rocket::TinyPBProtocol> message)
+{
+    assert(message->m_err_code == 0 && message->m_pb_message);
+    makeOrderResponse * response = dynamic_cast<makeOrderResponse *>(message->m_pb_message.get());
+    assert(response != NULL);
+    return response->order_id();
+}
+
+//同步的业务方法,不管自己有没有执行done,都只回一次包
+void test_sync_reply(rocket::RpcDispatcher & dispatcher)
+{
+    std::shared_ptr<Replies> replies = std::make_shared<Replies>();
+    dispatch(dispatcher, makeRequest("Order.makeOrder", makeOrder(1, "sync")), replies);
+    assert(replies->m_messages.size() == 1);
+    assert(replies->m_messages[0]->m_msg_id == "123456");
+    assert(orderId(replies->m_messages[0]) == "sync_1");
+    //响应消息分配在线程的arena上
+    assert(replies->m_messages[0]->m_pb_message->GetArena() != NULL);
+
+    replies = std::make_shared<Replies>();
+    dispatch(dispatcher, makeRequest("Order.makeOrder", makeOrder(2, "done")), replies);
+    assert(replies->m_messages.size() == 1);
+    assert(orderId(replies->m_messages[0]) == "sync_2");
+    printf("test_sync_reply ok\n");
+}
+
+void * runPendingDone(void *)
+{
+    usleep(20 * 1000);
+    g_pending_response->set_order_id("async");
+    g_pending_done->Run();
+    return NULL;
+}
+
+//StartAsync之后方法返回时不回包,done在其他线程执行时才回包
+void test_async_reply(rocket::RpcDispatcher & dispatcher)
+{
+    std::shared_ptr<Replies> replies = std::make_shared<Replies>();
+    dispatch(dispatcher, makeRequest("Order.makeOrder", makeOrder(3, "async")), replies);
+    assert(replies->m_messages.empty());
+    assert(g_pending_done != NULL);
+    pthread_t thread;
+    pthread_create(&thread, NULL, &runPendingDone, NULL);
+    pthread_join(thread, NULL);
+    assert(replies->m_messages.size() == 1);
+    assert(orderId(replies->m_messages[0]) == "async");
+    printf("test_async_reply ok\n");
+}
+
+//done还在其他线程里执行的时候业务方法就返回了,兜底回包不能再回一次,也不能访问done
+void test_done_race(rocket::RpcDispatcher & dispatcher)
+{
+    rocket::NetAddr::s_ptr addr = std::make_shared<rocket::IPNetAddr>("127.0.0.1", 12345);
+    for (int i = 0; i < 100; ++i)
+    {
+        std::shared_ptr<std::atomic<int>> count = std::make_shared<std::atomic<int>>(0);
+        dispatcher.dispatcher(makeRequest("Order.makeOrder", makeOrder(4, "race")), addr, addr, [count](rocket::AbstractProtocol::s_ptr message) {
+            std::shared_ptr<rocket::TinyPBProtocol> reply = std::dynamic_pointer_cast<rocket::TinyPBProtocol>(message);
+            assert(orderId(reply) == "sync_4");
+            count->fetch_add(1);
+            sem_post(&g_reply_entered);
+            sem_wait(&g_reply_release);
+        });
+        assert(count->load() == 1);
+        sem_post(&g_reply_release);
+        pthread_join(g_race_thread, NULL);
+        assert(count->load() == 1);
+    }
+    printf("test_done_race ok\n");
+}
+
+//找不到服务、方法名不合法、请求解析失败时也会回一个带错误码的包
+void test_error_reply(rocket::RpcDispatcher & dispatcher)
+{
+    std::shared_ptr<Replies> replies = std::make_shared<Replies>();
+    dispatch(dispatcher, makeRequest("Stock.query", makeOrder(1, "sync")), replies);
+    dispatch(dispatcher, makeRequest("makeOrder", makeOrder(1, "sync")), replies);
+    dispatch(dispatcher, makeRequest("Order.makeOrder", "\xff\xff\xff"), replies);
+    dispatch(dispatcher, makeRequest("Order.queryOrder", makeOrder(1, "sync")), replies);
+    assert(replies->m_messages.size() == 4);
+    assert(replies->m_messages[0]->m_err_code == ERROR_SERVICE_NOT_FOUND);
+    assert(replies->m_messages[1]->m_err_code == ERROR_PARSE_SERVICE_NAME);
+    assert(replies->m_messages[2]->m_err_code == ERROR_FAILED_DESERIALIZE);
+    assert(replies->m_messages[3]->m_err_code == ERROR_SERVICE_NOT_FOUND);
+    printf("test_error_reply ok\n");
+}
+
+//注册时为每个方法建好分发表,方法全名优先,其次服务名,最后是默认的线程池;注册前后设置都生效
+void test_method_table()
+{
+    sem_init(&g_reply_entered, 0, 0);
+    sem_init(&g_reply_release, 0, 0);
+    rocket::RpcDispatcher dispatcher;
+    rocket::RpcWorkerPool::s_ptr default_pool = std::make_shared<rocket::RpcWorkerPool>(1);
+    dispatcher.setWorkerPool("", default_pool);
+    assert(dispatcher.findMethod("Order.makeOrder") == NULL);
+
+    dispatcher.registerService(std::make_shared<OrderImpl>());
+    const rocket::RpcMethodEntry * entry = dispatcher.findMethod("Order.makeOrder");
+    assert(entry != NULL);
+    assert(entry->m_method->name() == "makeOrder");
+    assert(entry->m_request_prototype == &makeOrderRequest::default_instance());
+    assert(entry->m_response_prototype == &makeOrderResponse::default_instance());
+    assert(entry->m_worker_pool == default_pool.get());
+    assert(dispatcher.findMethod("Order.queryOrder") == NULL);
+    assert(dispatcher.findMethod("Order") == NULL);
+
+    rocket::RpcWorkerPool::s_ptr service_pool = std::make_shared<rocket::RpcWorkerPool>(1);
+    dispatcher.setWorkerPool("Order", service_pool);
+    assert(entry->m_worker_pool == service_pool.get());
+    rocket::RpcWorkerPool::s_ptr method_pool = std::make_shared<rocket::RpcWorkerPool>(1);
+    dispatcher.setWorkerPool("Order.makeOrder", method_pool);
+    assert(entry->m_worker_pool == method_pool.get());
+    printf("test_method_table ok\n");
+}
+
+//开了对象池之后请求和响应从池里取,回包释放后放回去,下一个请求复用
+void test_message_pool(rocket::RpcDispatcher & dispatcher)
+{
+    rocket::RpcMessagePool::SetMaxSize(4);
+    uint64_t hit = rocket::RpcMessagePool::GetHitCount();
+    for (int i = 0; i < 3; ++i)
+    {
+        std::shared_ptr<Replies> replies = std::make_shared<Replies>();
+        dispatch(dispatcher, makeRequest("Order.makeOrder", makeOrder(i, "sync")), replies);
+        assert(replies->m_messages.size() == 1);
+        assert(orderId(replies->m_messages[0]) == "sync_" + std::to_string(i));
+        assert(replies->m_messages[0]->m_pb_message->GetArena() == NULL);
+    }
+    //第一次请求和响应都没命中,后面两次都命中
+    assert(rocket::RpcMessagePool::GetHitCount() == hit + 4);
+    rocket::RpcMessagePool::SetMaxSize(0);
+    printf("test_message_pool ok\n");
+}
+
+int main()
+{
+    rocket::Config::SetGlobalConfig("conf/rocket.xml");
+    rocket::Logger::InitGlobalLogger();
+
+    sem_init(&g_reply_entered, 0, 0);
+    sem_init(&g_reply_release, 0, 0);
+    rocket::RpcDispatcher dispatcher;
+    dispatcher.registerService(std::make_shared<OrderImpl>());
+    test_sync_reply(dispatcher);
+    test_async_reply(dispatcher);
+    test_done_race(dispatcher);
+    test_error_reply(dispatcher);
+    test_method_table();
+    test_message_pool(dispatcher);
+    return 0;
+}
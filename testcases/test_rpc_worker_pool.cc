@@ -0,0 +1,113 @@
+#include <pthread.h>
+#include <assert.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <atomic>
+#include <set>
+#include <vector>
+#include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/common/mutex.h"
+#include "rocket/net/eventloop.h"
+#include "rocket/net/timer_event.h"
+#include "rocket/net/rpc/rpc_worker_pool.h"
+
+static rocket::RpcWorkerPool * g_pool = NULL;
+static std::atomic<int> g_done {0};
+static rocket::Mutex g_mutex;
+static std::set<pthread_t> g_threads;
+
+static const int PRODUCER_COUNT = 4;
+static const int TASK_COUNT = 1000;
+
+void * produce(void *)
+{
+    for (int i = 0; i < TASK_COUNT; ++i)
+    {
+        g_pool->addTask([]() {
+            rocket::ScopeMutex<rocket::Mutex> lock(g_mutex);
+            g_threads.insert(pthread_self());
+            lock.unlock();
+            g_done++;
+        });
+    }
+    return NULL;
+}
+
+//多个线程同时投递任务,每个任务都在业务线程里执行一次
+void test_run_tasks()
+{
+    rocket::RpcWorkerPool pool(3);
+    assert(pool.size() == 3);
+    g_pool = &pool;
+    std::vector<pthread_t> producers(PRODUCER_COUNT);
+    for (int i = 0; i < PRODUCER_COUNT; ++i)
+    {
+        pthread_create(&producers[i], NULL, &produce, NULL);
+    }
+    for (int i = 0; i < PRODUCER_COUNT; ++i)
+    {
+        pthread_join(producers[i], NULL);
+    }
+    for (int i = 0; i < 500 && g_done < PRODUCER_COUNT * TASK_COUNT; ++i)
+    {
+        usleep(10000);
+    }
+    assert(g_done == PRODUCER_COUNT * TASK_COUNT);
+    assert(pool.getQueueSize() == 0);
+    assert(!g_threads.empty() && g_threads.size() <= 3);
+    assert(g_threads.count(pthread_self()) == 0);
+    g_pool = NULL;
+    printf("test_run_tasks ok\n");
+}
+
+//析构时已经投递的任务都会执行完
+void test_drain_on_destroy()
+{
+    std::atomic<int> done {0};
+    rocket::RpcWorkerPool * pool = new rocket::RpcWorkerPool(1);
+    for (int i = 0; i < 100; ++i)
+    {
+        pool->addTask([&done]() {
+            usleep(100);
+            done++;
+        });
+    }
+    delete pool;
+    assert(done == 100);
+    printf("test_drain_on_destroy ok\n");
+}
+
+//业务线程上有EventLoop,任务里可以注册定时器等待异步结果,比如发起下游rpc
+void test_loop_in_worker()
+{
+    rocket::RpcWorkerPool pool(1);
+    std::atomic<bool> fired {false};
+    std::atomic<bool> same_thread {false};
+    pool.addTask([&fired, &same_thread]() {
+        rocket::EventLoop * loop = rocket::EventLoop::GetCurrentEventLoop();
+        pthread_t self = pthread_self();
+        rocket::TimerEvent::s_ptr timer = std::make_shared<rocket::TimerEvent>(20, false, [&fired, &same_thread, self]() {
+            same_thread = pthread_equal(self, pthread_self()) != 0;
+            fired = true;
+        });
+        loop->addTimerEvent(timer);
+    });
+    for (int i = 0; i < 100 && !fired; ++i)
+    {
+        usleep(10000);
+    }
+    assert(fired && same_thread);
+    printf("test_loop_in_worker ok\n");
+}
+
+int main()
+{
+    rocket::Config::SetGlobalConfig("conf/rocket.xml");
+    rocket::Logger::InitGlobalLogger();
+
+    test_run_tasks();
+    test_drain_on_destroy();
+    test_loop_in_worker();
+    return 0;
+}
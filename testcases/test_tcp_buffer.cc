@@ -0,0 +1,203 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <string>
+#include <vector>
+#include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/net/tcp/tcp_buffer.h"
+
+static std::string readAll(rocket::TcpBuffer & buffer)
+{
+    std::vector<char> out;
+    buffer.readFromBuffer(out, buffer.readAble());
+    return std::string(out.begin(), out.end());
+}
+
+//把读位置推到pos处,缓冲区里只剩一个字节"#"
+static void moveTo(rocket::TcpBuffer & buffer, int pos)
+{
+    std::string filler(pos, 'f');
+    buffer.writeToBuffer(filler.data(), pos);
+    buffer.writeToBuffer("#", 1);
+    buffer.moveReadIndex(pos);
+    assert(buffer.readIndex() == pos && buffer.readAble() == 1);
+    char c = 0;
+    buffer.peek(&c, 1);
+    assert(c == '#');
+}
+
+//容量向上取整到2的幂次,读空之后读位置归零
+void test_capacity()
+{
+    rocket::TcpBuffer buffer(100);
+    assert(buffer.capacity() == 128);
+    assert(buffer.readAble() == 0 && buffer.writeAble() == 128);
+    buffer.writeToBuffer("hello", 5);
+    assert(buffer.readAble() == 5 && buffer.writeIndex() == 5);
+    buffer.moveReadIndex(3);
+    assert(buffer.readIndex() == 3);
+    buffer.moveReadIndex(2);
+    assert(buffer.readIndex() == 0 && buffer.writeIndex() == 0);
+    //移动距离超过可读字节数时按可读字节数算
+    buffer.writeToBuffer("ab", 2);
+    buffer.moveReadIndex(10);
+    assert(buffer.readAble() == 0);
+    printf("test_capacity ok\n");
+}
+
+//写入跨越环尾,读出来的顺序不变,容量不变
+void test_wrap()
+{
+    rocket::TcpBuffer buffer(64);
+    moveTo(buffer, 60);
+    buffer.writeToBuffer("0123456789", 10);
+    assert(buffer.capacity() == 64);
+    assert(buffer.readIndex() == 60 && buffer.writeIndex() == 7);
+
+    struct iovec iov[2];
+    assert(buffer.readIovec(iov) == 2);
+    assert(iov[0].iov_len == 4 && memcmp(iov[0].iov_base, "#012", 4) == 0);
+    assert(iov[1].iov_len == 7 && memcmp(iov[1].iov_base, "3456789", 7) == 0);
+    assert(buffer.writeIovec(iov) == 1);
+    assert(iov[0].iov_len == 53);
+
+    char tmp[6];
+    buffer.peek(tmp, 6, 2);
+    assert(memcmp(tmp, "123456", 6) == 0);
+    assert(buffer.readAble() == 11);
+    assert(readAll(buffer) == "#0123456789");
+    printf("test_wrap ok\n");
+}
+
+//可写区域跨越环尾时writeIovec返回两段,写完用moveWriteIndex提交
+void test_write_iovec()
+{
+    rocket::TcpBuffer buffer(64);
+    moveTo(buffer, 40);
+    struct iovec iov[2];
+    assert(buffer.writeIovec(iov) == 2);
+    assert(iov[0].iov_len == 23 && iov[1].iov_len == 40);
+    std::string data(30, 'a');
+    for (int i = 0; i < 30; ++i)
+    {
+        data[i] = 'a' + i % 26;
+    }
+    memcpy(iov[0].iov_base, data.data(), 23);
+    memcpy(iov[1].iov_base, data.data() + 23, 7);
+    buffer.moveWriteIndex(30);
+    assert(readAll(buffer) == "#" + data);
+    printf("test_write_iovec ok\n");
+}
+
+//扩容和缩容都保留数据,数据跨越环尾也一样
+void test_grow_and_shrink()
+{
+    rocket::TcpBuffer buffer(64);
+    moveTo(buffer, 50);
+    std::string data;
+    for (int i = 0; i < 1000; ++i)
+    {
+        data.push_back('A' + i % 26);
+    }
+    buffer.writeToBuffer(data.data(), 30);
+    assert(buffer.capacity() == 64);
+    //再写就放不下了,扩容
+    buffer.writeToBuffer(data.data() + 30, data.length() - 30);
+    assert(buffer.capacity() >= 1001);
+    assert(buffer.readAble() == 1001);
+
+    std::vector<char> out;
+    buffer.readFromBuffer(out, 901);
+    assert(std::string(out.begin(), out.end()) == "#" + data.substr(0, 900));
+    //缩容不能丢掉剩下的100个字节
+    buffer.resizeBuffer(16);
+    assert(buffer.capacity() == 128);
+    assert(readAll(buffer) == data.substr(900));
+    printf("test_grow_and_shrink ok\n");
+}
+
+//peekContiguous在不跨环尾时直接返回环里的地址,跨越时返回拷贝
+void test_peek_contiguous()
+{
+    rocket::TcpBuffer buffer(64);
+    moveTo(buffer, 56);
+    buffer.writeToBuffer("0123456789ab", 12);
+    const char * head = buffer.peekContiguous(4, 1);
+    assert(memcmp(head, "0123", 4) == 0);
+    const char * wrap = buffer.peekContiguous(10, 1);
+    assert(memcmp(wrap, "0123456789", 10) == 0);
+    //前面的指针是环里的,不受临时区影响
+    assert(memcmp(head, "0123", 4) == 0);
+    assert(buffer.peekContiguous(20, 0) == NULL);
+    assert(buffer.readAble() == 13);
+    printf("test_peek_contiguous ok\n");
+}
+
+//reserveWrite在环尾放得下时直接写环,放不下时走临时区,commitWrite之后结果一样
+void test_reserve_write()
+{
+    rocket::TcpBuffer buffer(64);
+    moveTo(buffer, 10);
+    char * p = buffer.reserveWrite(8);
+    memcpy(p, "abcdefgh", 8);
+    buffer.commitWrite(8);
+    assert(readAll(buffer) == "#abcdefgh");
+
+    rocket::TcpBuffer wrap(64);
+    moveTo(wrap, 58);
+    p = wrap.reserveWrite(12);
+    memcpy(p, "0123456789xy", 12);
+    wrap.commitWrite(12);
+    assert(wrap.capacity() == 64);
+    assert(wrap.writeIndex() == 7);
+    assert(readAll(wrap) == "#0123456789xy");
+
+    //放不下就先扩容
+    rocket::TcpBuffer small(8);
+    moveTo(small, 4);
+    p = small.reserveWrite(100);
+    memset(p, 'z', 100);
+    small.commitWrite(100);
+    assert(small.capacity() >= 101);
+    assert(readAll(small) == "#" + std::string(100, 'z'));
+    printf("test_reserve_write ok\n");
+}
+
+//预留期间可以peek,跨环尾peek拿到的地址在之后的预留和提交之后仍然有效
+void test_reserve_then_peek()
+{
+    rocket::TcpBuffer buffer(64);
+    moveTo(buffer, 58);
+    char * p = buffer.reserveWrite(12);
+    memcpy(p, "0123456789xy", 12);
+    const char * head = buffer.peekContiguous(1);
+    assert(*head == '#');
+    buffer.commitWrite(12);
+
+    const char * wrap = buffer.peekContiguous(13);
+    assert(memcmp(wrap, "#0123456789xy", 13) == 0);
+    p = buffer.reserveWrite(4);
+    memcpy(p, "abcd", 4);
+    buffer.commitWrite(4);
+    assert(memcmp(wrap, "#0123456789xy", 13) == 0);
+    assert(buffer.capacity() == 64);
+    assert(readAll(buffer) == "#0123456789xyabcd");
+    printf("test_reserve_then_peek ok\n");
+}
+
+int main()
+{
+    rocket::Config::SetGlobalConfig("conf/rocket.xml");
+    rocket::Logger::InitGlobalLogger();
+
+    test_capacity();
+    test_wrap();
+    test_write_iovec();
+    test_grow_and_shrink();
+    test_peek_contiguous();
+    test_reserve_write();
+    test_reserve_then_peek();
+    return 0;
+}
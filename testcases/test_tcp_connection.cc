@@ -0,0 +1,313 @@
+#include <pthread.h>
+#include <semaphore.h>
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/net/io_thread.h"
+#include "rocket/net/tcp/net_addr.h"
+#include "rocket/net/tcp/tcp_connection.h"
+#include "rocket/net/coder/tinypb_protocol.h"
+
+static rocket::IOThread * g_io_thread = NULL;
+static sem_t g_step_done;
+static sem_t g_message_done;
+
+//连接只能在所属的IO线程里操作,每一步都放到loop线程执行
+void runInLoop(std::function<void()> fn)
+{
+    g_io_thread->getEventLoop()->addTask([fn]() {
+        fn();
+        sem_post(&g_step_done);
+    }, true);
+    sem_wait(&g_step_done);
+}
+
+//最多等5秒,等不到说明数据没有收全
+bool waitMessage()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += 5;
+    return sem_timedwait(&g_message_done, &ts) == 0;
+}
+
+static void appendInt32(std::string & out, int32_t value)
+{
+    int32_t net = htonl(value);
+    out.append(reinterpret_cast<const char *>(&net), sizeof(net));
+}
+
+static std::string buildFrame(const std::string & msg_id, const std::string & pb_data)
+{
+    std::string method_name = "Order.makeOrder";
+    int32_t pk_len = 2 + 24 + msg_id.length() + method_name.length() + pb_data.length();
+    std::string frame;
+    frame.push_back(rocket::TinyPBProtocol::PB_START);
+    appendInt32(frame, pk_len);
+    appendInt32(frame, msg_id.length());
+    frame += msg_id;
+    appendInt32(frame, method_name.length());
+    frame += method_name;
+    appendInt32(frame, 0);
+    appendInt32(frame, 0);
+    frame += pb_data;
+    appendInt32(frame, 1);
+    frame.push_back(rocket::TinyPBProtocol::PB_END);
+    return frame;
+}
+
+static std::string makePayload(int size)
+{
+    std::string data(size, 0);
+    for (int i = 0; i < size; ++i)
+    {
+        data[i] = 'a' + i % 26;
+    }
+    return data;
+}
+
+rocket::TcpConnection::s_ptr createConnection(int fd)
+{
+    rocket::NetAddr::s_ptr addr = std::make_shared<rocket::IPNetAddr>("127.0.0.1", 12345);
+    rocket::TcpConnection::s_ptr connection = std::make_shared<rocket::TcpConnection>(g_io_thread->getEventLoop(), fd, 128, addr, addr, rocket::TcpConnectionByClient);
+    connection->setState(rocket::Connected);
+    return connection;
+}
+
+//一个远大于socket发送缓冲区的包,writev会写一部分返回EAGAIN,等可写之后接着发,对端收到的字节完整有序
+void test_partial_write()
+{
+    int fds[2];
+    int rt = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    assert(rt == 0);
+    int sndbuf = 4096;
+    setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+    std::string payload = makePayload(4 * 1024 * 1024);
+    std::string expect = buildFrame("80001", payload) + buildFrame("80002", "tail");
+    rocket::TcpConnection::s_ptr connection;
+    int write_done = 0;
+    runInLoop([&]() {
+        connection = createConnection(fds[0]);
+        for (int i = 0; i < 2; ++i)
+        {
+            std::shared_ptr<rocket::TinyPBProtocol> message = std::make_shared<rocket::TinyPBProtocol>();
+            message->m_msg_id = i == 0 ? "80001" : "80002";
+            message->m_method_name = "Order.makeOrder";
+            message->m_pb_data = i == 0 ? payload : "tail";
+            connection->pushSendMessage(message, [&write_done](rocket::AbstractProtocol::s_ptr) {
+                write_done++;
+            });
+        }
+        connection->listenWrite();
+    });
+
+    //慢慢读,让发送端多次遇到缓冲区满
+    std::string received;
+    char buf[8192];
+    while (received.length() < expect.length())
+    {
+        int n = read(fds[1], buf, sizeof(buf));
+        assert(n > 0);
+        received.append(buf, n);
+    }
+    assert(received == expect);
+
+    runInLoop([&]() {
+        assert(write_done == 2);
+        connection->clear();
+        connection.reset();
+    });
+    close(fds[0]);
+    close(fds[1]);
+    printf("test_partial_write ok\n");
+}
+
+//小块分多次到达的包和超过输入缓冲区加溢出区大小的包都能读完整
+void test_chunked_read()
+{
+    int fds[2];
+    int rt = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    assert(rt == 0);
+
+    std::string small_payload = "chunked payload";
+    std::string large_payload = makePayload(300 * 1024);
+    std::string small_data;
+    std::string large_data;
+    rocket::TcpConnection::s_ptr connection;
+    runInLoop([&]() {
+        connection = createConnection(fds[0]);
+        connection->pushReadMessage("90001", [&small_data](rocket::AbstractProtocol::s_ptr message) {
+            std::shared_ptr<rocket::TinyPBProtocol> pb = std::dynamic_pointer_cast<rocket::TinyPBProtocol>(message);
+            small_data.assign(pb->pbData(), pb->pbDataLen());
+            sem_post(&g_message_done);
+        });
+        connection->pushReadMessage("90002", [&large_data](rocket::AbstractProtocol::s_ptr message) {
+            std::shared_ptr<rocket::TinyPBProtocol> pb = std::dynamic_pointer_cast<rocket::TinyPBProtocol>(message);
+            large_data.assign(pb->pbData(), pb->pbDataLen());
+            sem_post(&g_message_done);
+        });
+        connection->listenRead();
+    });
+
+    std::string frame = buildFrame("90001", small_payload);
+    for (size_t i = 0; i < frame.length(); i += 7)
+    {
+        size_t n = std::min((size_t)7, frame.length() - i);
+        assert(write(fds[1], frame.data() + i, n) == (ssize_t)n);
+        usleep(1000);
+    }
+    assert(waitMessage());
+    assert(small_data == small_payload);
+
+    frame = buildFrame("90002", large_payload);
+    size_t written = 0;
+    while (written < frame.length())
+    {
+        ssize_t n = write(fds[1], frame.data() + written, frame.length() - written);
+        assert(n > 0);
+        written += n;
+    }
+    assert(waitMessage());
+    assert(large_data == large_payload);
+
+    //对端关闭之后连接进入Closed状态
+    close(fds[1]);
+    for (int i = 0; i < 100; ++i)
+    {
+        bool closed = false;
+        runInLoop([&]() {
+            closed = connection->getState() == rocket::Closed;
+        });
+        if (closed)
+        {
+            break;
+        }
+        usleep(10000);
+    }
+    runInLoop([&]() {
+        assert(connection->getState() == rocket::Closed);
+        connection.reset();
+    });
+    close(fds[0]);
+    printf("test_chunked_read ok\n");
+}
+
+//回包按msg_id匹配,顺序可以和请求不同;取消了的请求迟到的回包直接丢掉
+void test_out_of_order_and_cancel()
+{
+    int fds[2];
+    int rt = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    assert(rt == 0);
+
+    std::string received;
+    int pending = 0;
+    rocket::TcpConnection::s_ptr connection;
+    runInLoop([&]() {
+        connection = createConnection(fds[0]);
+        const char * ids[] = {"70001", "70002", "70003"};
+        for (int i = 0; i < 3; ++i)
+        {
+            connection->pushReadMessage(ids[i], [&received](rocket::AbstractProtocol::s_ptr message) {
+                received += message->m_msg_id + ";";
+                sem_post(&g_message_done);
+            });
+        }
+        connection->cancelReadMessage("70002");
+        pending = connection->getPendingReadCount();
+        connection->listenRead();
+    });
+    assert(pending == 2);
+
+    std::string frames = buildFrame("70003", "c") + buildFrame("70002", "b") + buildFrame("70001", "a");
+    assert(write(fds[1], frames.data(), frames.length()) == (ssize_t)frames.length());
+    assert(waitMessage());
+    assert(waitMessage());
+    runInLoop([&]() {
+        pending = connection->getPendingReadCount();
+    });
+    assert(received == "70003;70001;");
+    assert(pending == 0);
+
+    runInLoop([&]() {
+        connection->clear();
+        connection.reset();
+    });
+    close(fds[0]);
+    close(fds[1]);
+    printf("test_out_of_order_and_cancel ok\n");
+}
+
+//在写完成回调里再发的请求,下一轮会发出去,不会被清掉
+void test_send_from_write_callback()
+{
+    int fds[2];
+    int rt = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    assert(rt == 0);
+
+    std::string expect = buildFrame("60001", "first") + buildFrame("60002", "second");
+    rocket::TcpConnection::s_ptr connection;
+    runInLoop([&]() {
+        connection = createConnection(fds[0]);
+        std::shared_ptr<rocket::TinyPBProtocol> first = std::make_shared<rocket::TinyPBProtocol>();
+        first->m_msg_id = "60001";
+        first->m_method_name = "Order.makeOrder";
+        first->m_pb_data = "first";
+        rocket::TcpConnection * raw = connection.get();
+        connection->pushSendMessage(first, [raw](rocket::AbstractProtocol::s_ptr) {
+            std::shared_ptr<rocket::TinyPBProtocol> second = std::make_shared<rocket::TinyPBProtocol>();
+            second->m_msg_id = "60002";
+            second->m_method_name = "Order.makeOrder";
+            second->m_pb_data = "second";
+            raw->pushSendMessage(second, [](rocket::AbstractProtocol::s_ptr) {});
+            raw->listenWrite();
+        });
+        connection->listenWrite();
+    });
+
+    std::string received;
+    char buf[256];
+    while (received.length() < expect.length())
+    {
+        int n = read(fds[1], buf, sizeof(buf));
+        assert(n > 0);
+        received.append(buf, n);
+    }
+    assert(received == expect);
+
+    runInLoop([&]() {
+        connection->clear();
+        connection.reset();
+    });
+    close(fds[0]);
+    close(fds[1]);
+    printf("test_send_from_write_callback ok\n");
+}
+
+int main()
+{
+    rocket::Config::SetGlobalConfig("conf/rocket.xml");
+    rocket::Logger::InitGlobalLogger();
+
+    sem_init(&g_step_done, 0, 0);
+    sem_init(&g_message_done, 0, 0);
+    g_io_thread = new rocket::IOThread();
+    g_io_thread->start();
+
+    test_partial_write();
+    test_chunked_read();
+    test_out_of_order_and_cancel();
+    test_send_from_write_callback();
+
+    delete g_io_thread;
+    return 0;
+}
@@ -0,0 +1,297 @@
+#include <semaphore.h>
+#include <assert.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <functional>
+#include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/common/util.h"
+#include "rocket/net/io_thread.h"
+#include "rocket/net/tcp/net_addr.h"
+#include "rocket/net/tcp/tcp_connection.h"
+#include "rocket/net/tcp/tcp_connection_manager.h"
+#include "rocket/net/coder/tinypb_coder.h"
+#include "rocket/net/coder/tinypb_protocol.h"
+#include "rocket/net/rpc/rpc_controller.h"
+#include "rocket/net/rpc/rpc_dispatcher.h"
+#include "order.pb.h"
+
+static sem_t g_step_done;
+static std::atomic<google::protobuf::Closure *> g_pending_done {NULL};
+
+//业务方法异步执行,done留给测试在其他线程里执行
+class OrderImpl : public Order
+{
+public:
+    void makeOrder(google::protobuf::RpcController * controller,
+                       const ::makeOrderRequest* request,
+                       ::makeOrderResponse* response,
+                       ::google::protobuf::Closure* done)
+    {
+        dynamic_cast<rocket::RpcController *>(controller)->StartAsync();
+        response->set_order_id("async");
+        g_pending_done = done;
+    }
+};
+
+void runInLoop(rocket::EventLoop * loop, std::function<void()> fn)
+{
+    loop->addTask([fn]() {
+        fn();
+        sem_post(&g_step_done);
+    }, true);
+    sem_wait(&g_step_done);
+}
+
+//非阻塞读一次对端:1 读到数据,0 EOF,-1 暂时没有数据
+int peekPeer(int fd)
+{
+    char buf[64];
+    int rt = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+    if (rt > 0)
+    {
+        return 1;
+    }
+    if (rt == 0)
+    {
+        return 0;
+    }
+    assert(errno == EAGAIN || errno == EWOULDBLOCK);
+    return -1;
+}
+
+rocket::TcpConnection::s_ptr newServerConnection(rocket::EventLoop * loop, int fd)
+{
+    rocket::NetAddr::s_ptr addr = std::make_shared<rocket::IPNetAddr>("127.0.0.1", 12345);
+    rocket::TcpConnection::s_ptr connection = std::make_shared<rocket::TcpConnection>(loop, fd, 128, addr, addr);
+    connection->setState(rocket::Connected);
+    connection->listenRead();
+    return connection;
+}
+
+//一直没有读写的连接被shutdown,对端读到EOF;对端不关的话下一轮扫描直接清掉
+//一直有数据来的连接不会被关
+void test_idle_reap()
+{
+    rocket::IOThread io_thread;
+    io_thread.start();
+    rocket::EventLoop * loop = io_thread.getEventLoop();
+    int idle_fds[2];
+    int busy_fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, idle_fds) == 0);
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, busy_fds) == 0);
+
+    rocket::TcpConnectionManager * manager = NULL;
+    runInLoop(loop, [&]() {
+        manager = new rocket::TcpConnectionManager(loop, 300, 128);
+        manager->addConnection(newServerConnection(loop, idle_fds[0]));
+        manager->addConnection(newServerConnection(loop, busy_fds[0]));
+    });
+    int size = 0;
+    runInLoop(loop, [&]() {
+        size = manager->size();
+    });
+    assert(size == 2);
+
+    //扫描间隔1s,3.5s内空闲连接一定经历了shutdown和clear
+    int64_t begin = rocket::getNowUs();
+    bool idle_closed = false;
+    while (rocket::getNowUs() - begin < 3500 * 1000)
+    {
+        //不是合法的协议包,解码时直接丢掉,但是算作活跃
+        assert(write(busy_fds[1], "x", 1) == 1);
+        if (!idle_closed && peekPeer(idle_fds[1]) == 0)
+        {
+            idle_closed = true;
+        }
+        assert(peekPeer(busy_fds[1]) == -1);
+        usleep(50 * 1000);
+    }
+    assert(idle_closed);
+    runInLoop(loop, [&]() {
+        size = manager->size();
+    });
+    assert(size == 1);
+    assert(fcntl(idle_fds[0], F_GETFD) == -1);
+
+    //先关掉剩下的连接,等管理器把它删掉再析构
+    close(busy_fds[1]);
+    for (int i = 0; i < 100 && size != 0; ++i)
+    {
+        usleep(10 * 1000);
+        runInLoop(loop, [&]() {
+            size = manager->size();
+        });
+    }
+    assert(size == 0);
+    runInLoop(loop, [&]() {
+        delete manager;
+    });
+    close(idle_fds[1]);
+    printf("test_idle_reap ok\n");
+}
+
+//idle_timeout为0时不关空闲连接
+void test_idle_disabled()
+{
+    rocket::IOThread io_thread;
+    io_thread.start();
+    rocket::EventLoop * loop = io_thread.getEventLoop();
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+    rocket::TcpConnectionManager * manager = NULL;
+    rocket::TcpConnection::s_ptr connection;
+    runInLoop(loop, [&]() {
+        manager = new rocket::TcpConnectionManager(loop, 0, 128);
+        connection = newServerConnection(loop, fds[0]);
+        manager->addConnection(connection);
+    });
+    usleep(2200 * 1000);
+    assert(peekPeer(fds[1]) == -1);
+    int size = 0;
+    runInLoop(loop, [&]() {
+        size = manager->size();
+        connection->clear();
+    });
+    assert(size == 1);
+    assert(peekPeer(fds[1]) == 0);
+    //clear通知管理器,下一轮事件循环里删掉
+    runInLoop(loop, []() {});
+    runInLoop(loop, [&]() {
+        size = manager->size();
+        connection.reset();
+        delete manager;
+    });
+    assert(size == 0);
+    close(fds[1]);
+    printf("test_idle_disabled ok\n");
+}
+
+//shutdown之后socket一直可读,下一次读事件就清掉连接,不用等下一轮扫描
+void test_shutdown_then_read()
+{
+    rocket::IOThread io_thread;
+    io_thread.start();
+    rocket::EventLoop * loop = io_thread.getEventLoop();
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+    rocket::TcpConnectionManager * manager = NULL;
+    rocket::TcpConnection::s_ptr connection;
+    runInLoop(loop, [&]() {
+        manager = new rocket::TcpConnectionManager(loop, 0, 128);
+        connection = newServerConnection(loop, fds[0]);
+        manager->addConnection(connection);
+        connection->shutdown();
+        assert(connection->getState() == rocket::HalfClosing);
+    });
+    //对端不关,扫描间隔是1s,200ms内被删掉说明是读事件触发的
+    int size = 1;
+    for (int i = 0; i < 20 && size != 0; ++i)
+    {
+        usleep(10 * 1000);
+        runInLoop(loop, [&]() {
+            size = manager->size();
+        });
+    }
+    assert(size == 0);
+    assert(connection->getState() == rocket::Closed);
+    assert(peekPeer(fds[1]) == 0);
+    runInLoop(loop, [&]() {
+        connection.reset();
+        delete manager;
+    });
+    close(fds[1]);
+    printf("test_shutdown_then_read ok\n");
+}
+
+//请求还没回包的连接不算空闲,回包之后重新计时,再空闲才被关掉
+void test_pending_reply_not_idle()
+{
+    rocket::IOThread io_thread;
+    io_thread.start();
+    rocket::EventLoop * loop = io_thread.getEventLoop();
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+    rocket::TcpConnectionManager * manager = NULL;
+    rocket::TcpConnection::s_ptr connection;
+    runInLoop(loop, [&]() {
+        manager = new rocket::TcpConnectionManager(loop, 300, 128);
+        connection = newServerConnection(loop, fds[0]);
+        manager->addConnection(connection);
+    });
+
+    makeOrderRequest order;
+    order.set_price(1);
+    std::shared_ptr<rocket::TinyPBProtocol> request = std::make_shared<rocket::TinyPBProtocol>();
+    request->m_msg_id = "50001";
+    request->m_method_name = "Order.makeOrder";
+    order.SerializeToString(&request->m_pb_data);
+    std::vector<rocket::AbstractProtocol::s_ptr> messages(1, request);
+    rocket::TcpBuffer::s_ptr out = std::make_shared<rocket::TcpBuffer>(128);
+    rocket::TinyPBCoder coder;
+    coder.encode(messages, out);
+    std::vector<char> bytes;
+    out->readFromBuffer(bytes, out->readAble());
+    assert(write(fds[1], &bytes[0], bytes.size()) == (int)bytes.size());
+
+    //扫描间隔1s,超过两轮扫描都没有读写,但是请求还没回包,连接不能关
+    usleep(2500 * 1000);
+    assert(g_pending_done != NULL);
+    assert(peekPeer(fds[1]) == -1);
+    int pending = 0;
+    runInLoop(loop, [&]() {
+        pending = connection->getPendingReplyCount();
+    });
+    assert(pending == 1);
+
+    //在其他线程里回包
+    g_pending_done.exchange(NULL)->Run();
+    bool replied = false;
+    bool closed = false;
+    int64_t begin = rocket::getNowUs();
+    while (!closed && rocket::getNowUs() - begin < 3500 * 1000)
+    {
+        int rt = peekPeer(fds[1]);
+        replied = replied || rt == 1;
+        closed = rt == 0;
+        usleep(10 * 1000);
+    }
+    assert(replied && closed);
+
+    int size = 1;
+    for (int i = 0; i < 100 && size != 0; ++i)
+    {
+        usleep(10 * 1000);
+        runInLoop(loop, [&]() {
+            size = manager->size();
+        });
+    }
+    assert(size == 0);
+    runInLoop(loop, [&]() {
+        connection.reset();
+        delete manager;
+    });
+    close(fds[1]);
+    printf("test_pending_reply_not_idle ok\n");
+}
+
+int main()
+{
+    rocket::Config::SetGlobalConfig("conf/rocket.xml");
+    rocket::Logger::InitGlobalLogger();
+
+    sem_init(&g_step_done, 0, 0);
+    rocket::RpcDispatcher::GetRpcDispatcher()->registerService(std::make_shared<OrderImpl>());
+    test_idle_reap();
+    test_idle_disabled();
+    test_shutdown_then_read();
+    test_pending_reply_not_idle();
+    return 0;
+}
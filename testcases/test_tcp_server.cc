@@ -0,0 +1,529 @@
+#include <pthread.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <dirent.h>
+#include <sched.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include <google/protobuf/service.h>
+#include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/common/util.h"
+#include "rocket/net/tcp/net_addr.h"
+#include "rocket/net/tcp/tcp_buffer.h"
+#include "rocket/net/tcp/tcp_server.h"
+#include "rocket/net/coder/tinypb_coder.h"
+#include "rocket/net/coder/tinypb_protocol.h"
+#include "rocket/net/rpc/rpc_dispatcher.h"
+#include "rocket/net/rpc/rpc_controller.h"
+#include "order.pb.h"
+
+/*
+    服务端跑在子进程里(重新exec自己,带上场景名),每个场景用自己的配置和端口
+    父进程用原始socket按TinyPB协议发请求,检查服务端的行为
+*/
+
+static const int SLOW_PRICE = 7777;
+static const int ASYNC_PRICE = 8888;
+
+struct AsyncCall {
+    makeOrderResponse * m_response;
+    google::protobuf::Closure * m_done;
+};
+
+//在其他线程里填好响应再执行done
+void * finishAsync(void * arg)
+{
+    AsyncCall * call = static_cast<AsyncCall *>(arg);
+    usleep(50 * 1000);
+    call->m_response->set_order_id("async");
+    call->m_done->Run();
+    delete call;
+    return NULL;
+}
+
+class OrderImpl : public Order
+{
+public:
+    void makeOrder(google::protobuf::RpcController * controller,
+                       const ::makeOrderRequest* request,
+                       ::makeOrderResponse* response,
+                       ::google::protobuf::Closure* done)
+    {
+        if (request->price() == ASYNC_PRICE)
+        {
+            dynamic_cast<rocket::RpcController *>(controller)->StartAsync();
+            AsyncCall * call = new AsyncCall();
+            call->m_response = response;
+            call->m_done = done;
+            pthread_t thread;
+            pthread_create(&thread, NULL, &finishAsync, call);
+            pthread_detach(thread);
+            return;
+        }
+        //模拟慢的业务方法
+        if (request->price() == SLOW_PRICE)
+        {
+            usleep(500 * 1000);
+        }
+        if (request->price() < 10)
+        {
+            response->set_ret_code(-1);
+            response->set_res_info("short balance");
+            return;
+        }
+        response->set_order_id("20230514");
+    }
+};
+
+//子进程:按场景修改配置,启动服务端,不会返回
+void runServer(const std::string & scenario, int port)
+{
+    rocket::Config::SetGlobalConfig("conf/rocket.xml");
+    rocket::Config * config = rocket::Config::GetGlobalConfig();
+    config->m_io_threads = 4;
+    config->m_reuse_port = 0;
+    if (scenario == "reuse_port")
+    {
+        config->m_reuse_port = 1;
+    }
+    if (scenario == "small_batch")
+    {
+        config->m_accept_batch = 4;
+    }
+    if (scenario == "pinned")
+    {
+        //IO线程绑核之后,连接转交给IO线程创建
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        sched_getaffinity(0, sizeof(cpus), &cpus);
+        for (int i = 0; i < CPU_SETSIZE; ++i)
+        {
+            if (CPU_ISSET(i, &cpus))
+            {
+                config->m_io_thread_cpus = std::to_string(i);
+                break;
+            }
+        }
+        config->m_io_placement = "least_conn";
+    }
+    if (scenario == "worker")
+    {
+        //只有一个IO线程,慢方法放在IO线程里会卡住所有连接
+        //业务线程按排队数选,上一个快请求的线程可能还没来得及减计数,多留一个空闲线程
+        config->m_io_threads = 1;
+        config->m_worker_threads = 3;
+        config->m_worker_services = "Order";
+    }
+    rocket::Logger::InitGlobalLogger();
+
+    std::shared_ptr<OrderImpl> service = std::make_shared<OrderImpl>();
+    rocket::RpcDispatcher::GetRpcDispatcher()->registerService(service);
+    rocket::IPNetAddr::s_ptr addr = std::make_shared<rocket::IPNetAddr>("127.0.0.1", port);
+    rocket::TcpServer tcp_server(addr);
+    if (scenario == "emfile")
+    {
+        //等日志线程把日志文件打开,然后只留出几个fd给新连接
+        usleep(1200 * 1000);
+        int open_fds = 0;
+        DIR * dir = opendir("/proc/self/fd");
+        while (readdir(dir) != NULL)
+        {
+            open_fds++;
+        }
+        closedir(dir);
+        struct rlimit limit;
+        getrlimit(RLIMIT_NOFILE, &limit);
+        limit.rlim_cur = open_fds + 4;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    tcp_server.start();
+}
+
+int connectServer(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(fd >= 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_aton("127.0.0.1", &addr.sin_addr);
+    if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    //读回包最多等5秒
+    struct timeval tv;
+    tv.tv_sec = 5;
+    tv.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    return fd;
+}
+
+//父进程:启动子进程,等到能连上为止
+pid_t startServer(const std::string & scenario, int port)
+{
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0)
+    {
+        std::string port_str = std::to_string(port);
+        execl("/proc/self/exe", "test_tcp_server", "server", scenario.c_str(), port_str.c_str(), (char *)NULL);
+        _exit(1);
+    }
+    for (int i = 0; i < 500; ++i)
+    {
+        int fd = connectServer(port);
+        if (fd >= 0)
+        {
+            close(fd);
+            return pid;
+        }
+        usleep(10000);
+    }
+    assert(false);
+    return pid;
+}
+
+void stopServer(pid_t pid)
+{
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+}
+
+//从/proc/net/tcp数出监听在port上的套接字个数
+int countListenSockets(int port)
+{
+    FILE * fp = fopen("/proc/net/tcp", "r");
+    assert(fp != NULL);
+    char line[512];
+    char local[64];
+    char remote[64];
+    unsigned int state = 0;
+    int count = 0;
+    char expect[16];
+    snprintf(expect, sizeof(expect), ":%04X", port);
+    fgets(line, sizeof(line), fp);
+    while (fgets(line, sizeof(line), fp))
+    {
+        if (sscanf(line, "%*d: %63s %63s %x", local, remote, &state) == 3 && state == 0x0A && strstr(local, expect) != NULL)
+        {
+            count++;
+        }
+    }
+    fclose(fp);
+    return count;
+}
+
+static void appendInt32(std::string & out, int32_t value)
+{
+    int32_t net = htonl(value);
+    out.append(reinterpret_cast<const char *>(&net), sizeof(net));
+}
+
+static std::string buildRequest(const std::string & msg_id, const std::string & method_name, const std::string & pb_data)
+{
+    int32_t pk_len = 2 + 24 + msg_id.length() + method_name.length() + pb_data.length();
+    std::string frame;
+    frame.push_back(rocket::TinyPBProtocol::PB_START);
+    appendInt32(frame, pk_len);
+    appendInt32(frame, msg_id.length());
+    frame += msg_id;
+    appendInt32(frame, method_name.length());
+    frame += method_name;
+    appendInt32(frame, 0);
+    appendInt32(frame, 0);
+    frame += pb_data;
+    appendInt32(frame, 1);
+    frame.push_back(rocket::TinyPBProtocol::PB_END);
+    return frame;
+}
+
+static std::string makeOrder(int price)
+{
+    makeOrderRequest request;
+    request.set_price(price);
+    request.set_goods("apple");
+    return request.SerializeAsString();
+}
+
+//同步读一个回包,超时或者对端关闭返回NULL
+std::shared_ptr<rocket::TinyPBProtocol> readResponse(int fd, rocket::TcpBuffer::s_ptr buffer)
+{
+    rocket::TinyPBCoder coder;
+    std::vector<rocket::AbstractProtocol::s_ptr> messages;
+    coder.decode(messages, buffer);
+    while (messages.empty())
+    {
+        char buf[4096];
+        int n = read(fd, buf, sizeof(buf));
+        if (n <= 0)
+        {
+            return NULL;
+        }
+        buffer->writeToBuffer(buf, n);
+        coder.decode(messages, buffer);
+    }
+    assert(messages.size() == 1);
+    std::shared_ptr<rocket::TinyPBProtocol> message = std::dynamic_pointer_cast<rocket::TinyPBProtocol>(messages[0]);
+    message->materialize();
+    return message;
+}
+
+//发一个请求,检查回包
+void callMakeOrder(int fd, const std::string & msg_id, int price)
+{
+    std::string request = buildRequest(msg_id, "Order.makeOrder", makeOrder(price));
+    assert(write(fd, request.data(), request.length()) == (ssize_t)request.length());
+    rocket::TcpBuffer::s_ptr buffer = std::make_shared<rocket::TcpBuffer>(128);
+    std::shared_ptr<rocket::TinyPBProtocol> response = readResponse(fd, buffer);
+    assert(response != NULL);
+    assert(response->m_msg_id == msg_id);
+    assert(response->m_err_code == 0);
+    makeOrderResponse pb;
+    assert(pb.ParseFromArray(response->pbData(), response->pbDataLen()));
+    if (price < 10)
+    {
+        assert(pb.ret_code() == -1 && pb.res_info() == "short balance");
+    }
+    else
+    {
+        assert(pb.order_id() == "20230514");
+    }
+}
+
+//默认只有主线程一个监听套接字
+void test_single_acceptor()
+{
+    int port = 12370;
+    pid_t pid = startServer("default", port);
+    assert(countListenSockets(port) == 1);
+    for (int i = 0; i < 8; ++i)
+    {
+        int fd = connectServer(port);
+        assert(fd >= 0);
+        callMakeOrder(fd, "1000" + std::to_string(i), 100);
+        close(fd);
+    }
+    stopServer(pid);
+    printf("test_single_acceptor ok\n");
+}
+
+//reuse_port模式下每个IO线程一个监听套接字,每个连接都能正常处理请求
+void test_reuse_port()
+{
+    int port = 12371;
+    pid_t pid = startServer("reuse_port", port);
+    assert(countListenSockets(port) == 4);
+    std::vector<int> fds;
+    for (int i = 0; i < 32; ++i)
+    {
+        int fd = connectServer(port);
+        assert(fd >= 0);
+        fds.push_back(fd);
+    }
+    for (size_t i = 0; i < fds.size(); ++i)
+    {
+        callMakeOrder(fds[i], "2000" + std::to_string(i), i % 2 == 0 ? 100 : 5);
+        close(fds[i]);
+    }
+    stopServer(pid);
+    printf("test_reuse_port ok\n");
+}
+
+//一次可读事件最多accept几个连接,积压的连接下一轮继续取,都能得到处理
+void test_accept_batch()
+{
+    int port = 12372;
+    pid_t pid = startServer("small_batch", port);
+    std::vector<int> fds;
+    for (int i = 0; i < 100; ++i)
+    {
+        int fd = connectServer(port);
+        assert(fd >= 0);
+        fds.push_back(fd);
+    }
+    for (size_t i = 0; i < fds.size(); ++i)
+    {
+        callMakeOrder(fds[i], "3000" + std::to_string(i), 100);
+        close(fds[i]);
+    }
+    stopServer(pid);
+    printf("test_accept_batch ok\n");
+}
+
+//进程的CPU时间,单位是时钟滴答
+long cpuTicks(pid_t pid)
+{
+    std::string path = "/proc/" + std::to_string(pid) + "/stat";
+    FILE * fp = fopen(path.c_str(), "r");
+    assert(fp != NULL);
+    long utime = 0;
+    long stime = 0;
+    int rt = fscanf(fp, "%*d %*s %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %ld %ld", &utime, &stime);
+    assert(rt == 2);
+    fclose(fp);
+    return utime + stime;
+}
+
+//fd用完之后,新连接被直接关掉而不是一直挂着,服务端不会空转,已有的连接不受影响
+void test_emfile()
+{
+    int port = 12373;
+    pid_t pid = startServer("emfile", port);
+    std::vector<int> served;
+    int dropped = -1;
+    for (int i = 0; i < 20 && dropped < 0; ++i)
+    {
+        int fd = connectServer(port);
+        assert(fd >= 0);
+        std::string request = buildRequest("4000" + std::to_string(i), "Order.makeOrder", makeOrder(100));
+        assert(write(fd, request.data(), request.length()) == (ssize_t)request.length());
+        struct timeval begin;
+        gettimeofday(&begin, NULL);
+        rocket::TcpBuffer::s_ptr buffer = std::make_shared<rocket::TcpBuffer>(128);
+        if (readResponse(fd, buffer) != NULL)
+        {
+            served.push_back(fd);
+            continue;
+        }
+        //是被服务端关掉的,不是等到读超时
+        struct timeval end;
+        gettimeofday(&end, NULL);
+        assert(end.tv_sec - begin.tv_sec < 3);
+        dropped = fd;
+    }
+    assert(dropped >= 0);
+    assert(!served.empty());
+    close(dropped);
+
+    long begin_ticks = cpuTicks(pid);
+    usleep(1000 * 1000);
+    long used = cpuTicks(pid) - begin_ticks;
+    assert(used < 30);
+
+    for (size_t i = 0; i < served.size(); ++i)
+    {
+        callMakeOrder(served[i], "4100" + std::to_string(i), 100);
+        close(served[i]);
+    }
+    stopServer(pid);
+    printf("test_emfile ok, served %d, cpu %ld ticks in 1s\n", (int)served.size(), used);
+}
+
+//IO线程绑核的时候连接在IO线程里创建,一批同时到来的连接都能正常处理
+void test_pinned_handoff()
+{
+    int port = 12374;
+    pid_t pid = startServer("pinned", port);
+    std::vector<int> fds;
+    for (int i = 0; i < 40; ++i)
+    {
+        int fd = connectServer(port);
+        assert(fd >= 0);
+        fds.push_back(fd);
+    }
+    for (size_t i = 0; i < fds.size(); ++i)
+    {
+        callMakeOrder(fds[i], "5000" + std::to_string(i), 100);
+        close(fds[i]);
+    }
+    stopServer(pid);
+    printf("test_pinned_handoff ok\n");
+}
+
+//业务方法在线程池里执行:慢请求不影响其他连接,同一个连接上后发的快请求先回包
+void test_worker_pool()
+{
+    int port = 12375;
+    pid_t pid = startServer("worker", port);
+    int slow_fd = connectServer(port);
+    int fast_fd = connectServer(port);
+    assert(slow_fd >= 0 && fast_fd >= 0);
+
+    std::string slow = buildRequest("5000", "Order.makeOrder", makeOrder(SLOW_PRICE));
+    assert(write(slow_fd, slow.data(), slow.length()) == (ssize_t)slow.length());
+    usleep(50 * 1000);
+    int64_t begin = rocket::getNowUs();
+    for (int i = 0; i < 10; ++i)
+    {
+        callMakeOrder(fast_fd, "5100" + std::to_string(i), 100);
+    }
+    assert(rocket::getNowUs() - begin < 300 * 1000);
+
+    //同一个连接上,慢请求之后发的快请求先回来
+    std::string fast = buildRequest("5001", "Order.makeOrder", makeOrder(100));
+    assert(write(slow_fd, fast.data(), fast.length()) == (ssize_t)fast.length());
+    rocket::TcpBuffer::s_ptr buffer = std::make_shared<rocket::TcpBuffer>(128);
+    std::shared_ptr<rocket::TinyPBProtocol> first = readResponse(slow_fd, buffer);
+    std::shared_ptr<rocket::TinyPBProtocol> second = readResponse(slow_fd, buffer);
+    assert(first != NULL && first->m_msg_id == "5001");
+    assert(second != NULL && second->m_msg_id == "5000");
+    makeOrderResponse pb;
+    assert(pb.ParseFromArray(second->pbData(), second->pbDataLen()));
+    assert(pb.order_id() == "20230514");
+
+    close(slow_fd);
+    close(fast_fd);
+    stopServer(pid);
+    printf("test_worker_pool ok\n");
+}
+
+//业务方法返回之后在其他线程执行done,回包交回IO线程发送;同一个连接上后面的同步请求不用等它
+void test_async_reply()
+{
+    int port = 12376;
+    pid_t pid = startServer("default", port);
+    int fd = connectServer(port);
+    assert(fd >= 0);
+    std::string async_request = buildRequest("6000", "Order.makeOrder", makeOrder(ASYNC_PRICE));
+    std::string sync_request = buildRequest("6001", "Order.makeOrder", makeOrder(100));
+    std::string both = async_request + sync_request;
+    assert(write(fd, both.data(), both.length()) == (ssize_t)both.length());
+
+    rocket::TcpBuffer::s_ptr buffer = std::make_shared<rocket::TcpBuffer>(128);
+    std::shared_ptr<rocket::TinyPBProtocol> first = readResponse(fd, buffer);
+    std::shared_ptr<rocket::TinyPBProtocol> second = readResponse(fd, buffer);
+    assert(first != NULL && first->m_msg_id == "6001");
+    assert(second != NULL && second->m_msg_id == "6000" && second->m_err_code == 0);
+    makeOrderResponse pb;
+    assert(pb.ParseFromArray(second->pbData(), second->pbDataLen()));
+    assert(pb.order_id() == "async");
+
+    close(fd);
+    stopServer(pid);
+    printf("test_async_reply ok\n");
+}
+
+int main(int argc, char * argv[])
+{
+    if (argc == 4 && std::string(argv[1]) == "server")
+    {
+        runServer(argv[2], atoi(argv[3]));
+        return 0;
+    }
+    rocket::Config::SetGlobalConfig("conf/rocket.xml");
+    rocket::Logger::InitGlobalLogger();
+
+    test_single_acceptor();
+    test_reuse_port();
+    test_accept_batch();
+    test_emfile();
+    test_pinned_handoff();
+    test_worker_pool();
+    test_async_reply();
+    return 0;
+}
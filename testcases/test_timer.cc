@@ -0,0 +1,220 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <semaphore.h>
+#include <vector>
+#include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/common/util.h"
+#include "rocket/net/timer.h"
+#include "rocket/net/timer_event.h"
+#include "rocket/net/io_thread.h"
+
+static const int EVENT_COUNT = 2000;
+
+struct FiredRecord {
+    int64_t m_arrive_time;
+    int m_index;    //加入定时器的顺序
+};
+
+//定时器的4叉堆:按到期时间出堆,到期时间相同时先加入的先执行;取消和删除的不会执行
+void test_timer_order_and_cancel()
+{
+    rocket::Timer timer;
+    //合并到5ms的整数倍,制造大量到期时间相同的任务
+    timer.setSlack(5000);
+
+    std::vector<FiredRecord> fired;
+    std::vector<rocket::TimerEvent::s_ptr> events;
+    std::vector<bool> canceled(EVENT_COUNT, false);
+    srand(12345);
+    for (int i = 0; i < EVENT_COUNT; ++i)
+    {
+        int64_t interval = 1000 + rand() % 50000;
+        rocket::TimerEvent::s_ptr event = std::make_shared<rocket::TimerEvent>(interval, false, [&fired, &events, i]() {
+            FiredRecord record;
+            record.m_arrive_time = events[i]->getArriveTime();
+            record.m_index = i;
+            fired.push_back(record);
+        }, true);
+        events.push_back(event);
+        timer.addTimerEvent(event);
+        assert(event->isPending());
+    }
+    assert(timer.size() == EVENT_COUNT);
+
+    //一部分直接从堆里删掉,一部分只打取消标记,等出堆时丢弃
+    int deleted = 0;
+    for (int i = 0; i < EVENT_COUNT; i += 3)
+    {
+        timer.deleteTimerEvent(events[i]);
+        assert(!events[i]->isPending());
+        canceled[i] = true;
+        deleted++;
+    }
+    for (int i = 1; i < EVENT_COUNT; i += 7)
+    {
+        if (!canceled[i])
+        {
+            events[i]->setCancel(true);
+            canceled[i] = true;
+        }
+    }
+    assert(timer.size() == EVENT_COUNT - deleted);
+
+    //重新加入相当于修改到期时间,堆里不会有两份
+    rocket::TimerEvent::s_ptr moved = events[2];
+    moved->resetArriveTime();
+    timer.addTimerEvent(moved);
+    assert(timer.size() == EVENT_COUNT - deleted);
+
+    //全部到期后一次取出
+    usleep(100 * 1000);
+    timer.onTimer();
+    assert(timer.size() == 0);
+
+    int expect = 0;
+    for (int i = 0; i < EVENT_COUNT; ++i)
+    {
+        if (!canceled[i])
+        {
+            expect++;
+        }
+    }
+    assert((int)fired.size() == expect);
+    for (size_t i = 0; i < fired.size(); ++i)
+    {
+        assert(!canceled[fired[i].m_index]);
+        assert(fired[i].m_arrive_time % 5000 == 0);
+        if (i > 0)
+        {
+            assert(fired[i - 1].m_arrive_time <= fired[i].m_arrive_time);
+            if (fired[i - 1].m_arrive_time == fired[i].m_arrive_time && fired[i].m_index != 2 && fired[i - 1].m_index != 2)
+            {
+                assert(fired[i - 1].m_index < fired[i].m_index);
+            }
+        }
+    }
+    printf("test_timer_order_and_cancel ok, fired %d of %d events\n", (int)fired.size(), EVENT_COUNT);
+}
+
+//周期任务执行后重新入堆,没到期的任务留在堆里
+void test_timer_repeated()
+{
+    rocket::Timer timer;
+    int repeated_count = 0;
+    int later_count = 0;
+    rocket::TimerEvent::s_ptr repeated = std::make_shared<rocket::TimerEvent>(1, true, [&repeated_count]() {
+        repeated_count++;
+    });
+    rocket::TimerEvent::s_ptr later = std::make_shared<rocket::TimerEvent>(10000, false, [&later_count]() {
+        later_count++;
+    });
+    timer.addTimerEvent(repeated);
+    timer.addTimerEvent(later);
+
+    for (int i = 0; i < 3; ++i)
+    {
+        usleep(2 * 1000);
+        timer.onTimer();
+        assert(repeated->isPending());
+    }
+    assert(repeated_count == 3);
+    assert(later_count == 0 && later->isPending());
+    assert(timer.size() == 2);
+
+    timer.deleteTimerEvent(repeated);
+    timer.deleteTimerEvent(later);
+    assert(timer.size() == 0);
+    printf("test_timer_repeated ok\n");
+}
+
+//微秒精度的到期时间,没到期的不执行
+void test_timer_us_precision()
+{
+    rocket::Timer timer;
+    int count = 0;
+    int64_t now = rocket::getNowUs();
+    rocket::TimerEvent::s_ptr event = std::make_shared<rocket::TimerEvent>(1500, false, [&count]() {
+        count++;
+    }, true);
+    assert(event->getArriveTime() >= now + 1500);
+    assert(event->getArriveTime() - now < 1500 + 1000);
+    timer.addTimerEvent(event);
+    timer.onTimer();
+    assert(count == 0);
+    usleep(2000);
+    timer.onTimer();
+    assert(count == 1 && timer.size() == 0);
+    printf("test_timer_us_precision ok\n");
+}
+
+//在loop里timerfd按绝对时间设置,几毫秒的定时任务按时执行,不会拖到100ms之后
+void test_timer_in_loop()
+{
+    rocket::IOThread io_thread;
+    io_thread.start();
+    sem_t fired;
+    sem_init(&fired, 0, 0);
+    int64_t fired_at = 0;
+    int64_t begin = rocket::getNowUs();
+    rocket::TimerEvent::s_ptr event = std::make_shared<rocket::TimerEvent>(3, false, [&fired, &fired_at]() {
+        fired_at = rocket::getNowUs();
+        sem_post(&fired);
+    });
+    io_thread.getEventLoop()->addTimerEvent(event);
+    sem_wait(&fired);
+    assert(fired_at - begin >= 3000);
+    assert(fired_at - begin < 50 * 1000);
+    sem_destroy(&fired);
+    printf("test_timer_in_loop ok, fired after %lld us\n", (long long)(fired_at - begin));
+}
+
+//到期时间落在同一个slack区间内的定时任务只设置一次timerfd,而且不会提前
+void test_timer_slack_arm()
+{
+    for (int slack = 0; slack <= 20000; slack += 20000)
+    {
+        rocket::Timer timer;
+        timer.setSlack(slack);
+        std::vector<rocket::TimerEvent::s_ptr> events;
+        //每个新任务都比之前的早到期,不合并的话每次都要重新设置timerfd
+        for (int i = 0; i < 100; ++i)
+        {
+            int64_t interval = 30000 - i * 100;
+            int64_t now = rocket::getNowUs();
+            rocket::TimerEvent::s_ptr event = std::make_shared<rocket::TimerEvent>(interval, false, []() {}, true);
+            timer.addTimerEvent(event);
+            assert(event->getArriveTime() >= now + interval);
+            assert(event->getArriveTime() < now + interval + slack + 1000);
+            events.push_back(event);
+        }
+        if (slack == 0)
+        {
+            assert(timer.getArmCount() > 50);
+        }
+        else
+        {
+            assert(timer.getArmCount() <= 2);
+        }
+        for (size_t i = 0; i < events.size(); ++i)
+        {
+            timer.deleteTimerEvent(events[i]);
+        }
+    }
+    printf("test_timer_slack_arm ok\n");
+}
+
+int main()
+{
+    rocket::Config::SetGlobalConfig("conf/rocket.xml");
+    rocket::Logger::InitGlobalLogger();
+
+    test_timer_order_and_cancel();
+    test_timer_repeated();
+    test_timer_us_precision();
+    test_timer_in_loop();
+    test_timer_slack_arm();
+    return 0;
+}
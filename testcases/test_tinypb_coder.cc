@@ -0,0 +1,293 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/net/tcp/tcp_buffer.h"
+#include "rocket/net/coder/tinypb_coder.h"
+#include "rocket/net/coder/tinypb_protocol.h"
+#include "order.pb.h"
+
+static void appendInt32(std::string & out, int32_t value)
+{
+    int32_t net = htonl(value);
+    out.append(reinterpret_cast<const char *>(&net), sizeof(net));
+}
+
+//按协议手工拼一个包,不依赖encode
+static std::string buildFrame(const std::string & msg_id, const std::string & method_name, int32_t err_code, const std::string & err_info, const std::string & pb_data)
+{
+    int32_t pk_len = 2 + 24 + msg_id.length() + method_name.length() + err_info.length() + pb_data.length();
+    std::string frame;
+    frame.push_back(rocket::TinyPBProtocol::PB_START);
+    appendInt32(frame, pk_len);
+    appendInt32(frame, msg_id.length());
+    frame += msg_id;
+    appendInt32(frame, method_name.length());
+    frame += method_name;
+    appendInt32(frame, err_code);
+    appendInt32(frame, err_info.length());
+    frame += err_info;
+    frame += pb_data;
+    appendInt32(frame, 1);
+    frame.push_back(rocket::TinyPBProtocol::PB_END);
+    return frame;
+}
+
+static std::shared_ptr<rocket::TinyPBProtocol> toTinyPB(rocket::AbstractProtocol::s_ptr message)
+{
+    return std::dynamic_pointer_cast<rocket::TinyPBProtocol>(message);
+}
+
+//一个完整的包,字段都解析出来,pb数据是指向缓冲区的视图
+void test_decode_single()
+{
+    rocket::TinyPBCoder coder;
+    rocket::TcpBuffer::s_ptr buffer = std::make_shared<rocket::TcpBuffer>(16);
+    std::string frame = buildFrame("10001", "Order.makeOrder", 0, "", "pb payload");
+    buffer->writeToBuffer(frame.data(), frame.length());
+
+    std::vector<rocket::AbstractProtocol::s_ptr> messages;
+    coder.decode(messages, buffer);
+    assert(messages.size() == 1);
+    std::shared_ptr<rocket::TinyPBProtocol> message = toTinyPB(messages[0]);
+    assert(message->parse_success);
+    assert(message->m_pk_len == (int32_t)frame.length());
+    assert(message->m_msg_id == "10001");
+    assert(message->m_method_name == "Order.makeOrder");
+    assert(message->m_err_code == 0 && message->m_err_info.empty());
+    assert(std::string(message->pbData(), message->pbDataLen()) == "pb payload");
+    assert(message->m_pb_data_view != NULL && message->m_pb_data.empty());
+    assert(buffer->readAble() == 0);
+
+    //拷贝出来之后就不再依赖缓冲区
+    message->materialize();
+    assert(message->m_pb_data_view == NULL && message->m_pb_data == "pb payload");
+    std::string other = buildFrame("10002", "Order.makeOrder", 0, "", "xxxxxxxxxx");
+    buffer->writeToBuffer(other.data(), other.length());
+    assert(std::string(message->pbData(), message->pbDataLen()) == "pb payload");
+    printf("test_decode_single ok\n");
+}
+
+//包前面的脏数据丢掉,一次读到的多个包都解析出来
+void test_decode_multiple_and_garbage()
+{
+    rocket::TinyPBCoder coder;
+    rocket::TcpBuffer::s_ptr buffer = std::make_shared<rocket::TcpBuffer>(16);
+    std::string data = "garbage";
+    data += buildFrame("1", "Order.makeOrder", 0, "", "first");
+    data += buildFrame("2", "Order.makeOrder", 3, "some error", "");
+    data += buildFrame("3", "", 0, "", std::string(300, 'p'));
+    buffer->writeToBuffer(data.data(), data.length());
+
+    std::vector<rocket::AbstractProtocol::s_ptr> messages;
+    coder.decode(messages, buffer);
+    assert(messages.size() == 3);
+    assert(toTinyPB(messages[0])->m_msg_id == "1");
+    assert(std::string(toTinyPB(messages[0])->pbData(), toTinyPB(messages[0])->pbDataLen()) == "first");
+    assert(toTinyPB(messages[1])->m_msg_id == "2");
+    assert(toTinyPB(messages[1])->m_err_code == 3 && toTinyPB(messages[1])->m_err_info == "some error");
+    assert(toTinyPB(messages[1])->pbDataLen() == 0);
+    assert(toTinyPB(messages[2])->m_method_name.empty());
+    assert(toTinyPB(messages[2])->pbDataLen() == 300);
+    assert(buffer->readAble() == 0);
+    printf("test_decode_multiple_and_garbage ok\n");
+}
+
+//半包:数据没到齐之前不出包,到齐之后一次解析出来
+void test_decode_partial()
+{
+    rocket::TinyPBCoder coder;
+    rocket::TcpBuffer::s_ptr buffer = std::make_shared<rocket::TcpBuffer>(16);
+    std::string frame = buildFrame("20001", "Order.makeOrder", 0, "", "partial payload");
+    std::vector<rocket::AbstractProtocol::s_ptr> messages;
+    for (size_t i = 0; i < frame.length(); ++i)
+    {
+        buffer->writeToBuffer(&frame[i], 1);
+        coder.decode(messages, buffer);
+        if (i + 1 < frame.length())
+        {
+            assert(messages.empty());
+        }
+    }
+    assert(messages.size() == 1);
+    assert(toTinyPB(messages[0])->m_msg_id == "20001");
+    assert(std::string(toTinyPB(messages[0])->pbData(), toTinyPB(messages[0])->pbDataLen()) == "partial payload");
+
+    //一个半包后面跟着下一个包的开头
+    messages.clear();
+    std::string data = buildFrame("20002", "Order.makeOrder", 0, "", "a") + buildFrame("20003", "Order.makeOrder", 0, "", "b");
+    size_t cut = data.length() - 5;
+    buffer->writeToBuffer(data.data(), cut);
+    coder.decode(messages, buffer);
+    assert(messages.size() == 1 && toTinyPB(messages[0])->m_msg_id == "20002");
+    buffer->writeToBuffer(data.data() + cut, data.length() - cut);
+    coder.decode(messages, buffer);
+    assert(messages.size() == 2 && toTinyPB(messages[1])->m_msg_id == "20003");
+    assert(buffer->readAble() == 0);
+    printf("test_decode_partial ok\n");
+}
+
+//结束符不对或者字段长度越界的包丢掉,不影响后面的包
+void test_decode_invalid()
+{
+    rocket::TinyPBCoder coder;
+    rocket::TcpBuffer::s_ptr buffer = std::make_shared<rocket::TcpBuffer>(16);
+    std::string bad_end = buildFrame("30001", "Order.makeOrder", 0, "", "bad end");
+    bad_end[bad_end.length() - 1] = 'x';
+    std::string bad_len = buildFrame("30002", "Order.makeOrder", 0, "", "bad len");
+    //msg_id长度写得比整个包还长
+    int32_t huge = htonl(1000);
+    memcpy(&bad_len[5], &huge, sizeof(huge));
+    std::string data = bad_end + bad_len + buildFrame("30003", "Order.makeOrder", 0, "", "good");
+    buffer->writeToBuffer(data.data(), data.length());
+
+    std::vector<rocket::AbstractProtocol::s_ptr> messages;
+    coder.decode(messages, buffer);
+    assert(messages.size() == 1);
+    assert(toTinyPB(messages[0])->m_msg_id == "30003");
+    assert(std::string(toTinyPB(messages[0])->pbData(), toTinyPB(messages[0])->pbDataLen()) == "good");
+    assert(buffer->readAble() == 0);
+    printf("test_decode_invalid ok\n");
+}
+
+//包头里的长度超过max_frame_size不当半包等,跳过之后后面的包照常解析,缓冲区里不留数据
+void test_decode_oversized()
+{
+    rocket::TinyPBCoder coder;
+    rocket::TcpBuffer::s_ptr buffer = std::make_shared<rocket::TcpBuffer>(16);
+    std::string data;
+    data.push_back(rocket::TinyPBProtocol::PB_START);
+    appendInt32(data, rocket::Config::GetGlobalConfig()->m_max_frame_size + 1);
+    data += buildFrame("40001", "Order.makeOrder", 0, "", "after huge");
+    buffer->writeToBuffer(data.data(), data.length());
+
+    std::vector<rocket::AbstractProtocol::s_ptr> messages;
+    coder.decode(messages, buffer);
+    assert(messages.size() == 1);
+    assert(toTinyPB(messages[0])->m_msg_id == "40001");
+    assert(buffer->readAble() == 0);
+    printf("test_decode_oversized ok\n");
+}
+
+//encode写出来的字节和协议格式一致,并且追加在缓冲区已有数据后面
+void test_encode_bytes()
+{
+    rocket::TinyPBCoder coder;
+    rocket::TcpBuffer::s_ptr buffer = std::make_shared<rocket::TcpBuffer>(16);
+    buffer->writeToBuffer("abc", 3);
+
+    std::shared_ptr<rocket::TinyPBProtocol> message = std::make_shared<rocket::TinyPBProtocol>();
+    message->m_msg_id = "40001";
+    message->m_method_name = "Order.makeOrder";
+    message->m_err_code = 7;
+    message->m_err_info = "err";
+    message->m_pb_data = std::string(100, 'd');
+    std::vector<rocket::AbstractProtocol::s_ptr> messages;
+    messages.push_back(message);
+    coder.encode(messages, buffer);
+
+    std::string expect = "abc" + buildFrame("40001", "Order.makeOrder", 7, "err", std::string(100, 'd'));
+    assert(buffer->readAble() == (int)expect.length());
+    std::vector<char> out;
+    buffer->readFromBuffer(out, buffer->readAble());
+    assert(std::string(out.begin(), out.end()) == expect);
+    assert(message->m_pk_len == (int32_t)expect.length() - 3);
+    printf("test_encode_bytes ok\n");
+}
+
+//设置了m_pb_message时直接序列化进缓冲区,decode之后能还原出同一个pb对象
+void test_encode_pb_message_roundtrip()
+{
+    rocket::TinyPBCoder coder;
+    rocket::TcpBuffer::s_ptr buffer = std::make_shared<rocket::TcpBuffer>(16);
+
+    std::shared_ptr<makeOrderRequest> request = std::make_shared<makeOrderRequest>();
+    request->set_price(100);
+    request->set_goods(std::string(1000, 'g'));
+    std::vector<rocket::AbstractProtocol::s_ptr> messages;
+    for (int i = 0; i < 3; ++i)
+    {
+        std::shared_ptr<rocket::TinyPBProtocol> message = std::make_shared<rocket::TinyPBProtocol>();
+        message->m_msg_id = std::to_string(50000 + i);
+        message->m_method_name = "Order.makeOrder";
+        message->m_pb_message = request;
+        messages.push_back(message);
+    }
+    coder.encode(messages, buffer);
+
+    std::vector<rocket::AbstractProtocol::s_ptr> decoded;
+    coder.decode(decoded, buffer);
+    assert(decoded.size() == 3);
+    for (int i = 0; i < 3; ++i)
+    {
+        std::shared_ptr<rocket::TinyPBProtocol> message = toTinyPB(decoded[i]);
+        assert(message->m_msg_id == std::to_string(50000 + i));
+        assert(message->m_method_name == "Order.makeOrder");
+        makeOrderRequest parsed;
+        assert(parsed.ParseFromArray(message->pbData(), message->pbDataLen()));
+        assert(parsed.price() == 100 && parsed.goods() == request->goods());
+    }
+    assert(buffer->readAble() == 0);
+    printf("test_encode_pb_message_roundtrip ok\n");
+}
+
+//包跨越环形缓冲区的尾部时,decode和encode都能得到完整的包
+void test_wrapped_frame()
+{
+    rocket::TinyPBCoder coder;
+    rocket::TcpBuffer::s_ptr buffer = std::make_shared<rocket::TcpBuffer>(256);
+    std::string frame = buildFrame("60001", "Order.makeOrder", 0, "", std::string(80, 'w'));
+    //先把读写位置推到环尾附近,留10个字节的包头没读
+    std::string filler(200, 'g');
+    buffer->writeToBuffer(filler.data(), filler.length());
+    buffer->writeToBuffer(frame.data(), 10);
+    buffer->moveReadIndex(filler.length());
+    buffer->writeToBuffer(frame.data() + 10, frame.length() - 10);
+    assert(buffer->capacity() == 256);
+    assert(buffer->readIndex() + buffer->readAble() > buffer->capacity());
+
+    std::vector<rocket::AbstractProtocol::s_ptr> messages;
+    coder.decode(messages, buffer);
+    assert(messages.size() == 1);
+    assert(toTinyPB(messages[0])->m_msg_id == "60001");
+    assert(std::string(toTinyPB(messages[0])->pbData(), toTinyPB(messages[0])->pbDataLen()) == std::string(80, 'w'));
+    assert(buffer->readAble() == 0);
+
+    //编码时环尾的连续空间不够
+    buffer->writeToBuffer(filler.data(), filler.length());
+    buffer->writeToBuffer("x", 1);
+    buffer->moveReadIndex(filler.length());
+    std::shared_ptr<rocket::TinyPBProtocol> message = std::make_shared<rocket::TinyPBProtocol>();
+    message->m_msg_id = "60002";
+    message->m_method_name = "Order.makeOrder";
+    message->m_pb_data = std::string(80, 'e');
+    messages.clear();
+    messages.push_back(message);
+    coder.encode(messages, buffer);
+    assert(buffer->capacity() == 256);
+    std::vector<char> out;
+    buffer->readFromBuffer(out, buffer->readAble());
+    assert(std::string(out.begin(), out.end()) == "x" + buildFrame("60002", "Order.makeOrder", 0, "", std::string(80, 'e')));
+    printf("test_wrapped_frame ok\n");
+}
+
+int main()
+{
+    rocket::Config::SetGlobalConfig("conf/rocket.xml");
+    rocket::Logger::InitGlobalLogger();
+
+    test_decode_single();
+    test_decode_multiple_and_garbage();
+    test_decode_partial();
+    test_decode_invalid();
+    test_decode_oversized();
+    test_encode_bytes();
+    test_encode_pb_message_roundtrip();
+    test_wrapped_frame();
+    return 0;
+}